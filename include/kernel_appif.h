@@ -69,6 +69,11 @@ enum kernel_appout_type {
   KERNEL_APPOUT_LISTEN_CLOSE,
   KERNEL_APPOUT_ACCEPT_CONN,
   KERNEL_APPOUT_REQ_SCALE,
+  KERNEL_APPOUT_RDMA_REG_MR,
+  KERNEL_APPOUT_RDMA_DEREG_MR,
+  KERNEL_APPOUT_RDMA_SHARE_MR,
+  KERNEL_APPOUT_RDMA_WQ_ATTACH,
+  KERNEL_APPOUT_RDMA_WQ_DETACH,
 };
 
 /** Open a new connection */
@@ -76,6 +81,8 @@ struct kernel_appout_conn_open {
   uint64_t opaque;
   uint32_t remote_ip;
   uint32_t flags;
+  uint32_t wq_len;  // rdma, 0 for default
+  uint32_t mr_len;  // rdma, 0 for default
   uint16_t remote_port;
 } __attribute__((packed));
 
@@ -119,6 +126,8 @@ struct kernel_appout_listen_close {
 struct kernel_appout_accept_conn {
   uint64_t listen_opaque;
   uint64_t conn_opaque;
+  uint32_t wq_len;  // rdma, 0 for default
+  uint32_t mr_len;  // rdma, 0 for default
   uint16_t local_port;
 } __attribute__((packed));
 
@@ -127,6 +136,28 @@ struct kernel_appout_req_scale {
   uint32_t num_cores;
 } __attribute__((packed));
 
+/** Register or release RDMA memory region of a connection. Also used to
+ * create the memory region shared by the connections of an application, only
+ * len is used then. */
+struct kernel_appout_rdma_mr {
+  uint64_t opaque;
+  uint32_t remote_ip;
+  uint32_t local_ip;
+  uint16_t remote_port;
+  uint16_t local_port;
+  uint32_t len;
+  uint16_t key;
+} __attribute__((packed));
+
+/** Attach or release the RDMA work queue of a connection */
+struct kernel_appout_rdma_wq {
+  uint64_t opaque;
+  uint32_t remote_ip;
+  uint32_t local_ip;
+  uint16_t remote_port;
+  uint16_t local_port;
+} __attribute__((packed));
+
 /** Common struct for events on kernel -> app queue */
 struct kernel_appout {
   union {
@@ -140,6 +171,9 @@ struct kernel_appout {
 
     struct kernel_appout_req_scale    req_scale;
 
+    struct kernel_appout_rdma_mr      rdma_mr;
+    struct kernel_appout_rdma_wq      rdma_wq;
+
     uint8_t raw[63];
   } __attribute__((packed)) data;
   uint8_t type;
@@ -161,6 +195,9 @@ enum kernel_appin_type {
   KERNEL_APPIN_CONN_OPENED,
   KERNEL_APPIN_LISTEN_NEWCONN,
   KERNEL_APPIN_ACCEPTED_CONN,
+  KERNEL_APPIN_STATUS_RDMA_MR,
+  KERNEL_APPIN_STATUS_RDMA_SHARED_MR,
+  KERNEL_APPIN_STATUS_RDMA_WQ,
 };
 
 /** Generic operation status */
@@ -217,6 +254,23 @@ struct kernel_appin_accept_conn {
   uint16_t fn_core;
 } __attribute__((packed));
 
+/** RDMA memory region registered, released or shared */
+struct kernel_appin_rdma_mr {
+  uint64_t opaque;
+  uint64_t mr_off;
+  uint32_t mr_len;
+  int32_t  status;
+  uint16_t key;
+} __attribute__((packed));
+
+/** RDMA work queue attached (wq_len > 0) or released */
+struct kernel_appin_rdma_wq {
+  uint64_t opaque;
+  uint64_t wq_off;
+  uint32_t wq_len;
+  int32_t  status;
+} __attribute__((packed));
+
 /** Common struct for events on app -> kernel queue */
 #define RAW_BYTES 127 // original 63
 struct kernel_appin {
@@ -225,6 +279,8 @@ struct kernel_appin {
     struct kernel_appin_conn_opened     conn_opened;
     struct kernel_appin_listen_newconn  listen_newconn;
     struct kernel_appin_accept_conn     accept_connection;
+    struct kernel_appin_rdma_mr         rdma_mr;
+    struct kernel_appin_rdma_wq         rdma_wq;
     uint8_t raw[RAW_BYTES];  // original 63 -> rdma 127
   } __attribute__((packed)) data;
   uint8_t type;
@@ -203,11 +203,20 @@ struct obj_hdr {
 
 #define RDMA_READ 0x01
 #define RDMA_WRITE 0x02
+#define RDMA_SEND 0x04
+#define RDMA_FETCH_ADD 0x08
 #define RDMA_REQUEST 0x10
 #define RDMA_RESPONSE 0x20
+#define RDMA_CMP_SWAP 0x40
+/* Atomic responses carry the original value in offset:length (high:low) */
+/* Flags */
+#define RDMA_HDR_IMM 0x0001 /* Header followed by 32-bit immediate data */
 struct rdma_hdr {
   uint8_t type;
-  uint8_t status;
+  union {
+    uint8_t status;   /* Responses: status of the operation */
+    uint8_t key;      /* Requests: memory region key at the responder */
+  };
   beui16_t flags;
   beui32_t id;
   beui32_t offset;
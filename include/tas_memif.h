@@ -142,6 +142,7 @@ struct flextcp_pl_arx_rdmaconnupdate {
   uint64_t opaque;
   uint32_t wq_tail;
   uint32_t cq_head;
+  uint32_t rcv_tail;
 } __attribute__((packed));
 
 /** Application RX queue entry */
@@ -161,6 +162,7 @@ STATIC_ASSERT(sizeof(struct flextcp_pl_arx) == 32, arx_size);
 
 #define FLEXTCP_PL_ATX_CONNUPDATE 0x1
 #define FLEXTCP_PL_ATX_RDMAUPDATE 0x2
+#define FLEXTCP_PL_ATX_RDMARECV   0x3
 
 #define FLEXTCP_PL_ATX_FLTXDONE  0x1
 
@@ -179,11 +181,18 @@ struct flextcp_pl_atx_rdmaconnupdate {
   uint32_t cq_tail;
 } __attribute__((packed));
 
+/** RDMA Application -> Fastpath receive buffers posted */
+struct flextcp_pl_atx_rdmarecv {
+  uint32_t flow_id;
+  uint32_t rcv_head;
+} __attribute__((packed));
+
 /** Application TX queue entry */
 struct flextcp_pl_atx {
   union {
     struct flextcp_pl_atx_connupdate connupdate;
     struct flextcp_pl_atx_rdmaconnupdate rdmaupdate;
+    struct flextcp_pl_atx_rdmarecv rdmarecv;
     uint8_t raw[15];
   } __attribute__((packed)) msg;
   volatile uint8_t type;
@@ -201,6 +210,7 @@ STATIC_ASSERT(sizeof(struct flextcp_pl_atx) == 16, atx_size);
 #define FLEXNIC_PL_FLOWST_NUM     (128 * 1024)
 #define FLEXNIC_PL_FLOWHT_ENTRIES (FLEXNIC_PL_FLOWST_NUM * 2)
 #define FLEXNIC_PL_FLOWHT_NBSZ      4
+#define FLEXNIC_PL_MR_NUM           4
 
 /** Application state */
 struct flextcp_pl_appst {
@@ -232,6 +242,9 @@ struct flextcp_pl_appctx {
   uint32_t tx_head;
   uint32_t last_ts;
   uint32_t rx_avail;
+
+  /** Notifications deferred for lack of rx queue space, read by statetool */
+  uint64_t cnt_arx_deferred;
 } __attribute__((packed));
 
 /** Enable out of order receive processing members */
@@ -333,13 +346,16 @@ struct flextcp_pl_flowst {
 // 128
 
   /********************RDMA additions *********************/
-  /** Offset in buffer for new data */
+  /** Offset in transmit buffer for the next message log entry */
   uint32_t txb_head;
-  /** Offset to next segment in partially transmitted WQ entry */
-  uint32_t wqe_tx_seq;
-  /** Base address of Work/Completion queue buffer */
+  /** Message log entry of the oldest unacknowledged message */
+  uint32_t txb_tail;
+  /** Base address of Work/Completion queue buffer, followed by the receive
+   * queue of the same size, an RDMA_WQE_EXT_LEN slot for each WQE and an
+   * RDMA_WQE_TS_LEN slot for each WQE */
   uint64_t wq_base;
-  /** Base address of Reponse queue buffer */
+  /** Base address of Reponse queue buffer, followed by an RDMA_RQE_TS_LEN
+   * slot for each entry */
   uint64_t rq_base;
   /** Base address of Memory Region */
   uint64_t mr_base;
@@ -349,24 +365,44 @@ struct flextcp_pl_flowst {
   uint32_t mr_len;
   /** Offset to which new WQE will be added */
   uint32_t wq_head;
-  /** Offset of the next WQE to be processed */
+  /** Offset of the next WQE to be queued for transmission */
   uint32_t wq_tail;
   /** Offset of the oldest ack'd WQE unprocessed by application */
   uint32_t cq_head;
   /** Offset of the latest ack'd WQE unprocessed by application */
   uint32_t cq_tail;
-  /** Offset of the latest unack'd request */
+  /** Offset to which the next received request will be added */
   uint32_t rq_head;
-  /** Offset of the oldest unack'd request */
+  /** Offset of the next request to be queued for a response */
   uint32_t rq_tail;
 // 192
   /** Buffer for partially received request */
   uint8_t pending_rq_buf[16];
-  /** RQ parsing state */
+  /** RQ parsing state, RDMA_RQ_PENDING_* */
   uint32_t pending_rq_state;
-  /** Offset to next segment in partially transmitted RQ entry */
-  uint32_t rqe_tx_seq;
-// 216
+  /** Acknowledged bytes of the message at txb_tail */
+  uint32_t txb_tail_acked;
+  /** Message log entry of the next message to be transmitted */
+  uint32_t txb_pos;
+  /** Offset to next segment in partially transmitted message */
+  uint32_t txb_pos_sent;
+  /** Offset of the oldest RQ entry whose response is unacknowledged */
+  uint32_t rqe_ack_pos;
+  /** Offset of the WQ/RQ entry the payload being received belongs to */
+  uint32_t pending_rq_pos;
+  /** Memory region offset for the next payload byte being received */
+  uint32_t pending_rq_off;
+  /** Payload bytes still to be received for the pending entry */
+  uint32_t pending_rq_len;
+  /** Offset to which the application posts the next receive buffer */
+  uint32_t rcv_head;
+  /** Offset of the next posted receive buffer to be filled by a SEND */
+  uint32_t rcv_tail;
+  /** Counter read response bytes received */
+  uint32_t cnt_rx_rdresp_bytes;
+  /** Counter responses matching no WQE and WQEs failed for lack of one */
+  uint32_t cnt_rx_resp_errs;
+// 256
 } __attribute__((packed, aligned(64)));
 
 #define FLEXNIC_PL_FLOWHTE_VALID  (1 << 31)
@@ -379,6 +415,17 @@ struct flextcp_pl_flowhte {
 } __attribute__((packed));
 
 
+/** Registered RDMA memory region of a flow */
+struct flextcp_pl_mr {
+  /** Base address of the region */
+  uint64_t base;
+  /** Size in bytes, 0 if the key is not registered */
+  uint32_t len;
+  /** Zero-copy segments of the region still held by the NIC, also counted
+   * for key 0. Kept when the flow is reused. */
+  uint32_t zc_refs;
+} __attribute__((packed));
+
 #define FLEXNIC_PL_MAX_FLOWGROUPS 4096
 
 /** Layout of internal pipeline memory */
@@ -392,6 +439,9 @@ struct flextcp_pl_mem {
   /* flow lookup table */
   struct flextcp_pl_flowhte flowht[FLEXNIC_PL_FLOWHT_ENTRIES];
 
+  /* RDMA memory regions by key, key 0 is mr_base/mr_len in flow state */
+  struct flextcp_pl_mr flow_mrs[FLEXNIC_PL_FLOWST_NUM][FLEXNIC_PL_MR_NUM];
+
   /* registers for kernel queues */
   struct flextcp_pl_appctx kctx[FLEXNIC_PL_APPST_CTX_MCS];
 
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FLEXNIC_RDMA_LAT_H_
+#define FLEXNIC_RDMA_LAT_H_
+
+#include <stdint.h>
+
+/**
+ * Per-WQE latency instrumentation of the RDMA emulation.
+ *
+ * Changes the layout of the queue memory shared by TAS and librdma, so both
+ * have to be built with the same setting.
+ */
+//#define FLEXNIC_RDMA_LATENCY
+
+/** Histograms of a fast path core, by core id */
+#define FLEXNIC_RDMA_LAT_NAME "flexnic_rdmalat_%u"
+/** Histograms of an application context, by pid and context id */
+#define FLEXNIC_RDMA_LAT_APP_NAME "flexnic_rdmalat_app_%u_%u"
+
+/** Stage timestamps of a WQE, in TSC cycles, 0 if not reached yet */
+struct rdma_wqe_ts {
+  /** Posted by librdma */
+  uint64_t post;
+  /** Queued for transmission by the fast path */
+  uint64_t bump;
+  /** First byte of the request sent */
+  uint64_t tx;
+  /** Response header received */
+  uint64_t resp;
+} __attribute__((packed));
+
+#ifdef FLEXNIC_RDMA_LATENCY
+/** Timestamp slot per WQE, following the WQE extension slots */
+#  define RDMA_WQE_TS_LEN sizeof(struct rdma_wqe_ts)
+/** Arrival timestamp per response queue entry, following the queue */
+#  define RDMA_RQE_TS_LEN sizeof(uint64_t)
+#else
+#  define RDMA_WQE_TS_LEN 0
+#  define RDMA_RQE_TS_LEN 0
+#endif
+
+enum {
+  /** Posted -> queued by the fast path (fast path) */
+  RDMA_LAT_POST_BUMP,
+  /** Queued -> first byte on the wire (fast path) */
+  RDMA_LAT_BUMP_TX,
+  /** First byte on the wire -> response received (fast path) */
+  RDMA_LAT_TX_RESP,
+  /** Request received -> placed and response queued, responder (fast path) */
+  RDMA_LAT_RQ_PLACE,
+  /** Response received -> returned by the completion poll (application) */
+  RDMA_LAT_RESP_CQ,
+  /** Posted -> returned by the completion poll (application) */
+  RDMA_LAT_TOTAL,
+  RDMA_LAT_STAGES,
+};
+
+/**
+ * Log-linear (HDR) histogram buckets: values below 2^SUB_BITS are exact,
+ * above that each power of two is split into 2^SUB_BITS linear buckets.
+ */
+#define RDMA_LAT_SUB_BITS 4
+#define RDMA_LAT_SUB_NUM (1 << RDMA_LAT_SUB_BITS)
+#define RDMA_LAT_BUCKETS ((64 - RDMA_LAT_SUB_BITS + 1) << RDMA_LAT_SUB_BITS)
+
+/** Histogram of one stage in TSC cycles, single writer */
+struct flexnic_rdma_lat_hist {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[RDMA_LAT_BUCKETS];
+} __attribute__((packed));
+
+/** Shared memory segment of a fast path core or application context */
+struct flexnic_rdma_lat {
+  /** TSC frequency, 0 if unknown to the writer */
+  uint64_t tsc_hz;
+  struct flexnic_rdma_lat_hist hist[RDMA_LAT_STAGES];
+} __attribute__((packed));
+
+static inline unsigned rdma_lat_bucket(uint64_t v)
+{
+  unsigned shift;
+
+  if (v < RDMA_LAT_SUB_NUM)
+    return v;
+  shift = 63 - __builtin_clzll(v) - RDMA_LAT_SUB_BITS;
+  return ((shift + 1) << RDMA_LAT_SUB_BITS) |
+    ((v >> shift) & (RDMA_LAT_SUB_NUM - 1));
+}
+
+/** Lowest value counted in bucket idx */
+static inline uint64_t rdma_lat_bucket_value(unsigned idx)
+{
+  unsigned g = idx >> RDMA_LAT_SUB_BITS;
+  uint64_t m = idx & (RDMA_LAT_SUB_NUM - 1);
+
+  if (g == 0)
+    return m;
+  return (RDMA_LAT_SUB_NUM + m) << (g - 1);
+}
+
+static inline void rdma_lat_add(struct flexnic_rdma_lat *lat, unsigned stage,
+    uint64_t start, uint64_t end)
+{
+  struct flexnic_rdma_lat_hist *h = &lat->hist[stage];
+  uint64_t v;
+
+  if (start == 0 || end < start)
+    return;
+  v = end - start;
+
+  if (h->count == 0 || v < h->min)
+    h->min = v;
+  if (v > h->max)
+    h->max = v;
+  h->sum += v;
+  h->buckets[rdma_lat_bucket(v)]++;
+  h->count++;
+}
+
+#endif /* ndef FLEXNIC_RDMA_LAT_H_ */
@@ -1,6 +1,14 @@
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <utils.h>
+#include <utils_sync.h>
 
 #include "tas_ll.h"
 #include "tas_rdma.h"
@@ -8,7 +16,14 @@
 #include "internal.h"
 
 struct rdma_socket* fdmap[MAX_FD_NUM];
-struct flextcp_context* appctx = NULL;
+
+static __thread struct rdma_context* local_context;
+static pthread_mutex_t context_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Free file descriptors, a stack with the lowest one on top */
+static uint16_t fd_free[MAX_FD_NUM];
+static uint32_t fd_free_num = 0;
+static volatile uint32_t fd_lock = 0;
 
 /**
  * NOTE: As the TAS internal structures will change,
@@ -23,16 +38,101 @@ struct flextcp_context* appctx = NULL;
 
 static int fd_alloc(void)
 {
-    int i;
-    // Skip 0 to avoid possible confusion
-    for (i = 1; i < MAX_FD_NUM; i++)
-        if (fdmap[i] == NULL)
-            break;
+    int fd = -1;
+
+    util_spin_lock(&fd_lock);
+    if (fd_free_num > 0)
+        fd = fd_free[--fd_free_num];
+    util_spin_unlock(&fd_lock);
+
+    return fd;
+}
+
+static void fd_release(int fd)
+{
+    util_spin_lock(&fd_lock);
+    fd_free[fd_free_num++] = fd;
+    util_spin_unlock(&fd_lock);
+}
+
+#ifdef FLEXNIC_RDMA_LATENCY
+/* Latency histograms of the context in shared memory, read by rdmalattool */
+static struct flexnic_rdma_lat* rdma_lat_create(struct rdma_context* ctx)
+{
+    struct flexnic_rdma_lat* lat;
+    char name[64];
+    int fd;
+
+    snprintf(name, sizeof(name), FLEXNIC_RDMA_LAT_APP_NAME,
+        (unsigned) getpid(), ctx->c.ctx_id);
+    if ((fd = shm_open(name, O_CREAT | O_RDWR, 0600)) == -1)
+        return NULL;
+    if (ftruncate(fd, sizeof(*lat)) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    lat = mmap(NULL, sizeof(*lat), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (lat == MAP_FAILED)
+        return NULL;
+
+    memset(lat, 0, sizeof(*lat));
+    return lat;
+}
+#endif
+
+struct rdma_context* rdma_context_create(void)
+{
+    struct rdma_context* ctx = calloc(1, sizeof(struct rdma_context));
+    int ret;
+
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
 
-    if (i == MAX_FD_NUM)
+    // Requests on the TAS kernel socket must not interleave
+    pthread_mutex_lock(&context_init_mutex);
+    ret = flextcp_context_create(&ctx->c);
+    pthread_mutex_unlock(&context_init_mutex);
+    if (ret != 0)
+    {
+        free(ctx);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+#ifdef FLEXNIC_RDMA_LATENCY
+    // Not fatal, the context just goes without histograms
+    if ((ctx->lat = rdma_lat_create(ctx)) == NULL)
+        fprintf(stderr, "[WARN] %s():%u latency histograms unavailable\n",
+            __func__, __LINE__);
+#endif
+
+    local_context = ctx;
+    return ctx;
+}
+
+int rdma_context_set(struct rdma_context* ctx)
+{
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
+    }
 
-    return i;
+    local_context = ctx;
+    return 0;
+}
+
+struct flextcp_context* rdma_ctx_get(void)
+{
+    if (local_context == NULL && rdma_context_create() == NULL)
+        return NULL;
+
+    return &local_context->c;
 }
 
 int rdma_init(void)
@@ -44,30 +144,145 @@ int rdma_init(void)
         return -1;
     }
 
-    // 2. Register app context with TAS
-    appctx = calloc(1, sizeof(struct flextcp_context));
-    if (appctx == NULL)
+    // 2. Register app context of the calling thread with TAS
+    if (rdma_ctx_get() == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    if (flextcp_context_create(appctx) != 0)
+
+    // 3. Initialize internal datastructures
+    memset(fdmap, 0, sizeof(fdmap));
+    // Skip 0 to avoid possible confusion
+    for (fd_free_num = 0; fd_free_num < MAX_FD_NUM - 1; fd_free_num++)
+        fd_free[fd_free_num] = MAX_FD_NUM - 1 - fd_free_num;
+
+    return 0;
+}
+
+/* Connection establishment completed, sockets of asynchronous requests are
+ * queued until reported by rdma_conn_poll() */
+static void rdma_handshake_done(struct rdma_socket* s, int status)
+{
+    struct rdma_context* rctx = (struct rdma_context*) s->ctx;
+
+    rctx->handshakes--;
+    s->type = (status == 0 ? RDMA_CONN_SOCKET : RDMA_UNDEF_SOCKET);
+    if (!s->async)
+        return;
+
+    s->done_next = NULL;
+    if (rctx->done_last == NULL)
+        rctx->done_first = s;
+    else
+        rctx->done_last->done_next = s;
+    rctx->done_last = s;
+}
+
+/* Process a connection establishment event, returns 0 if ev is none */
+static int rdma_handshake_event(struct flextcp_event* ev)
+{
+    // Connection is at the start of its rdma_socket
+    if (ev->event_type == FLEXTCP_EV_CONN_OPEN)
+        rdma_handshake_done((struct rdma_socket*) ev->ev.conn_open.conn,
+                ev->ev.conn_open.status);
+    else if (ev->event_type == FLEXTCP_EV_LISTEN_ACCEPT)
+        rdma_handshake_done((struct rdma_socket*) ev->ev.listen_accept.conn,
+                ev->ev.listen_accept.status);
+    else
+        return 0;
+
+    return 1;
+}
+
+/* Block until the next event of the context, the response to a control
+ * request. Connection establishment events received meanwhile are
+ * processed. */
+static int rdma_control_wait(struct flextcp_context* ctx,
+        struct flextcp_event* ev)
+{
+    struct rdma_context* rctx = (struct rdma_context*) ctx;
+    int ret;
+
+    // Events put aside by rdma_handshake_poll() arrived first
+    if (rctx->pending_num > 0)
+    {
+        *ev = rctx->pending[rctx->pending_head];
+        rctx->pending_head = (rctx->pending_head + 1) % RDMA_CONTROL_PENDING;
+        rctx->pending_num--;
+        return 0;
+    }
+
+    memset(ev, 0, sizeof(struct flextcp_event));
+    while (1)
+    {
+        ret = flextcp_context_poll(ctx, 1, ev);
+        if (ret < 0)
+            return -1;
+
+        if (ret == 1 && !rdma_handshake_event(ev))
+            return 0;
+
+        if (ret == 0)
+            flextcp_block(ctx, CONTROL_TIMEOUT);
+    }
+}
+
+/* Process up to RDMA_CONTROL_POLL_BATCH connection establishment events,
+ * other events are kept for rdma_control_wait() */
+static int rdma_handshake_poll(struct flextcp_context* ctx)
+{
+    struct rdma_context* rctx = (struct rdma_context*) ctx;
+    struct flextcp_event evs[RDMA_CONTROL_POLL_BATCH];
+    uint32_t num, tail;
+    int i, ret;
+
+    // Only poll as many events as can be put aside
+    num = MIN(RDMA_CONTROL_POLL_BATCH,
+            RDMA_CONTROL_PENDING - rctx->pending_num);
+    if (num == 0)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 3. Initialize internal datastructures
-    memset(fdmap, 0, sizeof(fdmap));
+    if ((ret = flextcp_context_poll(ctx, num, evs)) < 0)
+        return -1;
 
-    return 0;
+    for (i = 0; i < ret; i++)
+    {
+        if (rdma_handshake_event(&evs[i]))
+            continue;
+
+        tail = (rctx->pending_head + rctx->pending_num) % RDMA_CONTROL_PENDING;
+        rctx->pending[tail] = evs[i];
+        rctx->pending_num++;
+    }
+    return ret;
+}
+
+/* Block until the connection establishment of s completed */
+static int rdma_handshake_wait(struct rdma_socket* s)
+{
+    int ret;
+
+    while (s->type == RDMA_PENDING_SOCKET)
+    {
+        if ((ret = rdma_handshake_poll(s->ctx)) < 0)
+            return -1;
+
+        if (ret == 0 && s->type == RDMA_PENDING_SOCKET)
+            flextcp_block(s->ctx, CONTROL_TIMEOUT);
+    }
+    return (s->type == RDMA_CONN_SOCKET ? 0 : -1);
 }
 
 int rdma_listen(const struct sockaddr_in* localaddr, int backlog)
 {
     // 1. Validate localaddr
     // TODO: Check if localaddr is same as TAS addr
-    if (localaddr == NULL || localaddr->sin_family != AF_INET)
+    struct flextcp_context* ctx = rdma_ctx_get();
+    if (ctx == NULL || localaddr == NULL || localaddr->sin_family != AF_INET)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
@@ -83,6 +298,7 @@ int rdma_listen(const struct sockaddr_in* localaddr, int backlog)
     struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
     if (s == NULL)
     {
+        fd_release(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
@@ -94,199 +310,548 @@ int rdma_listen(const struct sockaddr_in* localaddr, int backlog)
         backlog = LISTEN_BACKLOG_MAX;
 
     // 4. listen() IPC to TAS Slowpath
-    if (flextcp_listen_open(appctx, &s->l,
+    if (flextcp_listen_open(ctx, &s->l,
             ntohs(localaddr->sin_port), backlog, 0) != 0)
     {
         free(s);
+        fd_release(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 5. Block until TAS Slowpath processes the request
     struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
-    {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(appctx, 1, &ev);
-        if (ret < 0)
-        {
-            free(s);
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
-        }
-
-        if (ret == 1)
-            break;
-
-        flextcp_block(appctx, CONTROL_TIMEOUT);
-    }
-
-    // 6. Check listen() status
-    if (ev.event_type != FLEXTCP_EV_LISTEN_OPEN ||
+    if (rdma_control_wait(ctx, &ev) != 0 ||
+        ev.event_type != FLEXTCP_EV_LISTEN_OPEN ||
         ev.ev.listen_open.listener != &s->l ||
         ev.ev.listen_open.status != 0)
     {
         free(s);
+        fd_release(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 7. Store rdma_socket in fdmap
+    // 6. Store rdma_socket in fdmap
     s->type = RDMA_LISTEN_SOCKET;
+    s->ctx = ctx;
     fdmap[fd] = s;
 
     return fd;
 }
 
-int rdma_accept(int listenfd, struct sockaddr_in* remoteaddr,
-		void **mr_base, uint32_t *mr_len)
+/* Work queue size in bytes requested for a depth of wq_depth entries */
+static uint32_t rdma_wq_bytes(uint32_t wq_depth)
+{
+    if (wq_depth > UINT32_MAX / sizeof(struct rdma_wqe))
+        return UINT32_MAX / sizeof(struct rdma_wqe) * sizeof(struct rdma_wqe);
+
+    return wq_depth * sizeof(struct rdma_wqe);
+}
+
+/* Allocate FD and socket for a connection being established on ctx */
+static struct rdma_socket* rdma_handshake_socket(struct flextcp_context* ctx,
+        uint8_t async)
+{
+    struct rdma_context* rctx = (struct rdma_context*) ctx;
+
+    // Every response needs a free slot in the context's kernel queue
+    if (rctx->handshakes >= ctx->kout_len)
+        return NULL;
+
+    int fd = fd_alloc();
+    if (fd == -1)
+        return NULL;
+    struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
+    if (s == NULL)
+    {
+        fd_release(fd);
+        return NULL;
+    }
+
+    s->type = RDMA_PENDING_SOCKET;
+    s->fd = fd;
+    s->ctx = ctx;
+    s->sig_interval = 1;
+    s->async = async;
+    return s;
+}
+
+/* Request sent to TAS Slowpath, socket is published in fdmap */
+static void rdma_handshake_start(struct rdma_socket* s)
+{
+    ((struct rdma_context*) s->ctx)->handshakes++;
+    fdmap[s->fd] = s;
+}
+
+static void rdma_socket_free(struct rdma_socket* s)
+{
+    fdmap[s->fd] = NULL;
+    fd_release(s->fd);
+    free(s);
+}
+
+static int rdma_accept_start(int listenfd, uint32_t wq_depth,
+        uint32_t mr_len, uint8_t async)
 {
     // 1. Find listener rdma_socket
-    if (listenfd < 1 || listenfd >= MAX_FD_NUM)
+    struct rdma_socket* ls =
+        (listenfd > 0 && listenfd < MAX_FD_NUM) ? fdmap[listenfd] : NULL;
+    struct flextcp_context* ctx = rdma_ctx_get();
+    if (ls == NULL || ls->type != RDMA_LISTEN_SOCKET || ctx == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct rdma_socket* ls = fdmap[listenfd];
 
     // 2. Allocate FD and Socket
-    int fd = fd_alloc();
+    struct rdma_socket* s = rdma_handshake_socket(ctx, async);
+    if (s == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 3. accept() IPC to TAS Slowpath
+    if (flextcp_rdma_listen_accept(ctx, &ls->l, &s->c,
+            rdma_wq_bytes(wq_depth), mr_len) != 0)
+    {
+        rdma_socket_free(s);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    rdma_handshake_start(s);
+    return s->fd;
+}
+
+int rdma_accept(int listenfd, struct sockaddr_in* remoteaddr,
+		uint32_t wq_depth, void **mr_base, uint32_t *mr_len)
+{
+    // 1. Request connection from TAS Slowpath
+    int fd = rdma_accept_start(listenfd, wq_depth, *mr_len, 0);
     if (fd == -1)
+        return -1;
+    struct rdma_socket* s = fdmap[fd];
+
+    // 2. Block until TAS Slowpath processes the request
+    if (rdma_handshake_wait(s) != 0)
     {
+        rdma_socket_free(s);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
+
+    // 3. Update return parameters
+    *mr_base = s->c.mr;
+    *mr_len = s->c.mr_len;
+
+    // TODO: Find a way to capture the remote addr
+    return fd;
+}
+
+int rdma_accept_async(int listenfd, uint32_t wq_depth, uint32_t mr_len)
+{
+    return rdma_accept_start(listenfd, wq_depth, mr_len, 1);
+}
+
+static int rdma_connect_start(const struct sockaddr_in* remoteaddr,
+        uint32_t wq_depth, uint32_t mr_len, uint8_t async)
+{
+    // 1. Validate Remoteaddr
+    struct flextcp_context* ctx = rdma_ctx_get();
+    if (ctx == NULL || remoteaddr == NULL || remoteaddr->sin_family != AF_INET)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. Allocate FD and Socket
+    struct rdma_socket* s = rdma_handshake_socket(ctx, async);
     if (s == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 3. accept() IPC to TAS Slowpath
-    if (flextcp_listen_accept(appctx, &ls->l, &s->c) != 0)
+    // 3. connect() IPC to TAS Slowpath
+    if (flextcp_rdma_connection_open(ctx, &s->c,
+        ntohl(remoteaddr->sin_addr.s_addr), ntohs(remoteaddr->sin_port),
+        rdma_wq_bytes(wq_depth), mr_len) != 0)
     {
-        free(s);
+        rdma_socket_free(s);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 4. Block until TAS Slowpath processes the request
-    struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
+    rdma_handshake_start(s);
+    return s->fd;
+}
+
+int rdma_connect(const struct sockaddr_in* remoteaddr, uint32_t wq_depth,
+		void **mr_base, uint32_t *mr_len)
+{
+    // 1. Request connection from TAS Slowpath
+    int fd = rdma_connect_start(remoteaddr, wq_depth, *mr_len, 0);
+    if (fd == -1)
+        return -1;
+    struct rdma_socket* s = fdmap[fd];
+
+    // 2. Block until TAS Slowpath processes the request
+    if (rdma_handshake_wait(s) != 0)
     {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(appctx, 1, &ev);
-        if (ret < 0)
+        rdma_socket_free(s);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 3. Update return parameters
+    *mr_base = s->c.mr;
+    *mr_len = s->c.mr_len;
+
+    return fd;
+}
+
+int rdma_connect_async(const struct sockaddr_in* remoteaddr,
+        uint32_t wq_depth, uint32_t mr_len)
+{
+    return rdma_connect_start(remoteaddr, wq_depth, mr_len, 1);
+}
+
+/* Report completed asynchronous connection establishments */
+static int rdma_conn_harvest(struct rdma_context* rctx,
+        struct rdma_conn_ev* evs, uint32_t num)
+{
+    struct rdma_socket* s;
+    int i = 0;
+
+    while (i < num && (s = rctx->done_first) != NULL)
+    {
+        rctx->done_first = s->done_next;
+        if (rctx->done_first == NULL)
+            rctx->done_last = NULL;
+
+        evs[i].fd = s->fd;
+        if (s->type == RDMA_CONN_SOCKET)
         {
-            free(s);
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
+            evs[i].status = 0;
+            evs[i].mr_base = s->c.mr;
+            evs[i].mr_len = s->c.mr_len;
         }
+        else
+        {
+            evs[i].status = -1;
+            evs[i].mr_base = NULL;
+            evs[i].mr_len = 0;
+            rdma_socket_free(s);
+        }
+        i++;
+    }
+    return i;
+}
 
-        if (ret == 1)
-            break;
+int rdma_conn_poll(struct rdma_conn_ev* evs, uint32_t num, int timeout_ms)
+{
+    struct flextcp_context* ctx = rdma_ctx_get();
+    struct rdma_context* rctx = (struct rdma_context*) ctx;
+    int i;
 
-        flextcp_block(appctx, CONTROL_TIMEOUT);
+    if (ctx == NULL || evs == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
     }
 
-    // 5. Check accept() status
-    if (ev.event_type != FLEXTCP_EV_LISTEN_ACCEPT ||
-        ev.ev.listen_accept.conn != &s->c ||
-        ev.ev.listen_accept.status != 0)
+    if ((i = rdma_conn_harvest(rctx, evs, num)) > 0)
+        return i;
+
+    if (rdma_handshake_poll(ctx) < 0)
     {
-        free(s);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
+    if ((i = rdma_conn_harvest(rctx, evs, num)) > 0 || timeout_ms == 0 ||
+        rctx->handshakes == 0)
+        return i;
 
-    // 6. Store socket in fdmap
-    s->type = RDMA_CONN_SOCKET;
-    fdmap[fd] = s;
+    // Nothing completed, wait for TAS to kick the context
+    flextcp_block(ctx, timeout_ms);
+    if (rdma_handshake_poll(ctx) < 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    return rdma_conn_harvest(rctx, evs, num);
+}
 
-    // 7. Update return parameters
-    *mr_base = s->c.mr;
-    *mr_len = s->c.mr_len;
+/* Work queue of s attached, it is a candidate for rdma_release_idle() */
+static void rdma_wq_link(struct rdma_socket* s)
+{
+    struct rdma_context* rctx = (struct rdma_context*) s->ctx;
 
-    // TODO: Find a way to capture the remote addr
-    return fd;
+    s->wq_prev = NULL;
+    s->wq_next = rctx->wq_first;
+    if (rctx->wq_first != NULL)
+        rctx->wq_first->wq_prev = s;
+    rctx->wq_first = s;
 }
 
-int rdma_connect(const struct sockaddr_in* remoteaddr, void **mr_base,
-		uint32_t *mr_len)
+/* Work queue of s released or connection closed, no-op if not linked */
+static void rdma_wq_unlink(struct rdma_socket* s)
 {
-    // 1. Validate Remoteaddr
-    if (remoteaddr == NULL || remoteaddr->sin_family != AF_INET)
+    struct rdma_context* rctx = (struct rdma_context*) s->ctx;
+
+    if (s->wq_prev != NULL)
+        s->wq_prev->wq_next = s->wq_next;
+    else if (rctx->wq_first == s)
+        rctx->wq_first = s->wq_next;
+    else
+        return;
+
+    if (s->wq_next != NULL)
+        s->wq_next->wq_prev = s->wq_prev;
+    s->wq_prev = NULL;
+    s->wq_next = NULL;
+}
+
+int rdma_close(int fd)
+{
+    // 1. Validate socket
+    struct rdma_socket* s = (fd > 0 && fd < MAX_FD_NUM) ? fdmap[fd] : NULL;
+    if (s == NULL || s->type != RDMA_CONN_SOCKET)
     {
+        // TAS does not support closing listeners
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 2. Allocate FD and Socket
-    int fd = fd_alloc();
-    if (fd == -1)
+    // 2. close() IPC to TAS Slowpath
+    if (flextcp_connection_close(s->ctx, &s->c) != 0)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
-    if (s == NULL)
+
+    // 3. Block until TAS Slowpath processes the request
+    struct flextcp_event ev;
+    if (rdma_control_wait(s->ctx, &ev) != 0 ||
+        ev.event_type != FLEXTCP_EV_CONN_CLOSED ||
+        ev.ev.conn_closed.conn != &s->c ||
+        ev.ev.conn_closed.status != 0)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 3. connect() IPC to TAS Slowpath
-    if (flextcp_connection_open(appctx, &s->c,
-        ntohl(remoteaddr->sin_addr.s_addr), ntohs(remoteaddr->sin_port)) != 0)
+    // 4. Remove socket from fdmap
+    rdma_scq_unlink(s);
+    rdma_wq_unlink(s);
+    fdmap[fd] = NULL;
+    fd_release(fd);
+    free(s);
+
+    return 0;
+}
+
+static int rdma_mr_wait(struct rdma_socket* s, uint16_t *key)
+{
+    struct flextcp_event ev;
+
+    if (rdma_control_wait(s->ctx, &ev) != 0 ||
+        ev.event_type != FLEXTCP_EV_CONN_RDMA_MR ||
+        ev.ev.conn_rdma_mr.conn != &s->c)
+    {
+        return -1;
+    }
+    if (ev.ev.conn_rdma_mr.status != 0)
+        return ev.ev.conn_rdma_mr.status;
+
+    *key = ev.ev.conn_rdma_mr.key;
+    return 0;
+}
+
+int rdma_reg_mr(int fd, uint32_t len, void **mr_base)
+{
+    // 1. Validate socket
+    struct rdma_socket* s = (fd > 0 && fd < MAX_FD_NUM) ? fdmap[fd] : NULL;
+    if (s == NULL || s->type != RDMA_CONN_SOCKET || mr_base == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. reg_mr() IPC to TAS Slowpath
+    if (flextcp_connection_reg_mr(s->ctx, &s->c, len) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 3. Block until TAS Slowpath processes the request
+    uint16_t key;
+    if (rdma_mr_wait(s, &key) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 4. Update return parameters
+    *mr_base = s->c.rdma_mrs[key].base;
+    return key;
+}
+
+int rdma_dereg_mr(int fd, int key)
+{
+    // 1. Validate socket and key
+    struct rdma_socket* s = (fd > 0 && fd < MAX_FD_NUM) ? fdmap[fd] : NULL;
+    if (s == NULL || s->type != RDMA_CONN_SOCKET ||
+        key <= 0 || key >= FLEXTCP_RDMA_MR_NUM)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. dereg_mr() IPC to TAS Slowpath
+    if (flextcp_connection_dereg_mr(s->ctx, &s->c, key) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 3. Block until TAS Slowpath processes the request, the key stays
+    //    registered while operations still reference it
+    uint16_t k;
+    int ret = rdma_mr_wait(s, &k);
+    if (ret == -EBUSY)
+        return -EBUSY;
+    if (ret != 0 || k != key)
     {
-        free(s);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 4. Block until TAS Slowpath processes the request
+    return 0;
+}
+
+int rdma_share_mr(uint32_t len, void **mr_base)
+{
+    // 1. share_mr() IPC to TAS Slowpath
+    struct flextcp_context* ctx = rdma_ctx_get();
+    if (ctx == NULL || mr_base == NULL || flextcp_rdma_share_mr(ctx, len) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. Block until TAS Slowpath processes the request
     struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
+    if (rdma_control_wait(ctx, &ev) != 0 ||
+        ev.event_type != FLEXTCP_EV_RDMA_SHARED_MR ||
+        ev.ev.rdma_shared_mr.status != 0)
     {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(appctx, 1, &ev);
-        if (ret < 0)
-        {
-            free(s);
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
-        }
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
 
-        if (ret == 1)
-            break;
+    // 3. Update return parameters
+    *mr_base = ev.ev.rdma_shared_mr.mr;
+    return 0;
+}
 
-        flextcp_block(appctx, CONTROL_TIMEOUT);
+static int rdma_wq_wait(struct rdma_socket* s)
+{
+    struct flextcp_event ev;
+
+    if (rdma_control_wait(s->ctx, &ev) != 0 ||
+        ev.event_type != FLEXTCP_EV_CONN_RDMA_WQ ||
+        ev.ev.conn_rdma_wq.conn != &s->c)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
     }
 
-    // 5. Check accept() status
-    if (ev.event_type != FLEXTCP_EV_CONN_OPEN ||
-        ev.ev.conn_open.conn != &s->c ||
-        ev.ev.conn_open.status != 0)
+    return ev.ev.conn_rdma_wq.status == 0 ? 0 : -1;
+}
+
+int rdma_wq_attach(struct rdma_socket* s)
+{
+    // 1. wq_attach() IPC to TAS Slowpath
+    if (flextcp_connection_wq_attach(s->ctx, &s->c) != 0)
     {
-        free(s);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 6. Store rdma_socket in fdmap
-    s->type = RDMA_CONN_SOCKET;
-    fdmap[fd] = s;
+    // 2. Block until TAS Slowpath processes the request
+    if (rdma_wq_wait(s) != 0 || s->c.wq_base == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
 
-    // 7. Update return parameters
-    *mr_base = s->c.mr;
-    *mr_len = s->c.mr_len;
+    rdma_wq_link(s);
+    return 0;
+}
 
-    return fd;
+int rdma_release_idle(void)
+{
+    struct flextcp_context* ctx = rdma_ctx_get();
+    struct rdma_context* rctx = (struct rdma_context*) ctx;
+    struct rdma_socket *s, *rs;
+    struct flextcp_event ev;
+    uint32_t max, sent;
+    int released = 0;
+
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    s = rctx->wq_first;
+    while (s != NULL)
+    {
+        // 1. Send detach requests for as many idle connections as there is
+        //    room for in the kernel queues, responses of connections being
+        //    established need a slot as well
+        max = MIN(ctx->kin_len, ctx->kout_len - rctx->handshakes);
+        if (max == 0)
+            break;
+
+        for (sent = 0; s != NULL && sent < max; s = s->wq_next)
+        {
+            // Skip connections used since the previous call
+            if (s->wq_used)
+            {
+                s->wq_used = 0;
+                continue;
+            }
+
+            // Skipped if operations are outstanding, the slow path refuses
+            // the release if the fast path is still busy with the connection
+            if (flextcp_connection_wq_detach(ctx, &s->c) == 0)
+                sent++;
+        }
+
+        // 2. Collect the responses once all requests are out
+        for (; sent > 0; sent--)
+        {
+            if (rdma_control_wait(ctx, &ev) != 0 ||
+                ev.event_type != FLEXTCP_EV_CONN_RDMA_WQ)
+            {
+                fprintf(stderr, "[ERROR] %s():%u failed\n", __func__,
+                        __LINE__);
+                return -1;
+            }
+
+            // Connection is at the start of its rdma_socket
+            rs = (struct rdma_socket*) ev.ev.conn_rdma_wq.conn;
+            if (ev.ev.conn_rdma_wq.status == 0 && rs->c.wq_base == NULL)
+            {
+                rdma_wq_unlink(rs);
+                released++;
+            }
+        }
+    }
+    return released;
 }
@@ -19,61 +19,288 @@ static inline void print_wqe(struct flextcp_connection* c, int num)
 }
 #endif
 
-/* NOTE: Two data operations must not be called concurrently on the same
- * 'fd'
+/* NOTE: Data operations on connections bound to the same context must not
+ * be called concurrently
  */
 
+/* Socket for fd, NULL if it is not a connected RDMA socket */
+static inline struct rdma_socket* rdma_fd_socket(int fd)
+{
+  if (fd < 1 || fd >= MAX_FD_NUM || fdmap[fd] == NULL
+      || fdmap[fd]->type != RDMA_CONN_SOCKET)
+    return NULL;
+  return fdmap[fd];
+}
+
+/* Mark every sig_interval-th operation as signaled */
+static inline uint16_t rdma_sig_flags(struct rdma_socket* s, uint16_t flags)
+{
+  if (s->sig_interval != 0 && ++s->sig_count >= s->sig_interval)
+  {
+    s->sig_count = 0;
+    flags |= RDMA_WQE_SIGNALED;
+  }
+  return flags;
+}
+
+/* Extension slot of the WQE at offset pos, holding SGE list or payload */
+static inline void* rdma_wqe_ext(struct flextcp_connection* c, uint32_t pos)
+{
+  return c->rcv_base + c->wq_size +
+      pos / sizeof(struct rdma_wqe) * RDMA_WQE_EXT_LEN;
+}
+
+#ifdef FLEXNIC_RDMA_LATENCY
+/* Timestamps of the WQE at offset pos, the slots follow the extensions */
+static inline struct rdma_wqe_ts* rdma_wqe_ts(struct flextcp_connection* c,
+    uint32_t pos)
+{
+  return (struct rdma_wqe_ts*)(c->rcv_base + c->wq_size +
+      c->wq_size / sizeof(struct rdma_wqe) * RDMA_WQE_EXT_LEN +
+      pos / sizeof(struct rdma_wqe) * RDMA_WQE_TS_LEN);
+}
+
+/* The WQE at offset pos is taken off the completion queue */
+static inline void rdma_lat_cq(struct flextcp_connection* c, uint32_t pos)
+{
+  // Connection is at the start of its rdma_socket
+  struct rdma_context* rctx =
+      (struct rdma_context*) ((struct rdma_socket*) c)->ctx;
+  struct rdma_wqe_ts* ts = rdma_wqe_ts(c, pos);
+  uint64_t now;
+
+  if (rctx->lat == NULL)
+    return;
+
+  now = util_rdtsc();
+  rdma_lat_add(rctx->lat, RDMA_LAT_RESP_CQ, ts->resp, now);
+  rdma_lat_add(rctx->lat, RDMA_LAT_TOTAL, ts->post, now);
+}
+#endif
+
+/* The work queue is attached on first use */
+static inline int rdma_wq_ready(struct rdma_socket* s)
+{
+  s->wq_used = 1;
+  if (LIKELY(s->c.wq_base != NULL))
+    return 0;
+  return rdma_wq_attach(s);
+}
+
+/* Fill the WQE after the 'pending' entries not yet added to wq_len */
+static inline int32_t rdma_wqe_fill(struct flextcp_connection* c,
+    uint32_t pending, uint8_t type, uint16_t flags, uint32_t len,
+    uint32_t loffset, uint32_t roffset)
+{
+  uint32_t wq_head = (c->wq_tail + c->wq_len + pending) % c->wq_size;
+  struct rdma_wqe* wqe_pos = (struct rdma_wqe*)(c->wq_base + wq_head);
+
+  wqe_pos->id = wq_head;
+  wqe_pos->type = type;
+  wqe_pos->status = RDMA_PENDING;
+  wqe_pos->flags = flags;
+  wqe_pos->loff = loffset;
+  wqe_pos->roff = roffset;
+  wqe_pos->len = len;
+  wqe_pos->imm = 0;
+  wqe_pos->lkey = 0;
+  wqe_pos->rkey = 0;
+#ifdef FLEXNIC_RDMA_LATENCY
+  struct rdma_wqe_ts* ts = rdma_wqe_ts(c, wq_head);
+  ts->post = util_rdtsc();
+  ts->bump = 0;
+  ts->tx = 0;
+  ts->resp = 0;
+#endif
+  return wq_head;
+}
+
+/* Post a single WQE. Operands of atomics are carried in the extension slot
+ * of the entry, the original remote value is returned to the local memory
+ * region at loffset. */
+static int rdma_post_wqe(struct rdma_socket* s, uint8_t type, uint32_t len,
+    uint32_t loffset, uint32_t roffset, uint32_t imm, const void* ops)
+{
+  struct flextcp_connection* c = &s->c;
+  uint32_t llen = (ops != NULL ? sizeof(uint64_t) : len);
+
+  // 1. Validate address in memory region
+  if (((uint64_t) loffset + llen) > c->mr_len)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  // 2. Acquire Work Queue Entry, one entry stays free
+  if (rdma_wq_ready(s) != 0
+      || c->wq_len + c->cq_len + sizeof(struct rdma_wqe) >= c->wq_size){
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+  if (ops != NULL)
+    memcpy(rdma_wqe_ext(c, (c->wq_tail + c->wq_len) % c->wq_size), ops, len);
+  int32_t id = rdma_wqe_fill(c, 0, type, rdma_sig_flags(s, 0), len,
+      loffset, roffset);
+  ((struct rdma_wqe*) (c->wq_base + id))->imm = imm;
+
+  // 3. Increment Queue length and bump the fast path
+  uint32_t old_len = c->wq_len;
+  MEM_BARRIER();
+  c->wq_len += sizeof(struct rdma_wqe);
+  if (rdma_conn_bump(s->ctx, c) < 0) {
+    c->wq_len = old_len;
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+#ifdef PRINT_WQE
+  print_wqe(c, 5);
+#endif
+
+  return id;
+}
+
 int rdma_read(int fd, uint32_t len, uint32_t loffset, uint32_t roffset)
 {
-  // 1. Find listener socket
-  if (fd < 1 || fd >= MAX_FD_NUM)
+  struct rdma_socket* s = rdma_fd_socket(fd);
+
+  if (s == NULL)
   {
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
-  struct rdma_socket* s = fdmap[fd];
-  if (s->type != RDMA_CONN_SOCKET)
+
+  return rdma_post_wqe(s, RDMA_OP_READ, len, loffset, roffset, 0, NULL);
+}
+
+int rdma_write(int fd, uint32_t len, uint32_t loffset, uint32_t roffset)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+
+  if (s == NULL)
   {
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
-  struct flextcp_connection* c = &s->c;
 
-  // 2. Validate address in memory region
-  if (((uint64_t) loffset + len) > c->mr_len)
+  return rdma_post_wqe(s, RDMA_OP_WRITE, len, loffset, roffset, 0, NULL);
+}
+
+int rdma_send(int fd, uint32_t len, uint32_t loffset)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+
+  if (s == NULL)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  return rdma_post_wqe(s, RDMA_OP_SEND, len, loffset, 0, 0, NULL);
+}
+
+int rdma_write_inline(int fd, const void* buf, uint32_t len,
+    uint32_t roffset)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+  struct flextcp_connection* c;
+  uint32_t wq_head;
+
+  if (s == NULL || len > RDMA_MAX_INLINE)
   {
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
+  c = &s->c;
 
-  // 3. Acquire Work Queue Entry
-  // NOTE: c->wq_len must be a multiple of sizeof(struct rdma_wqe)
-  if (c->wq_len + c->cq_len == c->wq_size){
-    // Queue full!
+  // 1. Acquire Work Queue Entry, one entry stays free
+  if (rdma_wq_ready(s) != 0
+      || c->wq_len + c->cq_len + sizeof(struct rdma_wqe) >= c->wq_size){
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
-  uint32_t wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
-  struct rdma_wqe* wqe_pos = (struct rdma_wqe*)(c->wq_base + wq_head);
 
-  // 4. Fill entries of Work Queue
-  int32_t id;
-  id = wqe_pos->id = (c->wq_tail + c->wq_len) % c->wq_size;
-  wqe_pos->type = RDMA_OP_READ;
-  wqe_pos->status = RDMA_PENDING;
-  wqe_pos->loff = loffset;
-  wqe_pos->roff = roffset;
-  wqe_pos->len = len;
+  // 2. Copy payload into the entry
+  wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
+  memcpy(rdma_wqe_ext(c, wq_head), buf, len);
+  int32_t id = rdma_wqe_fill(c, 0, RDMA_OP_WRITE,
+      rdma_sig_flags(s, RDMA_WQE_INLINE), len, 0, roffset);
 
-  // 5. Increment Queue length
+  // 3. Increment Queue length and bump the fast path
   uint32_t old_len = c->wq_len;
   MEM_BARRIER();
   c->wq_len += sizeof(struct rdma_wqe);
+  if (rdma_conn_bump(s->ctx, c) < 0) {
+    c->wq_len = old_len;
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  return id;
+}
+
+int rdma_write_imm(int fd, uint32_t len, uint32_t loffset, uint32_t roffset,
+    uint32_t imm)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+
+  if (s == NULL)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  return rdma_post_wqe(s, RDMA_OP_WRITE_IMM, len, loffset, roffset, imm,
+      NULL);
+}
+
+int rdma_write_sgl(int fd, const struct rdma_sge* sgl, uint32_t num,
+    uint32_t roffset)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+  struct flextcp_connection* c;
+  uint64_t len = 0;
+  uint32_t i, wq_head;
+
+  if (s == NULL || num == 0 || num > RDMA_MAX_SGE)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+  c = &s->c;
+
+  // 1. Validate segments in memory region
+  for (i = 0; i < num; i++)
+  {
+    if (((uint64_t) sgl[i].loff + sgl[i].len) > c->mr_len)
+    {
+      fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+      return -1;
+    }
+    len += sgl[i].len;
+  }
+  if (len > UINT32_MAX)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  // 2. Acquire Work Queue Entry, one entry stays free
+  if (rdma_wq_ready(s) != 0
+      || c->wq_len + c->cq_len + sizeof(struct rdma_wqe) >= c->wq_size){
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+  wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
+  memcpy(rdma_wqe_ext(c, wq_head), sgl, num * sizeof(*sgl));
+  int32_t id = rdma_wqe_fill(c, 0, RDMA_OP_WRITE,
+      rdma_sig_flags(s, RDMA_WQE_SGL), len, num, roffset);
 
-  // TODO: Handle the case where bump queue is full
-  // 6. Bump the fast path
-  if (rdma_conn_bump(appctx, c) < 0) {
-    // Undo the length increment (effectively revert adding wqe)
+  // 3. Increment Queue length and bump the fast path
+  uint32_t old_len = c->wq_len;
+  MEM_BARRIER();
+  c->wq_len += sizeof(struct rdma_wqe);
+  if (rdma_conn_bump(s->ctx, c) < 0) {
     c->wq_len = old_len;
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
@@ -82,83 +309,226 @@ int rdma_read(int fd, uint32_t len, uint32_t loffset, uint32_t roffset)
   return id;
 }
 
-int rdma_write(int fd, uint32_t len, uint32_t loffset, uint32_t roffset)
+int rdma_fetch_add(int fd, uint32_t loffset, uint32_t roffset, uint64_t add)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+  uint64_t ops[1] = { add };
+
+  if (s == NULL || roffset % sizeof(uint64_t) != 0)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  return rdma_post_wqe(s, RDMA_OP_FETCH_ADD, sizeof(ops), loffset, roffset,
+      0, ops);
+}
+
+int rdma_cmp_swap(int fd, uint32_t loffset, uint32_t roffset,
+    uint64_t compare, uint64_t swap)
 {
-  // 1. Find listener socket
-  if (fd < 1 || fd >= MAX_FD_NUM)
+  struct rdma_socket* s = rdma_fd_socket(fd);
+  uint64_t ops[2] = { compare, swap };
+
+  if (s == NULL || roffset % sizeof(uint64_t) != 0)
   {
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
-  struct rdma_socket* s = fdmap[fd];
-  if (s->type != RDMA_CONN_SOCKET)
+
+  return rdma_post_wqe(s, RDMA_OP_CMP_SWAP, sizeof(ops), loffset, roffset,
+      0, ops);
+}
+
+int rdma_post_recv(int fd, uint32_t len, uint32_t loffset)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+  struct flextcp_connection* c;
+
+  if (s == NULL)
   {
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
-  struct flextcp_connection* c = &s->c;
+  c = &s->c;
 
-  // 2. Validate address in memory region
+  // 1. Validate address in memory region
   if (((uint64_t) loffset + len) > c->mr_len)
   {
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
 
-#ifdef PRINT_WQE
-  fprintf(stderr, "%u, %u, %u\n", c->wq_len, c->cq_len, c->wq_size);
+  // 2. Acquire Receive Queue Entry, one entry stays free
+  if (rdma_wq_ready(s) != 0
+      || c->rcv_len + c->rcv_cq_len + sizeof(struct rdma_wqe) >= c->wq_size){
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+  uint32_t rcv_head = (c->rcv_tail + c->rcv_len) % c->wq_size;
+  struct rdma_wqe* rcv = (struct rdma_wqe*)(c->rcv_base + rcv_head);
+  rcv->id = rcv_head;
+  rcv->type = RDMA_OP_RECV;
+  rcv->status = RDMA_PENDING;
+  rcv->flags = RDMA_WQE_SIGNALED;
+  rcv->loff = loffset;
+  rcv->roff = 0;
+  rcv->len = len;
+  rcv->imm = 0;
+  rcv->lkey = 0;
+  rcv->rkey = 0;
+
+  // 3. Increment Queue length and bump the fast path
+  uint32_t old_len = c->rcv_len;
+  MEM_BARRIER();
+  c->rcv_len += sizeof(struct rdma_wqe);
+  if (rdma_conn_recv_bump(s->ctx, c) < 0) {
+    c->rcv_len = old_len;
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  return rcv_head;
+}
+
+/* Next completion to be reported, unsignaled successful ones are retired.
+ * Filled receive entries follow work queue completions. */
+static inline struct rdma_wqe* rdma_cq_next(struct flextcp_connection* c)
+{
+  struct rdma_wqe* wqe;
+
+  while (c->cq_len > 0)
+  {
+    wqe = (struct rdma_wqe*)(c->wq_base + c->cq_tail);
+#ifdef FLEXNIC_RDMA_LATENCY
+    rdma_lat_cq(c, c->cq_tail);
 #endif
 
-  // 3. Acquire Work Queue Entry
-  // NOTE: c->wq_len must be a multiple of sizeof(struct rdma_wqe)
-  if (c->wq_len + c->cq_len == c->wq_size){
-    // Queue full!
+    // Update queue pointers and length
+    c->cq_tail = (c->cq_tail + sizeof(struct rdma_wqe)) % c->wq_size;
+    c->cq_len -= sizeof(struct rdma_wqe);
+
+    if ((wqe->flags & RDMA_WQE_SIGNALED) != 0 || wqe->status != RDMA_SUCCESS)
+      return wqe;
+  }
+
+  if (c->rcv_cq_len > 0)
+  {
+    wqe = (struct rdma_wqe*)(c->rcv_base + c->rcv_cq_tail);
+    c->rcv_cq_tail = (c->rcv_cq_tail + sizeof(struct rdma_wqe)) % c->wq_size;
+    c->rcv_cq_len -= sizeof(struct rdma_wqe);
+    return wqe;
+  }
+  return NULL;
+}
+
+int rdma_post_batch(int fd, const struct rdma_wr* wrs, uint32_t num)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+  struct flextcp_connection* c;
+  uint32_t i, len, free_len, pending;
+  uint8_t inline_ok;
+
+  if (s == NULL)
+  {
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
+  c = &s->c;
 
-  uint32_t wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
-  struct rdma_wqe* wqe_pos = (struct rdma_wqe*)(c->wq_base + wq_head);
+  // 1. Validate all requests before anything is posted
+  for (i = 0; i < num; i++)
+  {
+    if (wrs[i].lkey >= FLEXTCP_RDMA_MR_NUM
+        || wrs[i].rkey >= FLEXTCP_RDMA_MR_NUM)
+    {
+      fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+      return -1;
+    }
+    switch (wrs[i].type)
+    {
+      case RDMA_OP_READ:
+      case RDMA_OP_WRITE:
+      case RDMA_OP_SEND:
+      case RDMA_OP_WRITE_IMM:
+        len = wrs[i].len;
+        inline_ok = (wrs[i].type != RDMA_OP_READ
+            && wrs[i].len <= RDMA_MAX_INLINE);
+        break;
+      case RDMA_OP_FETCH_ADD:
+      case RDMA_OP_CMP_SWAP:
+        // Only the original value is written to local memory
+        len = sizeof(uint64_t);
+        inline_ok = 0;
+        if (wrs[i].roff % sizeof(uint64_t) == 0)
+          break;
+        // fall through
+      default:
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    if (((uint64_t) wrs[i].loff + len) > c->rdma_mrs[wrs[i].lkey].len
+        || ((wrs[i].flags & RDMA_WQE_INLINE) != 0 && !inline_ok))
+    {
+      fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+      return -1;
+    }
+  }
 
-  // 4. Fill entries of Work Queue
-  int32_t id;
-  id = wqe_pos->id = (c->wq_tail + c->wq_len) % c->wq_size;
-  wqe_pos->type = RDMA_OP_WRITE;
-  wqe_pos->status = RDMA_PENDING;
-  wqe_pos->loff = loffset;
-  wqe_pos->roff = roffset;
-  wqe_pos->len = len;
+  // 2. Post as many as fit, one entry stays free
+  if (rdma_wq_ready(s) != 0)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+  free_len = c->wq_size - c->wq_len - c->cq_len - sizeof(struct rdma_wqe);
+  if (num > free_len / sizeof(struct rdma_wqe))
+    num = free_len / sizeof(struct rdma_wqe);
+  if (num == 0)
+    return 0;
+
+  pending = 0;
+  for (i = 0; i < num; i++)
+  {
+    len = wrs[i].len;
+    if (wrs[i].type == RDMA_OP_FETCH_ADD)
+      len = sizeof(uint64_t);
+    else if (wrs[i].type == RDMA_OP_CMP_SWAP)
+      len = 2 * sizeof(uint64_t);
+
+    int32_t id = rdma_wqe_fill(c, pending, wrs[i].type,
+        rdma_sig_flags(s, wrs[i].flags), len, wrs[i].loff, wrs[i].roff);
+    struct rdma_wqe* wqe = (struct rdma_wqe*)(c->wq_base + id);
+    wqe->lkey = wrs[i].lkey;
+    wqe->rkey = wrs[i].rkey;
+    wqe->imm = wrs[i].imm;
+    if ((wrs[i].flags & RDMA_WQE_INLINE) != 0)
+      memcpy(rdma_wqe_ext(c, id), c->rdma_mrs[wrs[i].lkey].base + wrs[i].loff,
+          wrs[i].len);
+    else if (wrs[i].type == RDMA_OP_FETCH_ADD
+        || wrs[i].type == RDMA_OP_CMP_SWAP)
+      memcpy(rdma_wqe_ext(c, id), wrs[i].ops, len);
+    pending += sizeof(struct rdma_wqe);
+  }
 
-  // 5. Increment Queue length
+  // 3. Single bump for the whole batch
   uint32_t old_len = c->wq_len;
   MEM_BARRIER();
-  c->wq_len += sizeof(struct rdma_wqe);
+  c->wq_len += pending;
 
-  // TODO: Handle the case where bump queue is full
-  // 6. Bump the fast path
-  if (rdma_conn_bump(appctx, c) < 0) {
-    // Undo the length increment (effectively revert adding wqe)
+  if (rdma_conn_bump(s->ctx, c) < 0) {
     c->wq_len = old_len;
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
   }
 
-#ifdef PRINT_WQE
-  print_wqe(c, 5);
-#endif
-
-  return id;
+  return num;
 }
 
 int rdma_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num){
   int ret;
-  if (fd < 1 || fd >= MAX_FD_NUM)
-  {
-    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-    return -1;
-  }
-  struct rdma_socket* s = fdmap[fd];
-  if (s->type != RDMA_CONN_SOCKET)
+  struct rdma_socket* s = rdma_fd_socket(fd);
+  if (s == NULL)
   {
     fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
     return -1;
@@ -169,33 +539,35 @@ int rdma_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num){
   fprintf(stderr, " rdma_cq_poll: cq_len=%u, cq_tail=%u\n", c->cq_len, c->cq_tail);
 #endif
 
-  if (c->cq_len < num * sizeof(struct rdma_wqe))
+  int i = 0;
+  struct rdma_wqe* wqe;
+  while (i < num && (wqe = rdma_cq_next(c)) != NULL)
+  {
+    // Copy the wqe data
+    memcpy(compl_evs + i, wqe, sizeof(struct rdma_wqe));
+    i += 1;
+  }
+
+  // Unsignaled entries are retired without being reported, so the queue
+  // length says nothing about how many completions can be returned
+  if (i < num)
   {
-    ret = rdma_fastpath_poll(appctx, c, num * sizeof(struct rdma_wqe));
+    // Updates for other connections of the context are kept on them
+    ret = rdma_cq_fastpath_poll(s->ctx, RDMA_POLL_BATCH);
     if (ret < 0){
       fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
       return -1;
     }
-  }
 
 #ifdef PRINT_WQE
-  fprintf(stderr, " after_fastpoll: cq_len=%u, cq_tail=%u\n", c->cq_len, c->cq_tail);
+    fprintf(stderr, " after_fastpoll: cq_len=%u, cq_tail=%u\n", c->cq_len, c->cq_tail);
 #endif
 
-  int i = 0;
-  struct rdma_wqe* wqe;
-  struct rdma_wqe* ev;
-  while(c->cq_len > 0 && i < num){
-    wqe = (struct rdma_wqe*)(c->wq_base + c->cq_tail);
-    ev = compl_evs + i;
-
-    // Copy the wqe data
-    memcpy(ev, wqe, sizeof(struct rdma_wqe));
-
-    // Update queue pointers and length
-    c->cq_tail = (c->cq_tail + sizeof(struct rdma_wqe)) % c->wq_size;
-    c->cq_len -= sizeof(struct rdma_wqe);
-    i += 1;
+    while (i < num && (wqe = rdma_cq_next(c)) != NULL)
+    {
+      memcpy(compl_evs + i, wqe, sizeof(struct rdma_wqe));
+      i += 1;
+    }
   }
 
 #ifdef PRINT_WQE
@@ -205,3 +577,151 @@ int rdma_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num){
 
   return i;
 }
+
+int rdma_set_signal_interval(int fd, uint32_t interval)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+
+  if (s == NULL)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  s->sig_interval = interval;
+  s->sig_count = 0;
+  return 0;
+}
+
+struct rdma_cq* rdma_scq_create(void)
+{
+  struct flextcp_context* ctx = rdma_ctx_get();
+  struct rdma_cq* cq;
+
+  if (ctx == NULL || (cq = calloc(1, sizeof(struct rdma_cq))) == NULL)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return NULL;
+  }
+
+  cq->ctx = ctx;
+  return cq;
+}
+
+int rdma_scq_attach(int fd, struct rdma_cq* cq)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+
+  if (s == NULL || cq == NULL || s->c.rdma_cq != NULL || s->ctx != cq->ctx)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  s->c.rdma_cq = &cq->c;
+  cq->num_conns++;
+  if (s->c.cq_len > 0 || s->c.rcv_cq_len > 0)
+    rdma_cq_conn_ready(&cq->c, &s->c);
+  return 0;
+}
+
+void rdma_scq_unlink(struct rdma_socket* s)
+{
+  // Completion queue state is at the start of its rdma_cq
+  struct rdma_cq* cq = (struct rdma_cq*) s->c.rdma_cq;
+
+  if (cq == NULL)
+    return;
+
+  rdma_cq_conn_remove(&cq->c, &s->c);
+  s->c.rdma_cq = NULL;
+  cq->num_conns--;
+}
+
+int rdma_scq_detach(int fd)
+{
+  struct rdma_socket* s = rdma_fd_socket(fd);
+
+  if (s == NULL || s->c.rdma_cq == NULL)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  rdma_scq_unlink(s);
+  return 0;
+}
+
+int rdma_scq_destroy(struct rdma_cq* cq)
+{
+  if (cq == NULL || cq->num_conns != 0)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  free(cq);
+  return 0;
+}
+
+/* Copy completions of ready connections, in notification order */
+static inline int rdma_scq_harvest(struct rdma_cq* cq,
+    struct rdma_cqe* compl_evs, uint32_t num)
+{
+  struct flextcp_connection* c;
+  struct rdma_wqe* wqe;
+  int i = 0;
+
+  while (i < num && (c = cq->c.ready_first) != NULL)
+  {
+    while (i < num && (wqe = rdma_cq_next(c)) != NULL)
+    {
+      // Connection is at the start of its rdma_socket
+      compl_evs[i].fd = ((struct rdma_socket*) c)->fd;
+      memcpy(&compl_evs[i].wqe, wqe, sizeof(struct rdma_wqe));
+      i += 1;
+    }
+
+    if (c->cq_len > 0 || c->rcv_cq_len > 0)
+      break;
+
+    // No more completions, remove from ready list
+    cq->c.ready_first = c->rdma_cq_next;
+    if (cq->c.ready_first == NULL)
+      cq->c.ready_last = NULL;
+    c->rdma_cq_ready = 0;
+  }
+  return i;
+}
+
+int rdma_scq_poll(struct rdma_cq* cq, struct rdma_cqe* compl_evs,
+    uint32_t num, int timeout_ms)
+{
+  int i;
+
+  if (cq == NULL)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+
+  if ((i = rdma_scq_harvest(cq, compl_evs, num)) > 0)
+    return i;
+
+  if (rdma_cq_fastpath_poll(cq->ctx, RDMA_POLL_BATCH) < 0)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+  if ((i = rdma_scq_harvest(cq, compl_evs, num)) > 0 || timeout_ms == 0)
+    return i;
+
+  // Nothing pending, wait for TAS to kick the context
+  flextcp_block(cq->ctx, timeout_ms);
+  if (rdma_cq_fastpath_poll(cq->ctx, RDMA_POLL_BATCH) < 0)
+  {
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+  }
+  return rdma_scq_harvest(cq, compl_evs, num);
+}
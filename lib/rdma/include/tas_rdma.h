@@ -12,7 +12,12 @@
  */
 enum rdma_op_type_e {
     RDMA_OP_READ,
-    RDMA_OP_WRITE
+    RDMA_OP_WRITE,
+    RDMA_OP_SEND,
+    RDMA_OP_RECV,
+    RDMA_OP_FETCH_ADD,
+    RDMA_OP_CMP_SWAP,
+    RDMA_OP_WRITE_IMM
 };
 
 /**
@@ -26,9 +31,41 @@ enum rdma_op_status_e {
     RDMA_TX_PENDING,
     RDMA_RESP_PENDING,
     RDMA_CONN_FAILURE,
-    RDMA_OUT_OF_BOUNDS
+    RDMA_OUT_OF_BOUNDS,
+    RDMA_RECV_NOT_READY
 };
 
+/**
+ * Flags of RDMA Work Queue Entry
+ */
+#define RDMA_WQE_SIGNALED   0x1  /**> Report a completion event */
+#define RDMA_WQE_SGL        0x2  /**> Payload gathered from the SGE list of
+                                      the entry, loff is the number of SGEs */
+#define RDMA_WQE_INLINE     0x4  /**> Payload carried in the entry */
+
+/**
+ * Scatter-gather element, a segment of local memory region
+ */
+struct rdma_sge {
+    uint32_t loff;  /**> Local offset */
+    uint32_t len;
+} __attribute__((packed));
+
+/**
+ * Each WQE has an extension slot holding its SGE list or inline payload
+ */
+#define RDMA_WQE_EXT_LEN 64
+
+/**
+ * Maximum number of segments gathered by a single operation
+ */
+#define RDMA_MAX_SGE (RDMA_WQE_EXT_LEN / 8)
+
+/**
+ * Maximum payload of an inline operation
+ */
+#define RDMA_MAX_INLINE RDMA_WQE_EXT_LEN
+
 /**
  * RDMA Work/Completion Queue Entry
  */
@@ -40,8 +77,59 @@ struct rdma_wqe {
     uint32_t loff;  /**> Local offset */
     uint32_t roff;  /**> Remote offset */
     uint32_t len;
+    uint32_t imm;   /**> Immediate data of RDMA_OP_WRITE_IMM */
+    uint16_t lkey;  /**> Key of local memory region */
+    uint16_t rkey;  /**> Key of remote memory region */
 } __attribute__((packed));
 
+/**
+ * RDMA work request, posted in batches with rdma_post_batch()
+ */
+struct rdma_wr {
+    uint8_t type;   /**> RDMA_OP_READ, RDMA_OP_WRITE, RDMA_OP_SEND,
+                         RDMA_OP_WRITE_IMM, RDMA_OP_FETCH_ADD or
+                         RDMA_OP_CMP_SWAP */
+    uint16_t flags; /**> RDMA_WQE_SIGNALED to always report completion,
+                         RDMA_WQE_INLINE to copy the payload at posting */
+    uint32_t loff;  /**> Local offset, the original value of atomics is
+                         returned there */
+    uint32_t roff;  /**> Remote offset, unused for RDMA_OP_SEND */
+    uint32_t len;   /**> Unused for atomics */
+    uint16_t lkey;  /**> Key of local memory region, 0 is the default one */
+    uint16_t rkey;  /**> Key of remote memory region, 0 is the default one */
+    uint32_t imm;   /**> Immediate data of RDMA_OP_WRITE_IMM */
+    uint64_t ops[2];/**> Operands of atomics: add, or compare and swap */
+};
+
+/**
+ * Completion event on a shared completion queue
+ */
+struct rdma_cqe {
+    int fd;               /**> Connection the operation was posted on */
+    struct rdma_wqe wqe;
+};
+
+/**
+ * Completion queue shared by several connections. (opaque)
+ */
+struct rdma_cq;
+
+/**
+ * TAS context with its own queues to the fast path. (opaque)
+ */
+struct rdma_context;
+
+/**
+ * Completion event of an asynchronous rdma_connect_async()/rdma_accept_async()
+ */
+struct rdma_conn_ev {
+    int fd;           /**> File descriptor returned by the request */
+    int status;       /**> 0 on success, -1 if the connection failed and fd
+                           was released */
+    void* mr_base;    /**> Base address of the memory region */
+    uint32_t mr_len;  /**> Granted size of the memory region */
+};
+
 /**
  * Initialize application library to communicate with TAS.
  * [1] Setup IPC mechanisms with TAS
@@ -50,10 +138,35 @@ struct rdma_wqe {
  * Application must ensure that this is first called before
  * using any RDMA APIs
  *
+ * Every thread gets its own context on its first call, connections and
+ * shared completion queues are bound to the context of the thread creating
+ * them. Operations on connections of the same context must not be called
+ * concurrently, operations on different contexts can.
+ *
  * @return SUCCESS/FAILURE
  */
 int rdma_init(void);
 
+/**
+ * Create a new context and make it the context of the calling thread.
+ *
+ * @return Context on SUCCESS. NULL on FAILURE.
+ */
+struct rdma_context* rdma_context_create(void);
+
+/**
+ * Make ctx the context of the calling thread.
+ *
+ * Connections created afterwards by the thread are bound to ctx, e.g. to
+ * hand a context over to a worker thread or share it between threads that
+ * serialize their calls.
+ *
+ * @param ctx     Context returned by rdma_context_create()
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_context_set(struct rdma_context* ctx);
+
 /**
  * Listen to RDMA connections on a TCP port.
  *
@@ -73,12 +186,21 @@ int rdma_listen(const struct sockaddr_in* localaddr, int backlog);
  * This is a wrapper around accept().
  * NOTE: Forced *synchronous* mode.
  *
+ * TAS bounds the requested work queue depth and memory region size by its
+ * per-connection maximum, and fails the request if the application would
+ * exceed its RDMA memory limit.
+ *
  * @param listenfd      File descriptor returned on rdma_listen()
  * @param remoteaddr    IPv4 address and TCP port number of remote peer
+ * @param wq_depth      Requested number of work queue entries, 0 for default
+ * @param mr_base       Set to the base address of the memory region
+ * @param mr_len        Requested memory region size in bytes, 0 for default.
+ *                      Set to the granted size.
  *
  * @return File Descriptor on SUCCESS. -1 on FAILURE.
  */
-int rdma_accept(int listenfd, struct sockaddr_in* remoteaddr, void **mr_base, uint32_t *mr_len);
+int rdma_accept(int listenfd, struct sockaddr_in* remoteaddr,
+        uint32_t wq_depth, void **mr_base, uint32_t *mr_len);
 
 /**
  * Connect to a remote RDMA-capable server.
@@ -86,11 +208,140 @@ int rdma_accept(int listenfd, struct sockaddr_in* remoteaddr, void **mr_base, ui
  * This is a wrapper around connect().
  * NOTE: Forced *synchronous* mode.
  *
+ * Work queue depth and memory region size are requested as in rdma_accept().
+ *
  * @param remoteaddr    IPv4 address and TCP port number of remote server
+ * @param wq_depth      Requested number of work queue entries, 0 for default
+ * @param mr_base       Set to the base address of the memory region
+ * @param mr_len        Requested memory region size in bytes, 0 for default.
+ *                      Set to the granted size.
  *
  * @return File Descriptor on SUCCESS. -1 on FAILURE.
  */
-int rdma_connect(const struct sockaddr_in* remoteaddr, void **mr_base, uint32_t *mr_len);
+int rdma_connect(const struct sockaddr_in* remoteaddr, uint32_t wq_depth,
+        void **mr_base, uint32_t *mr_len);
+
+/**
+ * Start accepting a connection on a listen socket.
+ *
+ * NOTE: *Asynchronous*. The returned file descriptor can be used once its
+ * completion event is returned by rdma_conn_poll() with status 0.
+ *
+ * Fails if the context of the calling thread has as many connections being
+ * established as its TAS kernel queue has entries, poll completions first.
+ *
+ * @param listenfd      File descriptor returned on rdma_listen()
+ * @param wq_depth      Requested number of work queue entries, 0 for default
+ * @param mr_len        Requested memory region size in bytes, 0 for default
+ *
+ * @return File Descriptor on SUCCESS. -1 on FAILURE.
+ */
+int rdma_accept_async(int listenfd, uint32_t wq_depth, uint32_t mr_len);
+
+/**
+ * Start connecting to a remote RDMA-capable server.
+ *
+ * NOTE: *Asynchronous*, as rdma_accept_async().
+ *
+ * @param remoteaddr    IPv4 address and TCP port number of remote server
+ * @param wq_depth      Requested number of work queue entries, 0 for default
+ * @param mr_len        Requested memory region size in bytes, 0 for default
+ *
+ * @return File Descriptor on SUCCESS. -1 on FAILURE.
+ */
+int rdma_connect_async(const struct sockaddr_in* remoteaddr,
+        uint32_t wq_depth, uint32_t mr_len);
+
+/**
+ * Fetch completion events of connections started with rdma_connect_async()
+ * and rdma_accept_async() on the context of the calling thread.
+ *
+ * NOTE: *Blocking* if connections are being established, none completed and
+ * timeout_ms is not 0.
+ *
+ * @param evs         Reference to completion event descriptors.
+ * @param num         Number of events to read
+ * @param timeout_ms  Time to wait for completions, -1 to wait indefinitely
+ *
+ * @return -1 on FAILURE, number of completion events on SUCCESS (0 on
+ *         timeout). Completion events are copied to *evs*.
+ */
+int rdma_conn_poll(struct rdma_conn_ev* evs, uint32_t num, int timeout_ms);
+
+/**
+ * Close an RDMA connection.
+ *
+ * This is a wrapper around close().
+ * NOTE: Forced *synchronous* mode.
+ *
+ * Completions not polled yet are dropped, the file descriptor and the memory
+ * regions of the connection must not be used afterwards. Listen sockets
+ * cannot be closed.
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_close(int fd);
+
+/**
+ * Register an additional memory region on a connection.
+ *
+ * Every connection has a default memory region with key 0, returned by
+ * rdma_accept()/rdma_connect(). Operations posted with rdma_post_batch()
+ * select local and remote regions by key, the peer learns keys out of band.
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param len     Size of the memory region in bytes
+ * @param mr_base Set to the base address of the memory region
+ *
+ * @return Key of the memory region on SUCCESS. -1 on FAILURE.
+ */
+int rdma_reg_mr(int fd, uint32_t len, void **mr_base);
+
+/**
+ * Create a memory region shared by connections.
+ *
+ * Connections accepted or connected afterwards use it as their default memory
+ * region (key 0) instead of allocating a private one, so rdma_accept() and
+ * rdma_connect() return its base and size. Offsets of operations on these
+ * connections are relative to the shared region and bounds checked against
+ * it. Can only be called once, the region lives as long as the application.
+ *
+ * @param len     Size of the memory region in bytes
+ * @param mr_base Set to the base address of the memory region
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_share_mr(uint32_t len, void **mr_base);
+
+/**
+ * Release the work queues of idle connections.
+ *
+ * Work queues are allocated when the first operation is posted on a
+ * connection. Connections without outstanding operations or posted receive
+ * buffers that posted nothing since the previous call release their work
+ * queue until the next operation. Calling this every T ms releases the work
+ * queues of connections idle for more than 2T ms at the latest. Only
+ * connections bound to the context of the calling thread are considered.
+ *
+ * @return Number of work queues released.
+ */
+int rdma_release_idle(void);
+
+/**
+ * Release a memory region registered with rdma_reg_mr().
+ *
+ * Refused while posted operations, unacknowledged messages or incoming
+ * requests still reference the key. Operations posted after the release fail
+ * with RDMA_OUT_OF_BOUNDS.
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param key     Key returned by rdma_reg_mr()
+ *
+ * @return 0 on SUCCESS. -EBUSY while the key is in use, -1 on FAILURE.
+ */
+int rdma_dereg_mr(int fd, int key);
 
 /**
  * One-sided communication primitive to read data
@@ -134,8 +385,182 @@ int rdma_read(int fd, uint32_t len, uint32_t loffset, uint32_t roffset);
  */
 int rdma_write(int fd, uint32_t len, uint32_t loffset, uint32_t roffset);
 
+/**
+ * One-sided communication primitive to write data gathered from several
+ * segments of local memory to contiguous remote peer's memory.
+ *
+ * The segments are sent back to back as a single message, starting at
+ * roffset in the remote peer's memory.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param sgl     Local segments, copied before the call returns
+ * @param num     Number of segments, at most RDMA_MAX_SGE
+ * @param roffset Offset into remote memory region to where the data is written
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_write_sgl(int fd, const struct rdma_sge* sgl, uint32_t num,
+    uint32_t roffset);
+
+/**
+ * One-sided write of a small payload carried in the work queue entry.
+ *
+ * Like rdma_write(), but the data is copied from buf when the operation is
+ * posted, so buf may be reused immediately. The payload is not staged in
+ * the memory region.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param buf     Data to write
+ * @param len     Number of bytes to write, at most RDMA_MAX_INLINE
+ * @param roffset Offset into remote memory region to where the data is written
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_write_inline(int fd, const void* buf, uint32_t len,
+    uint32_t roffset);
+
+/**
+ * One-sided write that also notifies the remote peer.
+ *
+ * Like rdma_write(), and the next receive buffer the peer posted with
+ * rdma_post_recv() is completed with type RDMA_OP_WRITE_IMM once the data
+ * is placed. Its imm is set to the immediate data, loff and len describe
+ * the written memory. The operation fails with RDMA_RECV_NOT_READY if the
+ * peer posted no receive buffer.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param len     Number of bytes to write
+ * @param loffset Offset into local memory region where the data is copied
+ * @param roffset Offset into remote memory region to where the data is written
+ * @param imm     Immediate data reported to the peer
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_write_imm(int fd, uint32_t len, uint32_t loffset, uint32_t roffset,
+    uint32_t imm);
+
+/**
+ * Two-sided communication primitive to send a message to the remote peer.
+ *
+ * Sends len bytes from loffset in local memory. The message is placed in
+ * the next receive buffer the peer posted with rdma_post_recv(). The
+ * operation fails with RDMA_RECV_NOT_READY if there is none, and with
+ * RDMA_OUT_OF_BOUNDS if the message does not fit into it.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param len     Number of bytes to send
+ * @param loffset Offset into local memory region of the message
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_send(int fd, uint32_t len, uint32_t loffset);
+
+/**
+ * Atomically add to a 64-bit word in remote peer's memory.
+ *
+ * The word at roffset is updated by the peer's fast path without involving
+ * the remote application. Its original value is written to loffset in local
+ * memory when the operation completes. The operand is carried in the work
+ * queue entry, local memory is only written on completion.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param loffset Offset into local memory region for the original value
+ * @param roffset Offset into remote memory region of the word, 8-byte aligned
+ * @param add     Value added to the remote word
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_fetch_add(int fd, uint32_t loffset, uint32_t roffset, uint64_t add);
+
+/**
+ * Atomically compare and swap a 64-bit word in remote peer's memory.
+ *
+ * The word at roffset is replaced with swap if it equals compare. Its
+ * original value is written to loffset in local memory when the operation
+ * completes, the swap took place if it equals compare. The operands are
+ * carried in the work queue entry.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param loffset Offset into local memory region for the original value
+ * @param roffset Offset into remote memory region of the word, 8-byte aligned
+ * @param compare Expected value of the remote word
+ * @param swap    New value of the remote word
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_cmp_swap(int fd, uint32_t loffset, uint32_t roffset,
+    uint64_t compare, uint64_t swap);
+
+/**
+ * Post a receive buffer for a message sent with rdma_send() by the peer.
+ *
+ * Receive buffers are filled in the order they were posted. A completion
+ * event of type RDMA_OP_RECV is reported for each filled buffer, its len
+ * is the number of bytes received.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd      File Descriptor obtained on successful accept()/connect()
+ * @param len     Size of the receive buffer
+ * @param loffset Offset into local memory region of the receive buffer
+ *
+ * @return Receive identifier on SUCCESS. -1 on FAILURE.
+ */
+int rdma_post_recv(int fd, uint32_t len, uint32_t loffset);
+
+/**
+ * Post a list of operations with a single notification to TAS.
+ *
+ * Equivalent to calling rdma_read()/rdma_write()/rdma_send()/
+ * rdma_write_imm()/rdma_fetch_add()/rdma_cmp_swap() for each entry, but the
+ * whole list is handed to the fast path at once. Writes and sends of at most
+ * RDMA_MAX_INLINE bytes flagged RDMA_WQE_INLINE copy their payload from the
+ * memory region when posted.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param wrs   Work requests, posted in order
+ * @param num   Number of work requests
+ *
+ * @return Number of posted work requests on SUCCESS, less than num if the
+ *         work queue is full. -1 on FAILURE, nothing is posted if any of
+ *         the work requests is invalid.
+ */
+int rdma_post_batch(int fd, const struct rdma_wr* wrs, uint32_t num);
+
+/**
+ * Set how often operations on a connection report completion events.
+ *
+ * Every interval-th READ/WRITE is signaled, the others are unsignaled and
+ * retired without a completion event once a later signaled operation
+ * completes. Failed operations are always reported. With interval 0 only
+ * work requests posted with RDMA_WQE_SIGNALED are signaled.
+ *
+ * Default interval is 1, all operations are signaled.
+ *
+ * @param fd        File Descriptor obtained on successful accept()/connect()
+ * @param interval  Signal every interval-th operation
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_set_signal_interval(int fd, uint32_t interval);
+
 /**
  * Fetch completion event with the status of a completed operation.
+ * Unsignaled operations that succeeded are skipped.
  *
  * NOTE: *Blocking*
  *
@@ -147,4 +572,64 @@ int rdma_write(int fd, uint32_t len, uint32_t loffset, uint32_t roffset);
  */
 int rdma_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num);
 
+/**
+ * Create a completion queue that can be shared by several connections.
+ *
+ * @return Completion queue on SUCCESS. NULL on FAILURE.
+ */
+struct rdma_cq* rdma_scq_create(void);
+
+/**
+ * Report completions of a connection on a shared completion queue.
+ *
+ * Connection and completion queue must be bound to the same context.
+ * Completions already pending on the connection are reported as well.
+ * They can still be fetched with rdma_cq_poll() on the connection.
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param cq    Completion queue returned by rdma_scq_create()
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_scq_attach(int fd, struct rdma_cq* cq);
+
+/**
+ * Stop reporting completions of a connection on its shared completion
+ * queue. Completions not fetched yet stay with the connection and can be
+ * fetched with rdma_cq_poll(). rdma_close() detaches the connection as well.
+ *
+ * @param fd    File Descriptor of a connection attached with rdma_scq_attach()
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_scq_detach(int fd);
+
+/**
+ * Free a shared completion queue.
+ *
+ * Fails while connections are attached to it.
+ *
+ * @param cq    Completion queue returned by rdma_scq_create()
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_scq_destroy(struct rdma_cq* cq);
+
+/**
+ * Fetch completion events of all connections attached to a shared
+ * completion queue, in the order the connections were notified.
+ *
+ * NOTE: *Blocking* if no completions are pending and timeout_ms is not 0.
+ *
+ * @param cq          Completion queue returned by rdma_scq_create()
+ * @param compl_evs   Reference to completion event descriptors.
+ * @param num         Number of events to read
+ * @param timeout_ms  Time to wait for completions, -1 to wait indefinitely
+ *
+ * @return -1 on FAILURE, number of completion events on SUCCESS (0 on
+ *         timeout). Completion events are copied to *compl_evs*.
+ */
+int rdma_scq_poll(struct rdma_cq* cq, struct rdma_cqe* compl_evs,
+    uint32_t num, int timeout_ms);
+
 #endif /* FLEXTCP_RDMA_H_ */
@@ -2,12 +2,14 @@
 #define INTERNAL_H_
 
 #include "tas_ll.h"
+#include "tas_rdma_lat.h"
 
 /* File descriptor related definitions */
 enum {
     RDMA_UNDEF_SOCKET,
     RDMA_LISTEN_SOCKET,
-    RDMA_CONN_SOCKET
+    RDMA_CONN_SOCKET,
+    RDMA_PENDING_SOCKET     // Connection being established
 };
 
 struct rdma_socket{
@@ -16,17 +18,61 @@ struct rdma_socket{
         struct flextcp_listener l;
     };
     uint8_t type;
+    int fd;
+    struct flextcp_context* ctx;  /**> Context the socket is bound to */
+    uint32_t sig_interval;  /**> Signal every n-th operation, 0: never */
+    uint32_t sig_count;     /**> Operations since last signaled one */
+    uint8_t wq_used;        /**> Posted since last rdma_release_idle() */
+    uint8_t async;          /**> Established with rdma_*_async() */
+    struct rdma_socket* done_next;  /**> Established, not reported yet */
+    struct rdma_socket* wq_prev;    /**> List of connections with a work */
+    struct rdma_socket* wq_next;    /**> queue attached, per context */
+};
+
+/* Shared completion queue, for connections of one context */
+struct rdma_cq {
+    struct flextcp_rdma_cq c;
+    struct flextcp_context* ctx;
+    uint32_t num_conns;     // Attached connections
+};
+
+#define RDMA_CONTROL_PENDING 64  // Events kept for rdma_control_wait()
+
+/* TAS context with its own queues, per thread unless set explicitly */
+struct rdma_context {
+    struct flextcp_context c;
+    uint32_t handshakes;    // Connections being established
+    struct rdma_socket* done_first;  // Established asynchronously, to be
+    struct rdma_socket* done_last;   // reported by rdma_conn_poll()
+    struct rdma_socket* wq_first;    // Connections with a work queue
+    // Other events seen while polling for handshakes, ring consumed by
+    // rdma_control_wait()
+    struct flextcp_event pending[RDMA_CONTROL_PENDING];
+    uint32_t pending_head;
+    uint32_t pending_num;
+#ifdef FLEXNIC_RDMA_LATENCY
+    struct flexnic_rdma_lat* lat;    // Latency histograms, NULL if disabled
+#endif
 };
 
 #define MAX_FD_NUM  (1 << 16)   // TODO: Should be configurable
 extern struct rdma_socket* fdmap[MAX_FD_NUM];
 
-/* TAS Application Context */
-extern struct flextcp_context* appctx;
+/* Context of the calling thread, created on first use */
+struct flextcp_context* rdma_ctx_get(void);
+
+/* Allocate the work queue of a connection, blocks for the slow path */
+int rdma_wq_attach(struct rdma_socket* s);
+
+/* Detach a connection from its shared completion queue, if any */
+void rdma_scq_unlink(struct rdma_socket* s);
 
 #define LISTEN_BACKLOG_MIN  8
 #define LISTEN_BACKLOG_MAX  1024
 
 #define CONTROL_TIMEOUT     10  // Block for 10ms
 
+#define RDMA_POLL_BATCH 64  // Updates processed per completion poll
+#define RDMA_CONTROL_POLL_BATCH 64  // Events processed per rdma_conn_poll()
+
 #endif /* INTERNAL_H_ */
@@ -88,6 +88,13 @@ int flextcp_listen_open(struct flextcp_context *ctx,
 
 int flextcp_listen_accept(struct flextcp_context *ctx,
     struct flextcp_listener *lst, struct flextcp_connection *conn)
+{
+  return flextcp_rdma_listen_accept(ctx, lst, conn, 0, 0);
+}
+
+int flextcp_rdma_listen_accept(struct flextcp_context *ctx,
+    struct flextcp_listener *lst, struct flextcp_connection *conn,
+    uint32_t wq_len, uint32_t mr_len)
 {
   uint32_t pos = ctx->kin_head;
   struct kernel_appout *kin = ctx->kin_base;
@@ -107,6 +114,8 @@ int flextcp_listen_accept(struct flextcp_context *ctx,
   kin->data.accept_conn.listen_opaque = OPAQUE(lst);
   kin->data.accept_conn.conn_opaque = OPAQUE(conn);
   kin->data.accept_conn.local_port = lst->local_port;
+  kin->data.accept_conn.wq_len = wq_len;
+  kin->data.accept_conn.mr_len = mr_len;
   MEM_BARRIER();
   kin->type = KERNEL_APPOUT_ACCEPT_CONN;
   flextcp_kernel_kick();
@@ -122,6 +131,13 @@ int flextcp_listen_accept(struct flextcp_context *ctx,
 
 int flextcp_connection_open(struct flextcp_context *ctx,
     struct flextcp_connection *conn, uint32_t dst_ip, uint16_t dst_port)
+{
+  return flextcp_rdma_connection_open(ctx, conn, dst_ip, dst_port, 0, 0);
+}
+
+int flextcp_rdma_connection_open(struct flextcp_context *ctx,
+    struct flextcp_connection *conn, uint32_t dst_ip, uint16_t dst_port,
+    uint32_t wq_len, uint32_t mr_len)
 {
   uint32_t pos = ctx->kin_head, f = 0;
   struct kernel_appout *kin = ctx->kin_base;
@@ -143,6 +159,8 @@ int flextcp_connection_open(struct flextcp_context *ctx,
   kin->data.conn_open.remote_ip = dst_ip;
   kin->data.conn_open.remote_port = dst_port;
   kin->data.conn_open.flags = f;
+  kin->data.conn_open.wq_len = wq_len;
+  kin->data.conn_open.mr_len = mr_len;
   MEM_BARRIER();
   kin->type = KERNEL_APPOUT_CONN_OPEN;
   flextcp_kernel_kick();
@@ -426,6 +444,148 @@ int flextcp_connection_move(struct flextcp_context *ctx,
   return 0;
 }
 
+static int connection_rdma_mr(struct flextcp_context *ctx,
+        struct flextcp_connection *conn, uint8_t type, uint32_t len,
+        uint16_t key)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "connection_rdma_mr: no queue space\n");
+    return -1;
+  }
+
+  kin->data.rdma_mr.local_ip = conn->local_ip;
+  kin->data.rdma_mr.remote_ip = conn->remote_ip;
+  kin->data.rdma_mr.local_port = conn->local_port;
+  kin->data.rdma_mr.remote_port = conn->remote_port;
+  kin->data.rdma_mr.len = len;
+  kin->data.rdma_mr.key = key;
+  kin->data.rdma_mr.opaque = OPAQUE(conn);
+  MEM_BARRIER();
+  kin->type = type;
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
+
+int flextcp_connection_reg_mr(struct flextcp_context *ctx,
+        struct flextcp_connection *conn, uint32_t len)
+{
+  if (conn->status != CONN_OPEN || len == 0) {
+    return -1;
+  }
+
+  return connection_rdma_mr(ctx, conn, KERNEL_APPOUT_RDMA_REG_MR, len, 0);
+}
+
+int flextcp_connection_dereg_mr(struct flextcp_context *ctx,
+        struct flextcp_connection *conn, uint16_t key)
+{
+  if (conn->status != CONN_OPEN || key == 0 || key >= FLEXTCP_RDMA_MR_NUM ||
+      conn->rdma_mrs[key].base == NULL)
+  {
+    return -1;
+  }
+
+  return connection_rdma_mr(ctx, conn, KERNEL_APPOUT_RDMA_DEREG_MR, 0, key);
+}
+
+static int connection_rdma_wq(struct flextcp_context *ctx,
+        struct flextcp_connection *conn, uint8_t type)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (conn->status != CONN_OPEN) {
+    return -1;
+  }
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "connection_rdma_wq: no queue space\n");
+    return -1;
+  }
+
+  kin->data.rdma_wq.local_ip = conn->local_ip;
+  kin->data.rdma_wq.remote_ip = conn->remote_ip;
+  kin->data.rdma_wq.local_port = conn->local_port;
+  kin->data.rdma_wq.remote_port = conn->remote_port;
+  kin->data.rdma_wq.opaque = OPAQUE(conn);
+  MEM_BARRIER();
+  kin->type = type;
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
+
+int flextcp_connection_wq_attach(struct flextcp_context *ctx,
+        struct flextcp_connection *conn)
+{
+  return connection_rdma_wq(ctx, conn, KERNEL_APPOUT_RDMA_WQ_ATTACH);
+}
+
+int flextcp_connection_wq_detach(struct flextcp_context *ctx,
+        struct flextcp_connection *conn)
+{
+  /* the slow path checks again, operations could be outstanding in the
+   * fast path */
+  if (conn->wq_base == NULL || conn->wq_len != 0 || conn->cq_len != 0 ||
+      conn->rcv_len != 0 || conn->rcv_cq_len != 0)
+  {
+    return -1;
+  }
+
+  return connection_rdma_wq(ctx, conn, KERNEL_APPOUT_RDMA_WQ_DETACH);
+}
+
+int flextcp_rdma_share_mr(struct flextcp_context *ctx, uint32_t len)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (len == 0) {
+    return -1;
+  }
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "flextcp_rdma_share_mr: no queue space\n");
+    return -1;
+  }
+
+  memset(&kin->data.rdma_mr, 0, sizeof(kin->data.rdma_mr));
+  kin->data.rdma_mr.len = len;
+  MEM_BARRIER();
+  kin->type = KERNEL_APPOUT_RDMA_SHARE_MR;
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
+
 static void connection_init(struct flextcp_connection *conn)
 {
   memset(conn, 0, sizeof(*conn));
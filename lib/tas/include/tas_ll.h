@@ -37,6 +37,10 @@
 
 #define FLEXTCP_MAX_CONTEXTS 32
 #define FLEXTCP_MAX_FTCPCORES 16
+/** Connection updates a context sets aside while polling for RDMA updates */
+#define FLEXTCP_ARX_DEFERRED 64
+/** Number of RDMA memory region keys per connection, including key 0 */
+#define FLEXTCP_RDMA_MR_NUM 4
 
 /**
  * A flextcp context is per-thread state for the stack. (opaque)
@@ -71,6 +75,19 @@ struct flextcp_context {
   struct flextcp_connection *bump_pending_first;
   struct flextcp_connection *bump_pending_last;
 
+  /* connection updates taken off the NIC queues by rdma_cq_fastpath_poll(),
+   * handed out first by the next flextcp_context_poll() */
+  struct {
+    uint64_t opaque;
+    uint32_t rx_bump;
+    uint32_t rx_pos;
+    uint32_t tx_bump;
+    uint16_t core;
+    uint8_t flags;
+  } arx_deferred[FLEXTCP_ARX_DEFERRED];
+  uint16_t arx_deferred_head;
+  uint16_t arx_deferred_num;
+
   /* other */
   uint16_t db_id;
   uint16_t ctx_id;
@@ -81,6 +98,13 @@ struct flextcp_context {
   int epfd, evfd;
 };
 
+/** Shared RDMA completion queue: connections with new completions, in the
+ * order they were notified. (opaque) */
+struct flextcp_rdma_cq {
+  struct flextcp_connection *ready_first;
+  struct flextcp_connection *ready_last;
+};
+
 /** TCP listening "socket". (opaque) */
 struct flextcp_listener {
   struct flextcp_connection *conns;
@@ -113,18 +137,38 @@ struct flextcp_connection {
   /** pending tx bump to fast path */
   uint32_t txb_bump;
 
-  /* work queue / completion queue */
+  /* work queue / completion queue, NULL until attached with
+   * flextcp_connection_wq_attach() */
   uint8_t *wq_base;
   uint32_t wq_size;
-  uint32_t wq_len; /*> Number of pending work queue entries */
-  uint32_t wq_tail; /*> Offset to first unprocessed wq entry */
+  uint32_t wq_len; /*> Number of posted but not completed wq entries */
+  uint32_t wq_tail; /*> Offset to first not completed wq entry */
   uint32_t cq_len; /*> Number of unread cq entries */
   uint32_t cq_tail; /*> Offset to first unread cq entry */
 
+  /* posted receive queue, follows the work queue and has the same size. It
+   * is followed by the extension slots of the WQEs. */
+  uint8_t *rcv_base;
+  uint32_t rcv_len; /*> Number of posted but not filled receive entries */
+  uint32_t rcv_tail; /*> Offset to first not filled receive entry */
+  uint32_t rcv_cq_len; /*> Number of unread receive completions */
+  uint32_t rcv_cq_tail; /*> Offset to first unread receive completion */
+
   /* Memory region */
   uint8_t *mr;
   uint32_t mr_len;
 
+  /* Registered memory regions by key, key 0 is the memory region above */
+  struct {
+    uint8_t *base;
+    uint32_t len;
+  } rdma_mrs[FLEXTCP_RDMA_MR_NUM];
+
+  /* shared completion queue the connection is attached to */
+  struct flextcp_rdma_cq *rdma_cq;
+  struct flextcp_connection *rdma_cq_next;
+  uint8_t rdma_cq_ready;
+
   uint32_t local_ip;
   uint32_t remote_ip;
   uint16_t local_port;
@@ -170,6 +214,12 @@ enum flextcp_event_type {
   FLEXTCP_EV_CONN_TXCLOSED,
   /** Connection moved to new context */
   FLEXTCP_EV_CONN_MOVED,
+  /** flextcp_connection_reg_mr() or flextcp_connection_dereg_mr() result */
+  FLEXTCP_EV_CONN_RDMA_MR,
+  /** flextcp_rdma_share_mr() result */
+  FLEXTCP_EV_RDMA_SHARED_MR,
+  /** flextcp_connection_wq_attach() or flextcp_connection_wq_detach() result */
+  FLEXTCP_EV_CONN_RDMA_WQ,
 };
 
 /** Events that can occur on flextcp contexts. */
@@ -221,6 +271,23 @@ struct flextcp_event {
       int16_t status;
       struct flextcp_connection *conn;
     } conn_moved;
+    /** For #FLEXTCP_EV_CONN_RDMA_MR */
+    struct {
+      int16_t status;
+      uint16_t key;
+      struct flextcp_connection *conn;
+    } conn_rdma_mr;
+    /** For #FLEXTCP_EV_RDMA_SHARED_MR */
+    struct {
+      int16_t status;
+      uint32_t len;
+      void *mr;
+    } rdma_shared_mr;
+    /** For #FLEXTCP_EV_CONN_RDMA_WQ */
+    struct {
+      int16_t status;
+      struct flextcp_connection *conn;
+    } conn_rdma_wq;
     /** For #FLEXTCP_EV_CONN_CLOSED */
     struct {
       int16_t status;
@@ -249,11 +316,26 @@ int flextcp_context_poll(struct flextcp_context *ctx, int num,
     struct flextcp_event *events);
 
 /**
- * Poll fastpath rx queue for 'num' bytes of data in the provided
- * connection's completion queue.
+ * Poll fastpath rx queues of all cores for at most 'num' RDMA updates.
+ * Connections attached to a shared completion queue with new completions
+ * are added to its ready list. Connection updates found in between are set
+ * aside for flextcp_context_poll(), which applies RDMA updates as well.
  */
-int rdma_fastpath_poll(struct flextcp_context *ctx,
-    struct flextcp_connection *conn, int num);
+int rdma_cq_fastpath_poll(struct flextcp_context *ctx, int num);
+
+/**
+ * Append connection to the ready list of a shared completion queue, if it
+ * is not on it already.
+ */
+void rdma_cq_conn_ready(struct flextcp_rdma_cq *cq,
+    struct flextcp_connection *conn);
+
+/**
+ * Remove connection from the ready list of a shared completion queue, if it
+ * is on it.
+ */
+void rdma_cq_conn_remove(struct flextcp_rdma_cq *cq,
+    struct flextcp_connection *conn);
 
 /**
  * Bump fast path for a new RDMA wq entry
@@ -261,6 +343,12 @@ int rdma_fastpath_poll(struct flextcp_context *ctx,
 int rdma_conn_bump(struct flextcp_context *ctx,
     struct flextcp_connection *c);
 
+/**
+ * Bump fast path for new posted RDMA receive entries
+ */
+int rdma_conn_recv_bump(struct flextcp_context *ctx,
+    struct flextcp_connection *c);
+
 void flextcp_block(struct flextcp_context *ctx, int timeout_ms);
 
 /*****************************************************************************/
@@ -320,6 +408,40 @@ int flextcp_connection_tx_possible(struct flextcp_context *ctx,
 int flextcp_connection_move(struct flextcp_context *ctx,
         struct flextcp_connection *conn);
 
+/** Open a connection with an RDMA work queue of wq_len bytes and a memory
+ * region of mr_len bytes, 0 for the TAS defaults (asynchronous). TAS may
+ * bound the sizes, the granted ones are set in conn once the memory region is
+ * reported with the open event and the work queue when it is attached. */
+int flextcp_rdma_connection_open(struct flextcp_context *ctx,
+    struct flextcp_connection *conn, uint32_t dst_ip, uint16_t dst_port,
+    uint32_t wq_len, uint32_t mr_len);
+
+/** Accept a connection with RDMA work queue and memory region sizes as in
+ * flextcp_rdma_connection_open() (asynchronous). */
+int flextcp_rdma_listen_accept(struct flextcp_context *ctx,
+    struct flextcp_listener *lst, struct flextcp_connection *conn,
+    uint32_t wq_len, uint32_t mr_len);
+
+/** Register an additional RDMA memory region of len bytes on connection */
+int flextcp_connection_reg_mr(struct flextcp_context *ctx,
+        struct flextcp_connection *conn, uint32_t len);
+
+/** Release RDMA memory region with specified key on connection */
+int flextcp_connection_dereg_mr(struct flextcp_context *ctx,
+        struct flextcp_connection *conn, uint16_t key);
+
+/** Create RDMA memory region of len bytes that is used as the memory region
+ * of all connections opened or accepted afterwards */
+int flextcp_rdma_share_mr(struct flextcp_context *ctx, uint32_t len);
+
+/** Allocate RDMA work queue of connection, connections are opened without */
+int flextcp_connection_wq_attach(struct flextcp_context *ctx,
+        struct flextcp_connection *conn);
+
+/** Release RDMA work queue of connection without outstanding operations */
+int flextcp_connection_wq_detach(struct flextcp_context *ctx,
+        struct flextcp_connection *conn);
+
 /** @} */
 
 #endif /* ndef TAS_LL_H_ */
@@ -51,6 +51,12 @@ static inline void event_kappin_st_conn_move(
     struct kernel_appin_status *inev, struct flextcp_event *outev);
 static inline void event_kappin_st_listen_open(
     struct kernel_appin_status *inev, struct flextcp_event *outev);
+static inline void event_kappin_st_rdma_mr(
+    struct kernel_appin_rdma_mr *inev, struct flextcp_event *outev);
+static inline void event_kappin_st_rdma_shared_mr(
+    struct kernel_appin_rdma_mr *inev, struct flextcp_event *outev);
+static inline void event_kappin_st_rdma_wq(
+    struct kernel_appin_rdma_wq *inev, struct flextcp_event *outev);
 static inline void event_kappin_st_conn_closed(
     struct kernel_appin_status *inev, struct flextcp_event *outev);
 
@@ -65,6 +71,11 @@ static int fastpath_poll(struct flextcp_context *ctx, int num,
     __attribute__((used,noinline));
 static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
     struct flextcp_event *events, int *used) __attribute__((used,noinline));
+static int arx_poll_vec(struct flextcp_context *ctx, int max,
+    struct flextcp_event *events, int num, int *used)
+    __attribute__((noinline));
+static int arx_deferred_poll(struct flextcp_context *ctx, int num,
+    struct flextcp_event *events);
 static void conns_bump(struct flextcp_context *ctx) __attribute__((noinline));
 static void txq_probe(struct flextcp_context *ctx, unsigned n) __attribute__((noinline));
 
@@ -183,6 +194,12 @@ static int kernel_poll(struct flextcp_context *ctx, int num,
       event_kappin_st_conn_move(&kout->data.status, &events[i]);
     } else if (type == KERNEL_APPIN_STATUS_CONN_CLOSE) {
       event_kappin_st_conn_closed(&kout->data.status, &events[i]);
+    } else if (type == KERNEL_APPIN_STATUS_RDMA_MR) {
+      event_kappin_st_rdma_mr(&kout->data.rdma_mr, &events[i]);
+    } else if (type == KERNEL_APPIN_STATUS_RDMA_SHARED_MR) {
+      event_kappin_st_rdma_shared_mr(&kout->data.rdma_mr, &events[i]);
+    } else if (type == KERNEL_APPIN_STATUS_RDMA_WQ) {
+      event_kappin_st_rdma_wq(&kout->data.rdma_wq, &events[i]);
     } else {
       fprintf(stderr, "flextcp_context_poll: unexpected kout type=%u pos=%u len=%u\n",
           type, pos, ctx->kout_len);
@@ -209,51 +226,86 @@ static int kernel_poll(struct flextcp_context *ctx, int num,
   return (j == -1 ? -1 : 0);
 }
 
-int rdma_fastpath_poll(struct flextcp_context *ctx,
-        struct flextcp_connection *conn, int num){
-    int i;
-    struct flextcp_pl_arx *arx_q, *arx;
-    uint32_t head;
-    struct flextcp_connection *rx_conn;
+void rdma_cq_conn_ready(struct flextcp_rdma_cq *cq,
+        struct flextcp_connection *conn)
+{
+    if (conn->rdma_cq_ready)
+        return;
 
-    arx_q = (struct flextcp_pl_arx *) ctx->queues[conn->fn_core].rxq_base;
-    head = ctx->queues[conn->fn_core].rxq_head;
-    for (i = 0; i < num;) {
-        arx = &arx_q[head / sizeof(*arx)];
-        if (arx->type == FLEXTCP_PL_ARX_INVALID) {
-            break;
-        } else if (arx->type == FLEXTCP_PL_ARX_RDMAUPDATE) {
-            rx_conn = OPAQUE_PTR(arx->msg.rdmaupdate.opaque);
-            // normal case
-            if (arx->msg.rdmaupdate.cq_head > rx_conn->cq_tail){
-                rx_conn->cq_len = arx->msg.rdmaupdate.cq_head - rx_conn->cq_tail;
-            }else{ // cq_head is overflowed
-                rx_conn->cq_len = arx->msg.rdmaupdate.cq_head + rx_conn->wq_size - rx_conn->cq_tail;
-            }
-            if (arx->msg.rdmaupdate.wq_tail > rx_conn->wq_tail){
-                rx_conn->wq_len -= (arx->msg.rdmaupdate.wq_tail - rx_conn->wq_tail);
-            }else if (arx->msg.rdmaupdate.wq_tail < rx_conn->wq_tail){
-                rx_conn->wq_len -= (arx->msg.rdmaupdate.wq_tail + rx_conn->wq_size - rx_conn->wq_tail);
-            }else if (rx_conn->wq_len == rx_conn->wq_size){
-                rx_conn->wq_len = 0; //TODO: is this required?
-            }
-            rx_conn->wq_tail = arx->msg.rdmaupdate.wq_tail;
-            i = conn->cq_len;
-        } else {
-            fprintf(stderr, "flextcp_context_poll: kout type=%u head=%x\n", arx->type, head);
-        }
+    conn->rdma_cq_ready = 1;
+    conn->rdma_cq_next = NULL;
+    if (cq->ready_last == NULL) {
+        cq->ready_first = conn;
+    } else {
+        cq->ready_last->rdma_cq_next = conn;
+    }
+    cq->ready_last = conn;
+}
 
-        MEM_BARRIER();
+void rdma_cq_conn_remove(struct flextcp_rdma_cq *cq,
+        struct flextcp_connection *conn)
+{
+    struct flextcp_connection *prev = NULL, *c;
 
-        arx->type = 0;
-        /* next entry */
-        head += sizeof(*arx);
-        if (head >= ctx->rxq_len) {
-            head -= ctx->rxq_len;
-        }
+    if (!conn->rdma_cq_ready)
+        return;
+
+    for (c = cq->ready_first; c != conn; c = c->rdma_cq_next)
+        prev = c;
+
+    if (prev == NULL) {
+        cq->ready_first = conn->rdma_cq_next;
+    } else {
+        prev->rdma_cq_next = conn->rdma_cq_next;
     }
-    ctx->queues[conn->fn_core].rxq_head = head;
-    return 0;
+    if (cq->ready_last == conn) {
+        cq->ready_last = prev;
+    }
+    conn->rdma_cq_ready = 0;
+}
+
+/* Apply RDMA update to connection, WQEs up to cq_head are completed */
+static void rdma_arx_update(struct flextcp_pl_arx *arx)
+{
+    struct flextcp_connection *rx_conn;
+    struct flextcp_rdma_cq *cq;
+    uint32_t cq_head, done, rcv_tail, rcv_done;
+
+    rx_conn = OPAQUE_PTR(arx->msg.rdmaupdate.opaque);
+    cq_head = arx->msg.rdmaupdate.cq_head;
+    if (cq_head >= rx_conn->wq_tail){
+        done = cq_head - rx_conn->wq_tail;
+    }else{ // cq_head is overflowed
+        done = cq_head + rx_conn->wq_size - rx_conn->wq_tail;
+    }
+    rx_conn->wq_len -= done;
+    rx_conn->cq_len += done;
+    rx_conn->wq_tail = cq_head;
+
+    // Receive entries up to rcv_tail are filled
+    rcv_tail = arx->msg.rdmaupdate.rcv_tail;
+    if (rcv_tail >= rx_conn->rcv_tail){
+        rcv_done = rcv_tail - rx_conn->rcv_tail;
+    }else{
+        rcv_done = rcv_tail + rx_conn->wq_size - rx_conn->rcv_tail;
+    }
+    rx_conn->rcv_len -= rcv_done;
+    rx_conn->rcv_cq_len += rcv_done;
+    rx_conn->rcv_tail = rcv_tail;
+
+    // Queue connection on its shared completion queue
+    cq = rx_conn->rdma_cq;
+    if (cq != NULL && (done > 0 || rcv_done > 0)) {
+        rdma_cq_conn_ready(cq, rx_conn);
+    }
+}
+
+int rdma_cq_fastpath_poll(struct flextcp_context *ctx, int num)
+{
+    int used;
+
+    /* connection updates are set aside for flextcp_context_poll() */
+    return arx_poll_vec(ctx, num, NULL, 0, &used);
 }
 
 static int fastpath_poll(struct flextcp_context *ctx, int num,
@@ -277,6 +329,8 @@ static int fastpath_poll(struct flextcp_context *ctx, int num,
         break;
       } else if (arx->type == FLEXTCP_PL_ARX_CONNUPDATE) {
         j = event_arx_connupdate(ctx, &arx->msg.connupdate, events + i, num - i, ctx->next_queue);
+      } else if (arx->type == FLEXTCP_PL_ARX_RDMAUPDATE) {
+        rdma_arx_update(arx);
       } else {
         fprintf(stderr, "flextcp_context_poll: kout type=%u head=%x\n", arx->type, head);
       }
@@ -402,27 +456,91 @@ static inline void fetch_4ts(struct flextcp_context *ctx, uint32_t *heads,
 static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
     struct flextcp_event *events, int *used)
 {
-  int i, j, ran_out, found;
+  arx_poll_vec(ctx, num, events, num, used);
+  return 0;
+}
+
+/* Copy a connection update to the tail of the context's deferral ring */
+static inline void arx_defer(struct flextcp_context *ctx,
+    struct flextcp_pl_arx_connupdate *cu, uint16_t core)
+{
+  uint16_t pos;
+
+  pos = (ctx->arx_deferred_head + ctx->arx_deferred_num) %
+    FLEXTCP_ARX_DEFERRED;
+  ctx->arx_deferred[pos].opaque = cu->opaque;
+  ctx->arx_deferred[pos].rx_bump = cu->rx_bump;
+  ctx->arx_deferred[pos].rx_pos = cu->rx_pos;
+  ctx->arx_deferred[pos].tx_bump = cu->tx_bump;
+  ctx->arx_deferred[pos].flags = cu->flags;
+  ctx->arx_deferred[pos].core = core;
+  ctx->arx_deferred_num++;
+}
+
+/* Hand out connection updates set aside by arx_defer(), in the order they
+ * were taken off the queues */
+static int arx_deferred_poll(struct flextcp_context *ctx, int num,
+    struct flextcp_event *events)
+{
+  struct flextcp_pl_arx_connupdate cu;
+  int i = 0, j;
+  uint16_t pos;
+
+  while (ctx->arx_deferred_num > 0) {
+    pos = ctx->arx_deferred_head;
+    cu.opaque = ctx->arx_deferred[pos].opaque;
+    cu.rx_bump = ctx->arx_deferred[pos].rx_bump;
+    cu.rx_pos = ctx->arx_deferred[pos].rx_pos;
+    cu.tx_bump = ctx->arx_deferred[pos].tx_bump;
+    cu.flags = ctx->arx_deferred[pos].flags;
+
+    j = event_arx_connupdate(ctx, &cu, events + i, num - i,
+        ctx->arx_deferred[pos].core);
+    if (j == -1) {
+      break;
+    }
+    i += j;
+
+    ctx->arx_deferred_head = (pos + 1) % FLEXTCP_ARX_DEFERRED;
+    ctx->arx_deferred_num--;
+  }
+
+  return i;
+}
+
+/**
+ * Demultiplex up to max entries from the rx queues of all fastpath cores.
+ * RDMA updates are applied to their connection, connection updates are turned
+ * into events. Without event space (events == NULL) connection updates are
+ * copied into the context's arx_deferred ring instead, so RDMA updates behind
+ * them are still applied. flextcp_context_poll() drains that ring before it
+ * polls the queues again. While the ring is full, a queue with a connection
+ * update at its head is skipped. Returns the number of RDMA updates applied.
+ */
+static int arx_poll_vec(struct flextcp_context *ctx, int max,
+    struct flextcp_event *events, int num, int *used)
+{
+  int i, j, n, rdma, ran_out, found;
   struct flextcp_pl_arx *arx;
   uint32_t head;
-  uint16_t l, k, q;
+  uint16_t l, k, q, d;
   uint8_t t;
   uint8_t types[ctx->num_queues];
   uint32_t qheads[ctx->num_queues];
 
-  struct flextcp_pl_arx *arxs[num];
-  uint8_t arx_qs[num];
+  struct flextcp_pl_arx *arxs[max];
+  uint8_t arx_qs[max];
 
   for (q = 0; q < ctx->num_queues; q++) {
     qheads[q] = ctx->queues[q].rxq_head;
   }
 
   ran_out = found = 0;
-  i = 0;
+  i = n = rdma = 0;
   q = ctx->next_queue;
-  while (i < num && !ran_out) {
-    l = 0;
-    for (found = 1; found && i + l < num; ) {
+  while (n < max && !ran_out) {
+    l = d = 0;
+    for (found = 1; found && n + l < max; ) {
       found = 0;
 
       /* fetch types from all n queues */
@@ -451,9 +569,21 @@ static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
         qs--;
       }
 
-      /* prefetch connection state for all entries */
-      for (k = 0, q = ctx->next_queue; k < ctx->num_queues && i + l < num; k++) {
-        if (types[k] == FLEXTCP_PL_ARX_CONNUPDATE) {
+      /* prefetch connection state for all entries, opaque is at the same
+       * offset for both update types. Without events connection updates are
+       * set aside, so they do not hold up RDMA updates behind them. */
+      for (k = 0, q = ctx->next_queue; k < ctx->num_queues && n + l < max; k++) {
+        if (types[k] == FLEXTCP_PL_ARX_CONNUPDATE && events == NULL) {
+          if (ctx->arx_deferred_num + d >= FLEXTCP_ARX_DEFERRED) {
+            q = (q + 1 < ctx->num_queues ? q + 1 : 0);
+            continue;
+          }
+          d++;
+        }
+
+        if (types[k] == FLEXTCP_PL_ARX_RDMAUPDATE ||
+            types[k] == FLEXTCP_PL_ARX_CONNUPDATE)
+        {
           arx = (struct flextcp_pl_arx *) (ctx->queues[q].rxq_base +
               qheads[q]);
           util_prefetch0(OPAQUE_PTR(arx->msg.connupdate.opaque) + 64);
@@ -476,7 +606,7 @@ static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
     if (l == 0)
       break;
 
-    for (k = 0; k < l && i < num; k++) {
+    for (k = 0; k < l; k++) {
       arx = arxs[k];
       q = arx_qs[k];
       head = ctx->queues[q].rxq_head;
@@ -484,9 +614,16 @@ static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
       t = arx->type;
       assert(t != FLEXTCP_PL_ARX_INVALID);
 
-      if (t == FLEXTCP_PL_ARX_CONNUPDATE) {
+      if (t == FLEXTCP_PL_ARX_CONNUPDATE && events == NULL) {
+        arx_defer(ctx, &arx->msg.connupdate, q);
+        j = 0;
+      } else if (t == FLEXTCP_PL_ARX_CONNUPDATE) {
         j = event_arx_connupdate(ctx, &arx->msg.connupdate, events + i,
             num - i, q);
+      } else if (t == FLEXTCP_PL_ARX_RDMAUPDATE) {
+        rdma_arx_update(arx);
+        rdma++;
+        j = 0;
       } else {
         j = 0;
         fprintf(stderr, "flextcp_context_poll: kout type=%u head=%x\n",
@@ -498,7 +635,9 @@ static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
         break;
       }
       i += j;
+      n++;
 
+      MEM_BARRIER();
       arx->type = 0;
 
       /* next entry */
@@ -524,7 +663,7 @@ static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
   }
 
   *used = i;
-  return 0;
+  return rdma;
 }
 
 
@@ -549,8 +688,16 @@ int flextcp_context_poll(struct flextcp_context *ctx, int num,
     return i;
   }
 
-  /* poll NIC queues */
-  fastpath_poll_vec(ctx, num - i, events + i, &j);
+  /* connection updates set aside by rdma_cq_fastpath_poll() go first */
+  if (ctx->arx_deferred_num > 0) {
+    i += arx_deferred_poll(ctx, num - i, events + i);
+  }
+
+  /* poll NIC queues, newer updates wait until the deferred ones are out */
+  j = 0;
+  if (ctx->arx_deferred_num == 0) {
+    fastpath_poll_vec(ctx, num - i, events + i, &j);
+  }
 
   txq_probe(ctx, num);
   // TODO: Handle failed rdma bumps
@@ -636,11 +783,20 @@ static inline int event_kappin_conn_opened(
   conn->txb_base = (uint8_t *) flexnic_mem + inev->tx_off;
   conn->txb_len = inev->tx_len;
 
-  conn->wq_base = (uint8_t *) flexnic_mem + inev->wq_off;
+  /* work queue is attached on first use */
+  if (inev->wq_len > 0) {
+    conn->wq_base = (uint8_t *) flexnic_mem + inev->wq_off;
+    conn->rcv_base = conn->wq_base + inev->wq_len;
+  } else {
+    conn->wq_base = NULL;
+    conn->rcv_base = NULL;
+  }
   conn->wq_size = inev->wq_len;
 
   conn->mr = (uint8_t *) flexnic_mem + inev->mr_off;
   conn->mr_len = inev->mr_len;
+  conn->rdma_mrs[0].base = conn->mr;
+  conn->rdma_mrs[0].len = conn->mr_len;
 
   /* inject bump if necessary */
   if (conn->rxb_used > 0) {
@@ -715,11 +871,20 @@ static inline int event_kappin_accept_conn(
   conn->txb_base = (uint8_t *) flexnic_mem + inev->tx_off;
   conn->txb_len = inev->tx_len;
 
-  conn->wq_base = (uint8_t *) flexnic_mem + inev->wq_off;
+  /* work queue is attached on first use */
+  if (inev->wq_len > 0) {
+    conn->wq_base = (uint8_t *) flexnic_mem + inev->wq_off;
+    conn->rcv_base = conn->wq_base + inev->wq_len;
+  } else {
+    conn->wq_base = NULL;
+    conn->rcv_base = NULL;
+  }
   conn->wq_size = inev->wq_len;
 
   conn->mr = (uint8_t *) flexnic_mem + inev->mr_off;
   conn->mr_len = inev->mr_len;
+  conn->rdma_mrs[0].base = conn->mr;
+  conn->rdma_mrs[0].len = conn->mr_len;
 
   /* inject bump if necessary */
   if (conn->rxb_used > 0) {
@@ -754,6 +919,60 @@ static inline void event_kappin_st_conn_move(
   outev->ev.conn_moved.conn = conn;
 }
 
+static inline void event_kappin_st_rdma_mr(
+    struct kernel_appin_rdma_mr *inev, struct flextcp_event *outev)
+{
+  struct flextcp_connection *conn;
+
+  conn = OPAQUE_PTR(inev->opaque);
+
+  if (inev->status == 0 && inev->key > 0 && inev->key < FLEXTCP_RDMA_MR_NUM) {
+    if (inev->mr_len > 0) {
+      conn->rdma_mrs[inev->key].base = (uint8_t *) flexnic_mem + inev->mr_off;
+    } else {
+      conn->rdma_mrs[inev->key].base = NULL;
+    }
+    conn->rdma_mrs[inev->key].len = inev->mr_len;
+  }
+
+  outev->event_type = FLEXTCP_EV_CONN_RDMA_MR;
+  outev->ev.conn_rdma_mr.status = inev->status;
+  outev->ev.conn_rdma_mr.key = inev->key;
+  outev->ev.conn_rdma_mr.conn = conn;
+}
+
+static inline void event_kappin_st_rdma_shared_mr(
+    struct kernel_appin_rdma_mr *inev, struct flextcp_event *outev)
+{
+  outev->event_type = FLEXTCP_EV_RDMA_SHARED_MR;
+  outev->ev.rdma_shared_mr.status = inev->status;
+  outev->ev.rdma_shared_mr.len = inev->mr_len;
+  outev->ev.rdma_shared_mr.mr = (inev->status == 0 ?
+      (uint8_t *) flexnic_mem + inev->mr_off : NULL);
+}
+
+static inline void event_kappin_st_rdma_wq(
+    struct kernel_appin_rdma_wq *inev, struct flextcp_event *outev)
+{
+  struct flextcp_connection *conn;
+
+  conn = OPAQUE_PTR(inev->opaque);
+
+  /* queue positions are kept while the work queue is released */
+  if (inev->status == 0 && inev->wq_len > 0) {
+    conn->wq_base = (uint8_t *) flexnic_mem + inev->wq_off;
+    conn->wq_size = inev->wq_len;
+    conn->rcv_base = conn->wq_base + conn->wq_size;
+  } else if (inev->status == 0) {
+    conn->wq_base = NULL;
+    conn->rcv_base = NULL;
+  }
+
+  outev->event_type = FLEXTCP_EV_CONN_RDMA_WQ;
+  outev->ev.conn_rdma_wq.status = inev->status;
+  outev->ev.conn_rdma_wq.conn = conn;
+}
+
 static inline void event_kappin_st_listen_open(
     struct kernel_appin_status *inev, struct flextcp_event *outev)
 {
@@ -985,6 +1204,23 @@ int rdma_conn_bump(struct flextcp_context *ctx,
 	  return 0;
 }
 
+int rdma_conn_recv_bump(struct flextcp_context *ctx,
+		struct flextcp_connection *c){
+	struct flextcp_pl_atx *atx;
+    assert(c->status == CONN_OPEN);
+    txq_probe(ctx, ctx->txq_len);
+    if (flextcp_context_tx_alloc(ctx, &atx, c->fn_core) != 0) {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+		    return -1;
+    }
+    atx->msg.rdmarecv.rcv_head = (c->rcv_tail + c->rcv_len) % c->wq_size;
+    atx->msg.rdmarecv.flow_id = c->flow_id;
+    MEM_BARRIER();
+    atx->type = FLEXTCP_PL_ATX_RDMARECV;
+    flextcp_context_tx_done(ctx, c->fn_core);
+	  return 0;
+}
+
 static void conns_bump(struct flextcp_context *ctx)
 {
   struct flextcp_connection *c;
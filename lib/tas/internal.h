@@ -37,6 +37,8 @@
 #define CONN_FLAG_TXEOS_ACK 4
 #define CONN_FLAG_RXEOS 8
 
+STATIC_ASSERT(FLEXTCP_RDMA_MR_NUM == FLEXNIC_PL_MR_NUM, rdma_mr_num);
+
 enum conn_state {
   CONN_CLOSED,
   CONN_OPEN_REQUESTED,
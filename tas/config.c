@@ -49,6 +49,9 @@ enum cfg_params {
   CP_TCP_HANDSHAKE_RETRIES,
   CP_RDMA_MR_LEN,
   CP_RDMA_WQ_LEN,
+  CP_RDMA_MR_MAX,
+  CP_RDMA_WQ_MAX,
+  CP_RDMA_APP_MEM,
   CP_CC,
   CP_CC_CONTROL_GRANULARITY,
   CP_CC_CONTROL_INTERVAL,
@@ -76,6 +79,7 @@ enum cfg_params {
   CP_FP_NO_AUTOSCALE,
   CP_FP_NO_HUGEPAGES,
   CP_FP_VLAN_STRIP,
+  CP_FP_RDMA_ZEROCOPY,
   CP_KNI_NAME,
   CP_READY_FD,
   CP_DPDK_EXTRA,
@@ -128,6 +132,15 @@ static struct option opts[] = {
     { .name = "rmda-wq-len",
       .has_arg = required_argument,
       .val = CP_RDMA_WQ_LEN },
+    { .name = "rdma-mr-max",
+      .has_arg = required_argument,
+      .val = CP_RDMA_MR_MAX },
+    { .name = "rdma-wq-max",
+      .has_arg = required_argument,
+      .val = CP_RDMA_WQ_MAX },
+    { .name = "rdma-app-mem",
+      .has_arg = required_argument,
+      .val = CP_RDMA_APP_MEM },
     { .name = "cc",
       .has_arg = required_argument,
       .val = CP_CC },
@@ -209,6 +222,9 @@ static struct option opts[] = {
     { .name = "fp-vlan-strip",
       .has_arg = no_argument,
       .val = CP_FP_VLAN_STRIP },
+    { .name = "fp-rdma-zerocopy",
+      .has_arg = no_argument,
+      .val = CP_FP_RDMA_ZEROCOPY },
     { .name = "kni-name",
       .has_arg = required_argument,
       .val = CP_KNI_NAME },
@@ -338,6 +354,24 @@ int config_parse(struct configuration *c, int argc, char *argv[])
           goto failed;
         }
         break;
+      case CP_RDMA_MR_MAX:
+        if (parse_int64(optarg, &c->rdma_mr_max) != 0) {
+          fprintf(stderr, "rdma mr max parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_RDMA_WQ_MAX:
+        if (parse_int64(optarg, &c->rdma_wq_max) != 0) {
+          fprintf(stderr, "rdma wq max parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_RDMA_APP_MEM:
+        if (parse_int64(optarg, &c->rdma_app_mem) != 0) {
+          fprintf(stderr, "rdma app mem parsing failed\n");
+          goto failed;
+        }
+        break;
       case CP_CC:
         if (!strcmp(optarg, "dctcp-win")) {
           c->cc_algorithm = CONFIG_CC_DCTCP_WIN;
@@ -347,6 +381,8 @@ int config_parse(struct configuration *c, int argc, char *argv[])
           c->cc_algorithm = CONFIG_CC_CONST_RATE;
         } else if (!strcmp(optarg, "timely")) {
           c->cc_algorithm = CONFIG_CC_TIMELY;
+        } else if (!strcmp(optarg, "rdma-rate")) {
+          c->cc_algorithm = CONFIG_CC_RDMA_RATE;
         } else {
           fprintf(stderr, "cc algorithm parsing failed\n");
           goto failed;
@@ -497,6 +533,9 @@ int config_parse(struct configuration *c, int argc, char *argv[])
       case CP_FP_VLAN_STRIP:
         c->fp_vlan_strip = 1;
         break;
+      case CP_FP_RDMA_ZEROCOPY:
+        c->fp_rdma_zerocopy = 1;
+        break;
 
       case CP_KNI_NAME:
         if (!(c->kni_name = strdup(optarg))) {
@@ -565,6 +604,9 @@ static int config_defaults(struct configuration *c, char *progname)
   c->tcp_handshake_retries = 10;
   c->rdma_mr_len = 64 * 1024;
   c->rdma_wq_len = 20 * 64;
+  c->rdma_mr_max = 64 * 1024 * 1024;
+  c->rdma_wq_max = 1024 * 32;
+  c->rdma_app_mem = 0;
   c->cc_algorithm = CONFIG_CC_DCTCP_RATE;
   c->cc_control_granularity = 50;
   c->cc_control_interval = 2;
@@ -590,6 +632,7 @@ static int config_defaults(struct configuration *c, char *progname)
   c->fp_autoscale = 1;
   c->fp_hugepages = 1;
   c->fp_vlan_strip = 0;
+  c->fp_rdma_zerocopy = 0;
   c->kni_name = NULL;
   c->ready_fd = -1;
   c->quiet = 0;
@@ -634,10 +677,22 @@ static void print_usage(struct configuration *c, char *progname)
       "  --tcp-handshake-retries=RETRIES  Handshake retries "
           "[default: %"PRIu32"]\n"
       "\n"
+      "RDMA parameters:\n"
+      "  --rmda-mr-len=LEN           Default memory region size "
+          "[default: %"PRIu64"]\n"
+      "  --rmda-wq-len=LEN           Default work queue size "
+          "[default: %"PRIu64"]\n"
+      "  --rdma-mr-max=LEN           Max memory region size per connection "
+          "[default: %"PRIu64"]\n"
+      "  --rdma-wq-max=LEN           Max work queue size per connection "
+          "[default: %"PRIu64"]\n"
+      "  --rdma-app-mem=BYTES        Max RDMA buffer memory per application "
+          "[default: unlimited]\n"
+      "\n"
       "Congestion control parameters:\n"
       "  --cc=ALGORITHM              Congestion-control algorithm "
           "[default: dctcp-rate]\n"
-      "     Options: dctcp-win, dctcp-rate, const-rate, timely\n"
+      "     Options: dctcp-win, dctcp-rate, const-rate, timely, rdma-rate\n"
       "  --cc-control-granularity=G  Minimal control iteration "
           "[default: %"PRIu32"]\n"
       "  --cc-control-interval=INT   Control interval (multiples of RTT) "
@@ -690,6 +745,8 @@ static void print_usage(struct configuration *c, char *progname)
           "[default: enabled]\n"
       "  --fp-no-hugepages           Disable hugepages for SHM "
           "[default: enabled]\n"
+      "  --fp-rdma-zerocopy          Transmit RDMA payloads from SHM "
+          "[default: disabled]\n"
       "  --dpdk-extra=ARG            Add extra DPDK argument\n"
       "\n"
       "Host kernel interface:\n"
@@ -706,6 +763,7 @@ static void print_usage(struct configuration *c, char *progname)
       c->nic_rx_len, c->nic_tx_len, c->app_kin_len, c->app_kout_len,
       c->tcp_rtt_init, c->tcp_link_bw, c->tcp_rxbuf_len, c->tcp_txbuf_len,
       c->tcp_handshake_to, c->tcp_handshake_retries,
+      c->rdma_mr_len, c->rdma_wq_len, c->rdma_mr_max, c->rdma_wq_max,
       c->cc_control_granularity, c->cc_control_interval, c->cc_rexmit_ints,
       (double) c->cc_dctcp_weight / UINT32_MAX, c->cc_dctcp_min,
       c->cc_const_rate, c->cc_timely_tlow, c->cc_timely_thigh,
@@ -56,7 +56,8 @@ int fast_appctx_poll_fetch(struct dataplane_context *ctx, uint32_t id,
   if (type == 0) {
     return -1;
   } else if (type != FLEXTCP_PL_ATX_CONNUPDATE
-          && type != FLEXTCP_PL_ATX_RDMAUPDATE) {
+          && type != FLEXTCP_PL_ATX_RDMAUPDATE
+          && type != FLEXTCP_PL_ATX_RDMARECV) {
     fprintf(stderr, "fast_appctx_poll: unknown type: %u id=%u\n", type,
         id);
     abort();
@@ -65,7 +66,12 @@ int fast_appctx_poll_fetch(struct dataplane_context *ctx, uint32_t id,
   *pqe = atx;
 
   /* update RX/TX queue pointers for connection */
-  flow_id = atx->msg.connupdate.flow_id;
+  if (type == FLEXTCP_PL_ATX_CONNUPDATE)
+    flow_id = atx->msg.connupdate.flow_id;
+  else if (type == FLEXTCP_PL_ATX_RDMAUPDATE)
+    flow_id = atx->msg.rdmaupdate.flow_id;
+  else
+    flow_id = atx->msg.rdmarecv.flow_id;
   if (flow_id >= FLEXNIC_PL_FLOWST_NUM) {
     fprintf(stderr, "fast_appctx_poll: invalid flow id=%u\n", flow_id);
     abort();
@@ -93,9 +99,12 @@ int fast_appctx_poll_bump(struct dataplane_context *ctx, void *pqe,
     ret = fast_flows_bump(ctx, atx->msg.connupdate.flow_id,
         atx->msg.connupdate.bump_seq, atx->msg.connupdate.rx_bump,
         atx->msg.connupdate.tx_bump, atx->msg.connupdate.flags, nbh, ts);
-  else
+  else if (atx->type == FLEXTCP_PL_ATX_RDMAUPDATE)
     ret = fast_rdmawq_bump(ctx, atx->msg.rdmaupdate.flow_id,
         atx->msg.rdmaupdate.wq_head, atx->msg.rdmaupdate.cq_tail);
+  else
+    ret = fast_rdmarcv_bump(ctx, atx->msg.rdmarecv.flow_id,
+        atx->msg.rdmarecv.rcv_head);
 
   if (ret != 0)
     ret = 1;
@@ -174,3 +183,115 @@ int fast_actx_rxq_probe(struct dataplane_context *ctx, uint32_t id)
 
   return 0;
 }
+
+/* Defer cached update i to the overflow list, -1 if that is full too */
+static int arx_ovf_add(struct dataplane_context *ctx, uint16_t i)
+{
+  struct flextcp_pl_arx *arx = &ctx->arx_cache[i];
+  uint16_t j;
+
+  /* positions are absolute, the newer update replaces the deferred one */
+  j = arx_find(ctx->arx_ovf, ctx->arx_ovf_ctx, ctx->arx_ovf_num,
+      ctx->arx_ctx[i], arx->msg.rdmaupdate.opaque);
+  if (j < ctx->arx_ovf_num) {
+    ctx->arx_ovf[j] = *arx;
+  } else if (j < ARX_OVF_SIZE) {
+    ctx->arx_ovf[j] = *arx;
+    ctx->arx_ovf_ctx[j] = ctx->arx_ctx[i];
+    ctx->arx_ovf_num++;
+  } else {
+    return -1;
+  }
+
+  ctx->arx_deferred++;
+  fp_state->appctx[ctx->id][ctx->arx_ctx[i]].cnt_arx_deferred++;
+  return 0;
+}
+
+/* Retry deferred updates, those that still do not fit stay in order.
+ * Returns the number of updates delivered. */
+static unsigned arx_ovf_flush(struct dataplane_context *ctx, uint32_t ts)
+{
+  uint16_t i, k = 0;
+  struct flextcp_pl_appctx *actx;
+  struct flextcp_pl_arx *parx;
+
+  for (i = 0; i < ctx->arx_ovf_num; i++) {
+    actx = &fp_state->appctx[ctx->id][ctx->arx_ovf_ctx[i]];
+    if (fast_actx_rxq_alloc(ctx, actx, &parx) != 0) {
+      if (k != i) {
+        ctx->arx_ovf[k] = ctx->arx_ovf[i];
+        ctx->arx_ovf_ctx[k] = ctx->arx_ovf_ctx[i];
+      }
+      k++;
+      continue;
+    }
+
+    *parx = ctx->arx_ovf[i];
+    actx_kick(actx, ts);
+  }
+
+  i = ctx->arx_ovf_num - k;
+  ctx->arx_ovf_num = k;
+  return i;
+}
+
+unsigned arx_cache_flush(struct dataplane_context *ctx, uint32_t ts)
+{
+  uint16_t i, j, n, k;
+  struct flextcp_pl_appctx *actx;
+  struct flextcp_pl_arx *parx[BATCH_SIZE];
+  uint16_t idx[BATCH_SIZE];
+  uint8_t stuck[BATCH_SIZE];
+  unsigned done = 0;
+
+  if (UNLIKELY(ctx->arx_ovf_num > 0))
+    done = arx_ovf_flush(ctx, ts);
+
+  /* A full app rx queue only defers that app's updates. A flow that already
+   * has a deferred update must not be overtaken by a newer one. */
+  for (i = 0, n = 0; i < ctx->arx_num; i++) {
+    stuck[i] = 0;
+    actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[i]];
+    if ((ctx->arx_ovf_num > 0 && arx_find(ctx->arx_ovf, ctx->arx_ovf_ctx,
+            ctx->arx_ovf_num, ctx->arx_ctx[i],
+            ctx->arx_cache[i].msg.rdmaupdate.opaque) < ctx->arx_ovf_num) ||
+        fast_actx_rxq_alloc(ctx, actx, &parx[n]) != 0)
+    {
+      stuck[i] = arx_ovf_add(ctx, i) != 0;
+      continue;
+    }
+    idx[n++] = i;
+  }
+
+  for (i = 0; i < n; i++) {
+    rte_prefetch0(parx[i]);
+  }
+
+  for (i = 0; i < n; i++) {
+    *parx[i] = ctx->arx_cache[idx[i]];
+  }
+
+  /* one kick per application context is enough */
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < i && ctx->arx_ctx[idx[j]] != ctx->arx_ctx[idx[i]]; j++);
+    if (j < i)
+      continue;
+    actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[idx[i]]];
+    actx_kick(actx, ts);
+  }
+
+  /* with the overflow list full, updates stay cached and poll_rx() shrinks
+   * its batch until the applications catch up */
+  for (i = 0, k = 0; i < ctx->arx_num; i++) {
+    if (!stuck[i])
+      continue;
+    if (k != i) {
+      ctx->arx_cache[k] = ctx->arx_cache[i];
+      ctx->arx_ctx[k] = ctx->arx_ctx[i];
+    }
+    k++;
+  }
+  ctx->arx_num = k;
+  return done + n;
+}
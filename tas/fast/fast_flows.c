@@ -36,6 +36,8 @@
 #include "tas_rdma.h"
 
 #define TCP_MSS 1448
+/* Minimal payload run transmitted from the memory region in zero-copy mode */
+#define RDMA_ZEROCOPY_MIN 256
 #define TCP_MAX_RTT 100000
 
 //#define SKIP_ACK 1
@@ -289,9 +291,9 @@ int fast_flows_packet(struct dataplane_context *ctx,
   struct pkt_tcp *p = network_buf_bufoff(nbh);
   struct flextcp_pl_flowst *fs = fsp;
   uint32_t payload_bytes, payload_off, seq, ack, old_avail, new_avail,
-           orig_payload;
+           orig_payload, old_rx_avail;
   uint8_t *payload;
-  uint32_t rx_bump = 0, tx_bump = 0, rx_pos, rtt;
+  uint32_t rx_bump = 0, rx_direct = 0, tx_bump = 0, rx_pos, rtt;
   int no_permanent_sp = 0;
   uint16_t tcp_extra_hlen, trim_start, trim_end;
   uint16_t flow_id = fs - fp_state->flowst;
@@ -514,17 +516,24 @@ int fast_flows_packet(struct dataplane_context *ctx,
     goto unlock;
   }
 
-  /* if there is payload, dma it to the receive buffer */
+  /* if there is payload, either place it directly (in order, parsed from the
+   * packet below) or dma it to the receive buffer if it has to be joined with
+   * out of order data or queued behind a request stalled on a full response
+   * queue */
   if (payload_bytes > 0) {
-    flow_rx_write(fs, fs->rx_next_pos, payload_bytes, payload);
+    if (LIKELY(fs->rx_ooo_len == 0 && !fast_rdmarq_stalled(fs))) {
+      rx_direct = payload_bytes;
+    } else {
+      flow_rx_write(fs, fs->rx_next_pos, payload_bytes, payload);
 
-    rx_bump = payload_bytes;
-    fs->rx_avail -= payload_bytes;
-    fs->rx_next_pos += payload_bytes;
-    if (fs->rx_next_pos >= fs->rx_len) {
-      fs->rx_next_pos -= fs->rx_len;
+      rx_bump = payload_bytes;
+      fs->rx_avail -= payload_bytes;
+      fs->rx_next_pos += payload_bytes;
+      if (fs->rx_next_pos >= fs->rx_len) {
+        fs->rx_next_pos -= fs->rx_len;
+      }
+      assert(fs->rx_next_pos < fs->rx_len);
     }
-    assert(fs->rx_next_pos < fs->rx_len);
     fs->rx_next_seq += payload_bytes;
 #ifndef SKIP_ACK
     trigger_ack = 1;
@@ -586,36 +595,31 @@ int fast_flows_packet(struct dataplane_context *ctx,
 unlock:
   /* if we bumped at least one, then we need to add a notification to the
    * queue */
-  if (LIKELY(rx_bump != 0 || tx_bump != 0 || fin_bump)) {
+  if (LIKELY(rx_bump != 0 || rx_direct != 0 || tx_bump != 0 || fin_bump)) {
 #if PL_DEBUG_ARX
     fprintf(stderr, "dma_krx_pkt_fastpath: updating application state\n");
 #endif
 
-    /**
-     * TODO:
-     * If rx_bump: fast_rdmarq_bump() -> if cq_update, arx_cache_add()
-     * If tx_bump: rdma_poll_workqueue()
-     */
-    if (rx_bump != 0)
+    /* Retire acknowledged messages, parse received requests/responses,
+     * then queue any responses and pending WQEs. The qman update below
+     * covers the added bytes. */
+    if (tx_bump != 0)
+    {
+      fast_rdma_txack(fs, tx_bump);
+    }
+    if (rx_direct != 0)
+    {
+      fast_rdmarq_place(ctx, fs, payload, rx_direct);
+    }
+    else if (rx_bump != 0 || fast_rdmarq_stalled(fs))
     {
+      old_rx_avail = fs->rx_avail;
       fast_rdmarq_bump(ctx, fs, rx_pos, rx_bump);
+      /* stalled request resumed, announce the reopened window */
+      if (fs->rx_avail > old_rx_avail)
+        trigger_ack = 1;
     }
-
-    uint32_t old_avail, new_avail;
-    // copy packets into txbuf
-    old_avail = tcp_txavail(fs, NULL);
     fast_rdma_poll(ctx, fs);
-    new_avail = tcp_txavail(fs, NULL);
-
-    if (old_avail < new_avail) {
-      if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail -
-            old_avail, TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK
-            | QMAN_ADD_AVAIL) != 0)
-      {
-        fprintf(stderr, "fast_rdmawq_bump: qman_set failed, UNEXPECTED\n");
-        abort();
-      }
-    }
 
     uint16_t type;
     type = FLEXTCP_PL_ARX_CONNUPDATE;
@@ -642,8 +646,6 @@ unlock:
       };
     trace_event(FLEXNIC_PL_TREV_ARX, sizeof(te_arx), &te_arx);
 #endif
-
-    // arx_cache_add(ctx, fs->db_id, fs->opaque, rx_bump, rx_pos, tx_bump, type);
   }
 
   /* Flow control: More receiver space? -> might need to start sending */
@@ -911,9 +913,12 @@ static void flow_tx_segment(struct dataplane_context *ctx,
     uint32_t seq, uint32_t ack, uint32_t rxwnd, uint16_t payload,
     uint32_t payload_pos, uint32_t ts_echo, uint32_t ts_my, uint8_t fin)
 {
-  uint16_t hdrs_len, optlen, fin_fl;
+  uint16_t hdrs_len, optlen, fin_fl, zc_len = 0;
   struct pkt_tcp *p = network_buf_buf(nbh);
   struct tcp_timestamp_opt *opt_ts;
+  struct network_buf_handle *zc_nbh = NULL;
+  uint64_t zc_addr = 0;
+  uint32_t *zc_refs = NULL;
 
   /* calculate header length depending on options */
   optlen = (sizeof(*opt_ts) + 3) & ~3;
@@ -965,63 +970,18 @@ static void flow_tx_segment(struct dataplane_context *ctx,
 #endif
 
   if (payload > 0) {
-    // send rdma header
-    struct rdma_wqe* wqe;
-    struct rdma_hdr hdr;
-    void* mr_buf;
-    uint8_t* pkt_buf;
-    int32_t residual = (int32_t) payload;
-
-    pkt_buf = (uint8_t*) p;
-    pkt_buf += hdrs_len; //point after TCP headers
-
-    while (residual>0 && fs->txb_head) {
-#ifdef DEBUG_MSG
-      fprintf(stderr, "  wqe_tx_seq=%u rqe_tx_seq=%u tx_avail=%u tx_sent=%u\n",
-              fs->wqe_tx_seq, fs->rqe_tx_seq, fs->tx_avail, fs->tx_sent);
-#endif
-      wqe = dma_pointer(fs->wq_base + fs->wqe_tx_seq, sizeof(struct rdma_wqe));
-#ifdef DEBUG_MSG
-      assert(wqe->type);
-      assert(wqe->status == RDMA_TX_PENDING);
-#endif
-      //TODO: distinguish rdma write / rdma read
-      hdr.type = RDMA_REQUEST | RDMA_WRITE;
-      hdr.status = 0;
-      hdr.length = t_beui32(wqe->len);
-      hdr.offset = t_beui32(wqe->roff);
-      hdr.id = t_beui32(wqe->id);
-      hdr.flags = t_beui16(0);
-#ifdef DEBUG_MSG
-      fprintf(stderr, "  hdr2: type=%u,%u stat=%u len=%u offset=%u id=%u\n",
-              hdr.type, wqe->type, hdr.status, wqe->len, wqe->roff, wqe->id);
-#endif
-      memcpy(pkt_buf, &hdr, sizeof(struct rdma_hdr));
-      residual -= sizeof(struct rdma_hdr);
+    /* zero-copy: a trailing payload run is sent straight from the memory
+     * region in a second segment, the rest is copied behind the headers */
+    if (config.fp_rdma_zerocopy) {
+      zc_len = fast_rdma_txzc(fs, payload, RDMA_ZEROCOPY_MIN);
+      if (zc_len > 0 && (zc_nbh = network_buf_alloc_ext(&ctx->net)) == NULL) {
+        zc_len = 0;
+      }
+    }
 
-      // send rdma payload
-      pkt_buf += sizeof(struct rdma_hdr);
-      mr_buf = dma_pointer(fs->mr_base + wqe->loff, wqe->len);
-      memcpy(pkt_buf, mr_buf, wqe->len);
-#ifdef DEBUG_MSG
-      fprintf(stderr, "  payload: %s, mr_base: %p mr_len: %u wq_len: %u\n",
-              (char*)mr_buf, (uint8_t *)(fs->mr_base + tas_shm), fs->mr_len, fs->wq_len);
-#endif
-      wqe->status = RDMA_SUCCESS; //RDMA_RESP_PENDING;
-
-      // update sent wqe position
-      /* Don't need to update wq_tail because it will be done at fast_rdma_poll()
-      if (fs->wq_tail < fs->wq_head) fs->wq_tail += sizeof(struct rdma_wqe);
-      if (fs->wq_tail >= fs->wq_len) fs->wq_tail -= fs->wq_len; */
-      fs->wqe_tx_seq += sizeof(struct rdma_wqe);
-      if (fs->wqe_tx_seq >= fs->wq_len)
-        fs->wqe_tx_seq -= fs->wq_len;
-      fs->txb_head -= sizeof(struct rdma_wqe);
-      pkt_buf += wqe->len;
-      residual -= wqe->len;
-#ifdef DEBUG_MSG
-      fprintf(stderr, "  txb_head: %u, residual: %u\n", fs->txb_head, residual);
-#endif
+    fast_rdma_txfill(fs, (uint8_t *) p + hdrs_len, payload - zc_len);
+    if (zc_len > 0) {
+      zc_addr = fast_rdma_txskip(fs, zc_len, &zc_refs);
     }
   }
 
@@ -1044,7 +1004,14 @@ static void flow_tx_segment(struct dataplane_context *ctx,
   trace_event(FLEXNIC_PL_TREV_TXSEG, sizeof(te_txseg), &te_txseg);
 #endif
 
-  tx_send(ctx, nbh, 0, hdrs_len + payload);
+  /* the zero-copy segment is chained before the packet is queued */
+  network_buf_setoff(nbh, 0);
+  network_buf_setlen(nbh, hdrs_len + payload - zc_len);
+  if (zc_len > 0) {
+    network_buf_chain_ext(nbh, zc_nbh, dma_pointer(zc_addr, zc_len), zc_len,
+        zc_refs);
+  }
+  tx_enqueue(ctx, nbh);
 }
 
 static void flow_tx_ack(struct dataplane_context *ctx, uint32_t seq,
@@ -1140,6 +1107,9 @@ static void flow_reset_retransmit(struct flextcp_pl_flowst *fs)
   fs->rx_remote_avail += fs->tx_sent;
   fs->tx_sent = 0;
 
+  /* segments are rebuilt from the work/response queues */
+  fast_rdma_txrewind(fs);
+
   /* cut rate by half if first drop in control interval */
   if (fs->cnt_tx_drops == 0) {
     fs->tx_rate /= 2;
@@ -2,12 +2,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <rte_cycles.h>
+#include <utils.h>
 #include <utils_sync.h>
 
 #include "fastpath.h"
 #include "packet_defs.h"
 #include "internal.h"
+#include "fastemu.h"
 #include "tas_memif.h"
 #include "tas.h"
 #include "tas_rdma.h"
@@ -15,9 +19,6 @@
 
 #define TCP_MSS 1448
 
-#define RDMA_RQ_PENDING_PARSE 0x0
-#define RDMA_RQ_PENDING_DATA  0x10
-
 #if 1
 #define fs_lock(fs) util_spin_lock(&fs->lock)
 #define fs_unlock(fs) util_spin_unlock(&fs->lock)
@@ -28,34 +29,283 @@
 
 static inline void fast_rdma_rxbuf_copy(struct flextcp_pl_flowst* fl,
       uint32_t rx_head, uint32_t len, void* dst);
-static inline void fast_rdmacq_bump(struct flextcp_pl_flowst* fl,
-      uint32_t id, uint8_t status);
+static inline int fast_rdma_rx(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fs, const uint8_t* buf, uint32_t rx_head,
+      uint32_t rx_bump);
+static inline int fast_rdmacq_find(struct flextcp_pl_flowst* fl,
+      uint32_t id, uint32_t* wqe_pos);
+static inline void fast_rdma_rx_hold(struct flextcp_pl_flowst* fs,
+      const uint8_t* buf, uint32_t len);
+static inline uint8_t fast_rdmacq_bump(struct flextcp_pl_flowst* fl,
+      uint32_t wqe_pos);
 static inline void arx_rdma_cache_add(struct dataplane_context* ctx,
-      uint16_t ctx_id, uint64_t opaque, uint32_t wq_tail, uint32_t cq_head);
+      uint16_t ctx_id, uint64_t opaque, uint32_t wq_tail, uint32_t cq_head,
+      uint32_t rcv_tail);
 void fast_rdma_poll(struct dataplane_context* ctx,
       struct flextcp_pl_flowst* fl);
 
-static inline uint32_t wqe_txavail(const struct flextcp_pl_flowst *fs)
+static inline uint32_t rdma_qnext(const struct flextcp_pl_flowst* fl,
+      uint32_t pos)
 {
-  uint32_t wqe_avail, tx_avail = 0;
-  struct rdma_wqe* wqe;
-  wqe_avail = fs->wq_head - fs->wq_tail;
+  pos += sizeof(struct rdma_wqe);
+  if (pos >= fl->wq_len)
+    pos -= fl->wq_len;
+  return pos;
+}
+
+/* Header of a write with immediate is followed by the immediate data */
+static inline uint32_t rdma_msg_hdr_len(const struct rdma_wqe* wqe,
+      uint8_t is_rqe)
+{
+  if (!is_rqe && wqe->type == RDMA_OP_WRITE_IMM)
+    return sizeof(struct rdma_hdr) + sizeof(beui32_t);
+  return sizeof(struct rdma_hdr);
+}
+
+/**
+ * Number of bytes a queue entry occupies in the transmit stream.
+ *
+ * Requests (WQ entries) carry the payload for writes, responses (RQ entries)
+ * carry the payload for successful reads.
+ */
+static inline uint32_t rdma_msg_len(const struct rdma_wqe* wqe, uint8_t is_rqe)
+{
+  uint32_t len = rdma_msg_hdr_len(wqe, is_rqe);
+
+  if (is_rqe) {
+    if (wqe->type == RDMA_OP_READ && wqe->status == RDMA_SUCCESS)
+      len += wqe->len;
+  } else if (wqe->type != RDMA_OP_READ) {
+    len += wqe->len;
+  }
+  return len;
+}
+
+static inline uint8_t rdma_op_hdr_type(uint8_t op)
+{
+  switch (op)
+  {
+    case RDMA_OP_READ:
+      return RDMA_READ;
+    case RDMA_OP_SEND:
+      return RDMA_SEND;
+    case RDMA_OP_FETCH_ADD:
+      return RDMA_FETCH_ADD;
+    case RDMA_OP_CMP_SWAP:
+      return RDMA_CMP_SWAP;
+    default:
+      return RDMA_WRITE;
+  }
+}
+
+/* Operand bytes carried by an atomic request */
+static inline uint32_t rdma_atomic_len(uint8_t op)
+{
+  return (op == RDMA_OP_CMP_SWAP ? 2 : 1) * sizeof(uint64_t);
+}
+
+/* Extension slot of the WQE at offset pos, holding its SGE list or inline
+ * payload. The slots follow the receive queue. */
+static inline uint64_t rdma_wqe_ext(const struct flextcp_pl_flowst* fl,
+      uint32_t pos)
+{
+  return fl->wq_base + 2 * fl->wq_len +
+      pos / sizeof(struct rdma_wqe) * RDMA_WQE_EXT_LEN;
+}
+
+#ifdef FLEXNIC_RDMA_LATENCY
+static __thread struct flexnic_rdma_lat *rdma_lat;
+
+int rdma_lat_thread_init(uint16_t id)
+{
+  char name[64];
+
+  snprintf(name, sizeof(name), FLEXNIC_RDMA_LAT_NAME, id);
+  if ((rdma_lat = util_create_shmsiszed(name, sizeof(*rdma_lat), NULL))
+      == NULL)
+  {
+    return -1;
+  }
+
+  memset(rdma_lat, 0, sizeof(*rdma_lat));
+  rdma_lat->tsc_hz = rte_get_tsc_hz();
+  return 0;
+}
 
-#ifdef DEBUG_MSG
-  fprintf(stderr, "wqe_avail= %d, wq_head= %d, wq_tail= %d, wq_len= %d\n",
-          wqe_avail, fs->wq_head, fs->wq_tail, fs->wq_len);
+/* Timestamps of the WQE at offset pos, the slots follow the extensions */
+static inline struct rdma_wqe_ts* rdma_wqe_ts(
+      const struct flextcp_pl_flowst* fl, uint32_t pos)
+{
+  uint32_t n = fl->wq_len / sizeof(struct rdma_wqe);
+
+  return dma_pointer(fl->wq_base + 2 * fl->wq_len + n * RDMA_WQE_EXT_LEN +
+      pos / sizeof(struct rdma_wqe) * RDMA_WQE_TS_LEN, RDMA_WQE_TS_LEN);
+}
+
+/* Arrival timestamp of the response queue entry at offset pos */
+static inline uint64_t* rdma_rqe_ts(const struct flextcp_pl_flowst* fl,
+      uint32_t pos)
+{
+  return dma_pointer(fl->rq_base + fl->wq_len +
+      pos / sizeof(struct rdma_wqe) * RDMA_RQE_TS_LEN, RDMA_RQE_TS_LEN);
+}
 #endif
 
-  // TODO?: calculate tx bytes for each wqe
-  // sum byte between wq_head and wq_tail, each wqe has wqe->len bytes
-  if (wqe_avail) {
-    wqe = dma_pointer(fs->wq_base + fs->wqe_tx_seq, sizeof(struct rdma_wqe));
-    if (wqe->status == RDMA_PENDING) {
-      tx_avail += (wqe->len + sizeof(struct rdma_hdr));
-      wqe->status = RDMA_TX_PENDING;
+/**
+ * Memory region of the flow registered with key, *len is set to its size.
+ * Key 0 is the region the flow was created with. Unknown and released keys
+ * resolve to an empty region, failing every bounds check.
+ */
+static inline uint64_t rdma_mr(const struct flextcp_pl_flowst* fl,
+      uint16_t key, uint32_t* len)
+{
+  const struct flextcp_pl_mr* mr;
+
+  if (key == 0)
+  {
+    *len = fl->mr_len;
+    return fl->mr_base;
+  }
+  if (UNLIKELY(key >= FLEXNIC_PL_MR_NUM))
+  {
+    *len = 0;
+    return 0;
+  }
+
+  mr = &fp_state->flow_mrs[fl - fp_state->flowst][key];
+  *len = mr->len;
+  return mr->base;
+}
+
+/* len bytes at off lie within the memory region registered with key */
+static inline int rdma_mr_contains(const struct flextcp_pl_flowst* fl,
+      uint16_t key, uint32_t off, uint32_t len)
+{
+  uint32_t mr_len;
+
+  rdma_mr(fl, key, &mr_len);
+  return (uint64_t) off + len <= mr_len;
+}
+
+/**
+ * Address of payload byte off of the message for a queue entry, *contig is
+ * set to the number of payload bytes stored contiguously from there.
+ * Requests posted with an SGE list are gathered from its segments, inline
+ * requests and atomics carry the payload in the WQE extension slot.
+ */
+static inline uint64_t rdma_msg_payload(const struct flextcp_pl_flowst* fl,
+      const struct rdma_wqe* wqe, uint8_t is_rqe, uint32_t qpos, uint32_t off,
+      uint32_t* contig)
+{
+  const struct rdma_sge* sge;
+  uint32_t i, mr_len;
+
+  if (is_rqe || ((wqe->flags & (RDMA_WQE_SGL | RDMA_WQE_INLINE)) == 0
+        && wqe->type != RDMA_OP_FETCH_ADD && wqe->type != RDMA_OP_CMP_SWAP))
+  {
+    *contig = wqe->len - off;
+    return rdma_mr(fl, wqe->lkey, &mr_len) + wqe->loff + off;
+  }
+
+  if ((wqe->flags & RDMA_WQE_INLINE) != 0 || wqe->type == RDMA_OP_FETCH_ADD
+      || wqe->type == RDMA_OP_CMP_SWAP)
+  {
+    *contig = wqe->len - off;
+    return rdma_wqe_ext(fl, qpos) + off;
+  }
+
+  sge = dma_pointer(rdma_wqe_ext(fl, qpos), RDMA_WQE_EXT_LEN);
+  for (i = 0; off >= sge[i].len; i++)
+    off -= sge[i].len;
+  *contig = sge[i].len - off;
+  return rdma_mr(fl, wqe->lkey, &mr_len) + sge[i].loff + off;
+}
+
+/* Header of the message transmitted for a queue entry, rdma_msg_hdr_len()
+ * bytes are written to buf */
+static inline void rdma_msg_hdr(const struct rdma_wqe* wqe, uint8_t is_rqe,
+      uint32_t msg_len, uint8_t* buf)
+{
+  struct rdma_hdr* hdr = (struct rdma_hdr*) buf;
+
+  hdr->id = t_beui32(wqe->id);
+  hdr->flags = t_beui16(0);
+  if (is_rqe)
+  {
+    hdr->type = RDMA_RESPONSE;
+    hdr->status = wqe->status;
+    if (wqe->type == RDMA_OP_FETCH_ADD || wqe->type == RDMA_OP_CMP_SWAP)
+    {
+      /* Original value of the word, see fast_rdma_atomic() */
+      hdr->offset = t_beui32(wqe->roff);
+      hdr->length = t_beui32(wqe->loff);
+    }
+    else
+    {
+      hdr->offset = t_beui32(0);
+      hdr->length = t_beui32(msg_len - sizeof(struct rdma_hdr));
+    }
+  }
+  else
+  {
+    hdr->type = RDMA_REQUEST;
+    hdr->key = wqe->rkey;
+    hdr->offset = t_beui32(wqe->type == RDMA_OP_SEND ? 0 : wqe->roff);
+    hdr->length = t_beui32(wqe->len);
+    if (wqe->type == RDMA_OP_WRITE_IMM)
+    {
+      hdr->flags = t_beui16(RDMA_HDR_IMM);
+      *(beui32_t*) (hdr + 1) = t_beui32(wqe->imm);
     }
   }
-  return tx_avail;
+  hdr->type |= rdma_op_hdr_type(wqe->type);
+}
+
+/**
+ * Message log
+ *
+ * The TCP transmit buffer of an RDMA flow holds no payload. Instead it is
+ * used as a ring of 32-bit entries recording the WQ/RQ entry of each queued
+ * message in stream order: [txb_tail, txb_head) are queued and not fully
+ * acknowledged, txb_pos is the next one to be transmitted. Segments are
+ * (re)built from the queue entry and the memory region, so retransmission
+ * rewinds to the first unacknowledged byte.
+ */
+
+static inline uint32_t rdma_txlog_next(const struct flextcp_pl_flowst* fl,
+      uint32_t pos)
+{
+  pos += sizeof(uint32_t);
+  if (pos >= fl->tx_len)
+    pos -= fl->tx_len;
+  return pos;
+}
+
+static inline struct rdma_wqe* rdma_txlog_entry(struct flextcp_pl_flowst* fl,
+      uint32_t pos, uint8_t* is_rqe, uint32_t* qpos)
+{
+  uint32_t ent = *(uint32_t*) dma_pointer(fl->tx_base + pos, sizeof(ent));
+
+  *qpos = ent & ~RDMA_TXLOG_RQE;
+  if (ent & RDMA_TXLOG_RQE) {
+    *is_rqe = 1;
+    return dma_pointer(fl->rq_base + *qpos, sizeof(struct rdma_wqe));
+  }
+  *is_rqe = 0;
+  return dma_pointer(fl->wq_base + *qpos, sizeof(struct rdma_wqe));
+}
+
+/* Append message to log, fails if it is full */
+static inline int rdma_txlog_add(struct flextcp_pl_flowst* fl, uint32_t ent)
+{
+  uint32_t head = fl->txb_head;
+
+  if (rdma_txlog_next(fl, head) == fl->txb_tail)
+    return -1;
+
+  *(uint32_t*) dma_pointer(fl->tx_base + head, sizeof(ent)) = ent;
+  fl->txb_head = rdma_txlog_next(fl, head);
+  return 0;
 }
 
 int fast_rdmawq_bump(struct dataplane_context *ctx, uint32_t flow_id,
@@ -94,6 +344,7 @@ int fast_rdmawq_bump(struct dataplane_context *ctx, uint32_t flow_id,
    *  Should we trust the application input blindly ?
    */
   uint8_t invalid = ((new_wq_head >= wq_len)
+        || (fs->wq_base == 0 && new_wq_head != wq_head)
         || (wq_tail < new_wq_head && new_wq_head < wq_head)
         || (new_wq_head < wq_head && wq_head < wq_tail)
         || (wq_head < wq_tail && wq_tail <= new_wq_head)
@@ -117,11 +368,11 @@ int fast_rdmawq_bump(struct dataplane_context *ctx, uint32_t flow_id,
   fs->wq_head = new_wq_head;
   fs->cq_tail = new_cq_tail;
 
-  /* No pending workqueue requests previously !*/
-  if (wq_head == wq_tail)
+  /* Queue all newly posted WQEs at once, a batch is a single bump. Entries
+   * that do not fit in the message log are picked up as acks retire it. */
+  if (wq_head != new_wq_head)
   {
     uint32_t old_avail, new_avail;
-    // copy packets into txbuf
     old_avail = tcp_txavail(fs, NULL);
     fast_rdma_poll(ctx, fs);
     new_avail = tcp_txavail(fs, NULL);
@@ -148,94 +399,377 @@ RDMA_BUMP_ERROR:
   return -1;
 }
 
+int fast_rdmarcv_bump(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t new_rcv_head)
+{
+  struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
+
+  fs_lock(fs);
+  if (UNLIKELY(new_rcv_head >= fs->wq_len
+        || new_rcv_head % sizeof(struct rdma_wqe) != 0
+        || (fs->wq_base == 0 && new_rcv_head != fs->rcv_head)))
+  {
+    fs_unlock(fs);
+    fprintf(stderr, "Invalid receive bump flowid=%u len=%u rcv_head=%u "
+        "new_rcv_head=%u\n", flow_id, fs->wq_len, fs->rcv_head, new_rcv_head);
+    return -1;
+  }
+
+  fs->rcv_head = new_rcv_head;
+  fs_unlock(fs);
+  return -1;  /* Return value compatible with fast_flows_bump() */
+}
+
+/* Posted receive buffer at the head of the receive queue */
+static inline struct rdma_wqe* fast_rdmarcv_entry(struct flextcp_pl_flowst* fs)
+{
+  return dma_pointer(fs->wq_base + fs->wq_len + fs->rcv_tail,
+      sizeof(struct rdma_wqe));
+}
+
+/* Complete the receive buffer consumed by a SEND of len bytes or by a write
+ * with immediate, which reports the written memory and the immediate */
+static inline void fast_rdmarcv_done(struct flextcp_pl_flowst* fs,
+      const struct rdma_wqe* rqe, uint32_t len)
+{
+  struct rdma_wqe* rcv;
+
+  if (rqe->status == RDMA_RECV_NOT_READY)
+    return;
+
+  rcv = fast_rdmarcv_entry(fs);
+  if (rqe->type == RDMA_OP_WRITE_IMM)
+  {
+    rcv->type = RDMA_OP_WRITE_IMM;
+    rcv->loff = rqe->loff;
+    rcv->imm = rqe->imm;
+  }
+  rcv->len = len;
+  rcv->status = rqe->status;
+  fs->rcv_tail = rdma_qnext(fs, fs->rcv_tail);
+}
+
+/* Write or send request at rq_head received completely, returns whether the
+ * application needs to be notified */
+static inline uint8_t fast_rdmarq_done(struct flextcp_pl_flowst* fs,
+      struct rdma_wqe* rqe, uint32_t* rq_head)
+{
+  if (rqe->status == RDMA_PENDING)
+    rqe->status = RDMA_SUCCESS;
+  *rq_head = rdma_qnext(fs, *rq_head);
+
+  if (rqe->type == RDMA_OP_SEND || rqe->type == RDMA_OP_WRITE_IMM)
+  {
+    fast_rdmarcv_done(fs, rqe, rqe->len);
+    return 1;
+  }
+  return 0;
+}
+
+/* Payload of the write or send request at rq_head follows, if any */
+static inline uint8_t fast_rdmarq_data(struct flextcp_pl_flowst* fs,
+      struct rdma_wqe* rqe, uint32_t* rq_head)
+{
+  if (rqe->len == 0)
+    return fast_rdmarq_done(fs, rqe, rq_head);
+
+  fs->pending_rq_state = RDMA_RQ_PENDING_DATA;
+  fs->pending_rq_pos = *rq_head;
+  fs->pending_rq_off = rqe->loff;
+  fs->pending_rq_len = rqe->len;
+  return 0;
+}
+
+/**
+ * Execute an atomic request on the memory region word at its loff.
+ *
+ * The word may be accessed by the application concurrently, so it is updated
+ * with a locked instruction. The original value is kept in roff:loff
+ * (high:low) of the RQ entry until it is returned in the response header.
+ */
+static inline void fast_rdma_atomic(struct flextcp_pl_flowst* fs,
+      struct rdma_wqe* rqe, const uint8_t* buf)
+{
+  uint64_t ops[2], old = 0;
+  uint64_t* word;
+  uint32_t mr_len;
+
+  if (rqe->status == RDMA_PENDING
+      && UNLIKELY(!rdma_mr_contains(fs, rqe->lkey, rqe->loff, sizeof(*word))))
+    rqe->status = RDMA_OUT_OF_BOUNDS;
+
+  if (rqe->status == RDMA_PENDING)
+  {
+    memcpy(ops, buf, rdma_atomic_len(rqe->type));
+    word = dma_pointer(rdma_mr(fs, rqe->lkey, &mr_len) + rqe->loff,
+        sizeof(*word));
+    if (rqe->type == RDMA_OP_FETCH_ADD)
+      old = __sync_fetch_and_add(word, ops[0]);
+    else
+      old = __sync_val_compare_and_swap(word, ops[0], ops[1]);
+    rqe->status = RDMA_SUCCESS;
+  }
+
+  rqe->loff = (uint32_t) old;
+  rqe->roff = (uint32_t) (old >> 32);
+}
+
 int fast_rdmarq_bump(struct dataplane_context* ctx,
     struct flextcp_pl_flowst* fs, uint32_t prev_rx_head, uint32_t rx_bump)
 {
-  uint32_t rq_head, rq_len, rx_head, rx_len, new_rx_head;
+  /* Bytes held behind a stalled request precede the new ones */
+  if (fs->pending_rq_state == RDMA_RQ_PENDING_FULL)
+  {
+    prev_rx_head += fs->rx_len - fs->pending_rq_len;
+    if (prev_rx_head >= fs->rx_len)
+      prev_rx_head -= fs->rx_len;
+    rx_bump += fs->pending_rq_len;
+    fs->pending_rq_len = 0;
+  }
+  return fast_rdma_rx(ctx, fs, NULL, prev_rx_head, rx_bump);
+}
+
+uint8_t fast_rdmarq_stalled(const struct flextcp_pl_flowst* fs)
+{
+  return fs->pending_rq_state == RDMA_RQ_PENDING_FULL;
+}
+
+int fast_rdmarq_place(struct dataplane_context* ctx,
+    struct flextcp_pl_flowst* fs, const uint8_t* payload, uint32_t len)
+{
+  return fast_rdma_rx(ctx, fs, payload, 0, len);
+}
+
+/* Consume len bytes of received stream into dst: from the packet payload in
+ * buf if given, otherwise from the rx buffer at rx_head. Without dst the
+ * bytes are skipped. */
+static inline void fast_rdma_rx_read(struct flextcp_pl_flowst* fs,
+      const uint8_t** buf, uint32_t* rx_head, uint32_t len, void* dst)
+{
+  if (*buf != NULL)
+  {
+    if (dst != NULL)
+      memcpy(dst, *buf, len);
+    *buf += len;
+    return;
+  }
+
+  if (dst != NULL)
+    fast_rdma_rxbuf_copy(fs, *rx_head, len, dst);
+  else
+    fs->rx_avail += len;
+
+  *rx_head += len;
+  if (*rx_head >= fs->rx_len)
+    *rx_head -= fs->rx_len;
+}
+
+/**
+ * Parse received requests and responses.
+ *
+ * In-order segments are parsed straight from the packet and their payload is
+ * written to the memory region once. Data that had to be staged in the rx
+ * buffer (out of order) is parsed from there and the buffer is released.
+ */
+static inline int fast_rdma_rx(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fs, const uint8_t* buf, uint32_t rx_head,
+      uint32_t rx_bump)
+{
+  uint32_t rq_head, mr_len;
   uint8_t cq_bump = 0;
   rq_head = fs->rq_head;
-  rq_len = fs->wq_len;
-  rx_head = prev_rx_head;
-  rx_len = fs->rx_len;
-  new_rx_head = prev_rx_head + rx_bump;
-  if (new_rx_head >= rx_len)
-    new_rx_head -= rx_len;
 
   uint32_t wqe_pending_rx, rx_bump_len;
-  while (rx_head != new_rx_head && rx_bump > 0)
+  while (rx_bump > 0 || fs->pending_rq_state == RDMA_RQ_PENDING_FULL)
   {
-    if (fs->pending_rq_state == RDMA_RQ_PENDING_DATA)
+    if (fs->pending_rq_state == RDMA_RQ_PENDING_DATA
+        || fs->pending_rq_state == RDMA_RQ_PENDING_RESP)
     {
-      struct rdma_wqe* wqe = dma_pointer(fs->rq_base + rq_head,
-                                            sizeof(struct rdma_wqe));
-      wqe_pending_rx = wqe->len;
+      /* Payload of a write request (into RQ entry) or of a read response
+       * (into WQ entry), placed in the memory region */
+      struct rdma_wqe* wqe;
+      uint8_t valid_status;
+      if (fs->pending_rq_state == RDMA_RQ_PENDING_DATA)
+      {
+        wqe = dma_pointer(fs->rq_base + fs->pending_rq_pos,
+                            sizeof(struct rdma_wqe));
+        valid_status = RDMA_PENDING;
+      }
+      else
+      {
+        wqe = dma_pointer(fs->wq_base + fs->pending_rq_pos,
+                            sizeof(struct rdma_wqe));
+        valid_status = RDMA_RESP_PENDING;
+      }
+
+      wqe_pending_rx = fs->pending_rq_len;
       rx_bump_len = MIN(wqe_pending_rx, rx_bump);
-      void* mr_ptr = dma_pointer(fs->mr_base + wqe->loff, rx_bump_len);
-      if (wqe->status == RDMA_PENDING)
-        fast_rdma_rxbuf_copy(fs, rx_head, rx_bump_len, mr_ptr);
+      if (wqe->status == valid_status && UNLIKELY(!rdma_mr_contains(fs,
+              wqe->lkey, fs->pending_rq_off, rx_bump_len)))
+        wqe->status = RDMA_OUT_OF_BOUNDS;
+
+      if (wqe->status == valid_status)
+      {
+        void* mr_ptr = dma_pointer(rdma_mr(fs, wqe->lkey, &mr_len) +
+                                    fs->pending_rq_off, rx_bump_len);
+        fast_rdma_rx_read(fs, &buf, &rx_head, rx_bump_len, mr_ptr);
+      }
       else
       {
         /* Ignore this data */
-        fs->rx_avail += rx_bump_len;
+        fast_rdma_rx_read(fs, &buf, &rx_head, rx_bump_len, NULL);
       }
 
-      rx_head += rx_bump_len;
-      if (rx_head >= rx_len)
-        rx_head -= rx_len;
       rx_bump -= rx_bump_len;
       wqe_pending_rx -= rx_bump_len;
-      wqe->len -= rx_bump_len;
-      wqe->loff += rx_bump_len;
+      fs->pending_rq_len = wqe_pending_rx;
+      fs->pending_rq_off += rx_bump_len;
 
       if (wqe_pending_rx == 0)
       {
-        if (wqe->status == RDMA_PENDING)
-          wqe->status = RDMA_SUCCESS;
+        if (fs->pending_rq_state == RDMA_RQ_PENDING_DATA)
+        {
+          cq_bump |= fast_rdmarq_done(fs, wqe, &rq_head);
+        }
+        else
+        {
+          if (wqe->status == RDMA_RESP_PENDING)
+            wqe->status = RDMA_SUCCESS;
+          cq_bump |= fast_rdmacq_bump(fs, fs->pending_rq_pos);
+        }
+        fs->pending_rq_state = RDMA_RQ_PENDING_PARSE;
+      }
+    }
+    else if (fs->pending_rq_state == RDMA_RQ_PENDING_SKIP)
+    {
+      /* Payload of a dropped request */
+      rx_bump_len = MIN(fs->pending_rq_len, rx_bump);
+      fast_rdma_rx_read(fs, &buf, &rx_head, rx_bump_len, NULL);
 
+      rx_bump -= rx_bump_len;
+      fs->pending_rq_len -= rx_bump_len;
+      if (fs->pending_rq_len == 0)
         fs->pending_rq_state = RDMA_RQ_PENDING_PARSE;
-        rq_head += sizeof(struct rdma_wqe);
-        if (rq_head >= rq_len)
-          rq_head -= rq_len;
+    }
+    else if (fs->pending_rq_state == RDMA_RQ_PENDING_ATOMIC
+        || fs->pending_rq_state == RDMA_RQ_PENDING_IMM)
+    {
+      /* Operands of an atomic request or immediate data of a write, staged
+       * until they are complete */
+      rx_bump_len = MIN(fs->pending_rq_len, rx_bump);
+      fast_rdma_rx_read(fs, &buf, &rx_head, rx_bump_len,
+          fs->pending_rq_buf + fs->pending_rq_off);
+
+      rx_bump -= rx_bump_len;
+      fs->pending_rq_len -= rx_bump_len;
+      fs->pending_rq_off += rx_bump_len;
+
+      if (fs->pending_rq_len == 0)
+      {
+        struct rdma_wqe* wqe = dma_pointer(fs->rq_base + fs->pending_rq_pos,
+                                            sizeof(struct rdma_wqe));
+        if (fs->pending_rq_state == RDMA_RQ_PENDING_ATOMIC)
+        {
+          fast_rdma_atomic(fs, wqe, fs->pending_rq_buf);
+          rq_head = rdma_qnext(fs, rq_head);
+          fs->pending_rq_state = RDMA_RQ_PENDING_PARSE;
+        }
+        else
+        {
+          wqe->imm = f_beui32(*(beui32_t*) fs->pending_rq_buf);
+          fs->pending_rq_state = RDMA_RQ_PENDING_PARSE;
+          cq_bump |= fast_rdmarq_data(fs, wqe, &rq_head);
+        }
       }
     }
     else
     {
-      wqe_pending_rx = 16 - fs->pending_rq_state;
-      rx_bump_len = MIN(wqe_pending_rx, rx_bump);
-      fast_rdma_rxbuf_copy(fs, rx_head, rx_bump_len, fs->pending_rq_buf + fs->pending_rq_state);
+      if (fs->pending_rq_state == RDMA_RQ_PENDING_FULL)
+      {
+        /* Header of a request waiting for a response queue entry */
+        wqe_pending_rx = 0;
+      }
+      else
+      {
+        wqe_pending_rx = sizeof(struct rdma_hdr) - fs->pending_rq_state;
+        rx_bump_len = MIN(wqe_pending_rx, rx_bump);
+        fast_rdma_rx_read(fs, &buf, &rx_head, rx_bump_len,
+            fs->pending_rq_buf + fs->pending_rq_state);
 
-      rx_head += rx_bump_len;
-      if (rx_head >= rx_len)
-        rx_head -= rx_len;
-      rx_bump -= rx_bump_len;
-      wqe_pending_rx -= rx_bump_len;
-      fs->pending_rq_state += rx_bump_len;
+        rx_bump -= rx_bump_len;
+        wqe_pending_rx -= rx_bump_len;
+        fs->pending_rq_state += rx_bump_len;
+      }
 
       if (wqe_pending_rx == 0)
       {
         struct rdma_hdr* hdr = (struct rdma_hdr*) fs->pending_rq_buf;
-        struct rdma_wqe* wqe = dma_pointer(fs->rq_base + rq_head,
-                                            sizeof(struct rdma_wqe));
+        struct rdma_wqe* wqe;
+        uint32_t len = f_beui32(hdr->length);
+        uint32_t off = f_beui32(hdr->offset);
+
+        fs->pending_rq_state = RDMA_RQ_PENDING_PARSE;
 
-        /**
-         *  TODO: Implement RDMA_READ operations
-         */
         uint8_t type = hdr->type;
         if ((type & RDMA_RESPONSE) == RDMA_RESPONSE)
         {
-          if ((type & RDMA_READ) == RDMA_READ)
+          uint32_t wqe_pos;
+          if (UNLIKELY(fast_rdmacq_find(fs, f_beui32(hdr->id), &wqe_pos)
+                != 0))
           {
-            /* Not yet implemented */
-            fprintf(stderr, "%s():%d RDMA_READ Not yet implemented.\n", __func__, __LINE__);
-            abort();
+            /* Matches no WQE, skip the read data that follows */
+            if ((type & RDMA_READ) == RDMA_READ && len > 0)
+            {
+              fs->pending_rq_state = RDMA_RQ_PENDING_SKIP;
+              fs->pending_rq_len = len;
+            }
+            continue;
           }
-          else if ((type & RDMA_WRITE) == RDMA_WRITE)
+          wqe = dma_pointer(fs->wq_base + wqe_pos, sizeof(struct rdma_wqe));
+#ifdef FLEXNIC_RDMA_LATENCY
+          struct rdma_wqe_ts* ts = rdma_wqe_ts(fs, wqe_pos);
+          ts->resp = util_rdtsc();
+          rdma_lat_add(rdma_lat, RDMA_LAT_TX_RESP, ts->tx, ts->resp);
+#endif
+
+          if ((type & RDMA_READ) == RDMA_READ && len > 0)
           {
-            /* No more data to be received */
-            fs->pending_rq_state = RDMA_RQ_PENDING_PARSE;
+            /* Read data follows, place it at the local offset */
+            if (UNLIKELY(len > wqe->len))
+              wqe->status = RDMA_OUT_OF_BOUNDS;
+            else if (UNLIKELY(hdr->status != RDMA_SUCCESS)
+                && wqe->status == RDMA_RESP_PENDING)
+              wqe->status = hdr->status;
+
+            fs->cnt_rx_rdresp_bytes += len;
 
-            fast_rdmacq_bump(fs, f_beui32(hdr->id), hdr->status);
-            cq_bump = 1;
+            fs->pending_rq_state = RDMA_RQ_PENDING_RESP;
+            fs->pending_rq_pos = wqe_pos;
+            fs->pending_rq_off = wqe->loff;
+            fs->pending_rq_len = len;
+          }
+          else if ((type & (RDMA_FETCH_ADD | RDMA_CMP_SWAP)) != 0)
+          {
+            /* Original value of the word, place it at the local offset */
+            uint64_t old = ((uint64_t) off << 32) | len;
+            if (wqe->status == RDMA_RESP_PENDING)
+              wqe->status = hdr->status;
+            if (wqe->status == RDMA_SUCCESS && UNLIKELY(!rdma_mr_contains(fs,
+                    wqe->lkey, wqe->loff, sizeof(old))))
+              wqe->status = RDMA_OUT_OF_BOUNDS;
+            if (wqe->status == RDMA_SUCCESS)
+            {
+              memcpy(dma_pointer(rdma_mr(fs, wqe->lkey, &mr_len) + wqe->loff,
+                  sizeof(old)), &old, sizeof(old));
+            }
+            cq_bump |= fast_rdmacq_bump(fs, wqe_pos);
+          }
+          else if ((type & (RDMA_READ | RDMA_WRITE | RDMA_SEND)) != 0)
+          {
+            /* No more data to be received */
+            if (wqe->status == RDMA_RESP_PENDING)
+              wqe->status = hdr->status;
+            cq_bump |= fast_rdmacq_bump(fs, wqe_pos);
           }
           else
           {
@@ -245,29 +779,113 @@ int fast_rdmarq_bump(struct dataplane_context* ctx,
         }
         else if ((type & RDMA_REQUEST) == RDMA_REQUEST)
         {
+          if (UNLIKELY(rdma_qnext(fs, rq_head) == fs->rqe_ack_pos))
+          {
+            /* No entry until responses are acknowledged. The request waits
+             * with its header kept, the stream behind it stays in the rx
+             * buffer and shrinks the receive window until acks free an
+             * entry. */
+            fs->pending_rq_state = RDMA_RQ_PENDING_FULL;
+            break;
+          }
+
+          wqe = dma_pointer(fs->rq_base + rq_head, sizeof(struct rdma_wqe));
+#ifdef FLEXNIC_RDMA_LATENCY
+          *rdma_rqe_ts(fs, rq_head) = util_rdtsc();
+#endif
           wqe->id = f_beui32(hdr->id);
-          wqe->len = f_beui32(hdr->length);
-          wqe->loff = f_beui32(hdr->offset);
-          if (wqe->loff + wqe->len > fs->mr_len)
+          wqe->len = len;
+          wqe->loff = off;
+          wqe->roff = 0;
+          wqe->flags = 0;
+          wqe->imm = 0;
+          wqe->lkey = hdr->key;
+          wqe->rkey = 0;
+          rdma_mr(fs, wqe->lkey, &mr_len);
+          if ((uint64_t) off + len > mr_len)
             wqe->status = RDMA_OUT_OF_BOUNDS;
           else
             wqe->status = RDMA_PENDING;
-          wqe->roff = 0;
 
           if ((type & RDMA_READ) == RDMA_READ)
           {
-            fprintf(stderr, "%s():%d RDMA_READ Not yet implemented.\n", __func__, __LINE__);
-            abort();
-
+            /* Served from the memory region when the response is sent */
             wqe->type = (RDMA_OP_READ);
-            fs->pending_rq_state = RDMA_RQ_PENDING_PARSE; /* No more data to be received */
-            rq_head += sizeof(struct rdma_wqe);
-            if (rq_head >= rq_len)
-              rq_head -= rq_len;
+            if (wqe->status == RDMA_PENDING)
+              wqe->status = RDMA_SUCCESS;
+            rq_head = rdma_qnext(fs, rq_head);
+          }
+          else if ((type & (RDMA_FETCH_ADD | RDMA_CMP_SWAP)) != 0)
+          {
+            /* Executed once the operands are received */
+            wqe->type = ((type & RDMA_CMP_SWAP) == RDMA_CMP_SWAP ?
+                RDMA_OP_CMP_SWAP : RDMA_OP_FETCH_ADD);
+            if (UNLIKELY(len != rdma_atomic_len(wqe->type)))
+            {
+              /* Operands do not fit the staging buffer, skip them and fail
+               * the request */
+              wqe->status = RDMA_OUT_OF_BOUNDS;
+              cq_bump |= fast_rdmarq_data(fs, wqe, &rq_head);
+              continue;
+            }
+
+            if (off % sizeof(uint64_t) != 0
+                || (uint64_t) off + sizeof(uint64_t) > mr_len)
+              wqe->status = RDMA_OUT_OF_BOUNDS;
+            else
+              wqe->status = RDMA_PENDING;
+
+            fs->pending_rq_state = RDMA_RQ_PENDING_ATOMIC;
+            fs->pending_rq_pos = rq_head;
+            fs->pending_rq_off = 0;
+            fs->pending_rq_len = len;
           }
-          else if ((type & RDMA_WRITE) == RDMA_WRITE)
+          else if ((type & (RDMA_WRITE | RDMA_SEND)) != 0)
           {
-            wqe->type = (RDMA_OP_WRITE);
+            if ((type & RDMA_SEND) == RDMA_SEND)
+            {
+              /* Placed in the next posted receive buffer */
+              struct rdma_wqe* rcv;
+              wqe->type = (RDMA_OP_SEND);
+              if (fs->rcv_tail == fs->rcv_head)
+              {
+                wqe->status = RDMA_RECV_NOT_READY;
+              }
+              else
+              {
+                rcv = fast_rdmarcv_entry(fs);
+                wqe->loff = rcv->loff;
+                wqe->lkey = rcv->lkey;
+                rdma_mr(fs, wqe->lkey, &mr_len);
+                if (len > rcv->len || (uint64_t) wqe->loff + len > mr_len)
+                  wqe->status = RDMA_OUT_OF_BOUNDS;
+                else
+                  wqe->status = RDMA_PENDING;
+              }
+            }
+            else if ((f_beui16(hdr->flags) & RDMA_HDR_IMM) == RDMA_HDR_IMM)
+            {
+              /* Completes the next posted receive buffer */
+              wqe->type = (RDMA_OP_WRITE_IMM);
+              if (fs->rcv_tail == fs->rcv_head)
+                wqe->status = RDMA_RECV_NOT_READY;
+            }
+            else
+            {
+              wqe->type = (RDMA_OP_WRITE);
+            }
+
+            if (wqe->type == RDMA_OP_WRITE_IMM)
+            {
+              fs->pending_rq_state = RDMA_RQ_PENDING_IMM;
+              fs->pending_rq_pos = rq_head;
+              fs->pending_rq_off = 0;
+              fs->pending_rq_len = sizeof(beui32_t);
+            }
+            else
+            {
+              cq_bump |= fast_rdmarq_data(fs, wqe, &rq_head);
+            }
           }
           else
           {
@@ -277,65 +895,137 @@ int fast_rdmarq_bump(struct dataplane_context* ctx,
         }
         else
         {
-            fprintf(stderr, "%s():%d Invalid request type\n", __func__, __LINE__);
+          fprintf(stderr, "%s():%d Invalid request type\n", __func__, __LINE__);
           abort();
         }
       }
     }
   }
 
+  if (UNLIKELY(fs->pending_rq_state == RDMA_RQ_PENDING_FULL))
+    fast_rdma_rx_hold(fs, buf, rx_bump);
+
   fs->rq_head = rq_head;
   if (cq_bump)
-    arx_rdma_cache_add(ctx, fs->db_id, fs->opaque, fs->wq_tail, fs->cq_head);
+    arx_rdma_cache_add(ctx, fs->db_id, fs->opaque, fs->wq_tail, fs->cq_head,
+        fs->rcv_tail);
 
   return 0;
 }
 
+/* Hold the len unparsed stream bytes behind a stalled request in the rx
+ * buffer, bytes still in the packet are copied there first */
+static inline void fast_rdma_rx_hold(struct flextcp_pl_flowst* fs,
+      const uint8_t* buf, uint32_t len)
+{
+  uint64_t rxbuf_base = (fs->rx_base_sp & FLEXNIC_PL_FLOWST_RX_MASK);
+  uint32_t pos = fs->rx_next_pos, part;
+
+  if (buf != NULL && len > 0)
+  {
+    part = MIN(len, fs->rx_len - pos);
+    dma_write(rxbuf_base + pos, part, buf);
+    if (part < len)
+      dma_write(rxbuf_base, len - part, buf + part);
+
+    pos += len;
+    if (pos >= fs->rx_len)
+      pos -= fs->rx_len;
+    fs->rx_next_pos = pos;
+    fs->rx_avail -= len;
+  }
+  fs->pending_rq_len = len;
+}
+
 static inline void arx_rdma_cache_add(struct dataplane_context* ctx,
-      uint16_t ctx_id, uint64_t opaque, uint32_t wq_tail, uint32_t cq_head)
+      uint16_t ctx_id, uint64_t opaque, uint32_t wq_tail, uint32_t cq_head,
+      uint32_t rcv_tail)
 {
-  uint16_t id = ctx->arx_num++;
+  uint16_t id;
 
-  ctx->arx_ctx[id] = ctx_id;
-  ctx->arx_cache[id].type = FLEXTCP_PL_ARX_RDMAUPDATE;
-  ctx->arx_cache[id].msg.rdmaupdate.opaque = opaque;
+  /* queue positions are absolute, a merged entry just takes the latest */
+  id = arx_cache_slot(ctx, ctx_id, opaque);
   ctx->arx_cache[id].msg.rdmaupdate.wq_tail = wq_tail;
   ctx->arx_cache[id].msg.rdmaupdate.cq_head = cq_head;
+  ctx->arx_cache[id].msg.rdmaupdate.rcv_tail = rcv_tail;
 }
 
-static inline void fast_rdmacq_bump(struct flextcp_pl_flowst* fl,
-      uint32_t id, uint8_t status)
+/**
+ * Locate the WQE a response belongs to, WQEs failed while being transmitted
+ * still get one. Responses arrive in request order, so WQEs still awaiting a
+ * response ahead of the matching one never get theirs and fail. Returns -1 if
+ * no WQE awaits a response with this id.
+ */
+static inline int fast_rdmacq_find(struct flextcp_pl_flowst* fl,
+      uint32_t id, uint32_t* wqe_pos)
 {
-  uint32_t cq_head = fl->cq_head;
-  uint32_t wq_tail = fl->wq_tail;
-  uint32_t wq_len = fl->wq_len;
+  struct rdma_wqe* wqe;
+  uint32_t pos;
 
-  while (cq_head != wq_tail)
+  for (pos = fl->cq_head; pos != fl->wq_tail; pos = rdma_qnext(fl, pos))
   {
-    struct rdma_wqe* wqe = dma_pointer(fl->wq_base + cq_head,
-                                        sizeof(struct rdma_wqe));
-    if (wqe->status == RDMA_RESP_PENDING)
-    {
-      if (wqe->id != id)
-      {
-        fprintf(stderr, "%s():%d Invalid response received=%u expected=%u\n",
-            __func__, __LINE__, wqe->id, id);
-        abort();
-      }
-
-      wqe->status = status;
-      cq_head += sizeof(struct rdma_wqe);
-      if (cq_head >= wq_len)
-        cq_head -= wq_len;
+    wqe = dma_pointer(fl->wq_base + pos, sizeof(struct rdma_wqe));
+    if ((wqe->status == RDMA_RESP_PENDING
+          || wqe->status == RDMA_OUT_OF_BOUNDS) && wqe->id == id)
       break;
+  }
+  if (UNLIKELY(pos == fl->wq_tail))
+  {
+    fl->cnt_rx_resp_errs++;
+    return -1;
+  }
+  *wqe_pos = pos;
+
+  for (pos = fl->cq_head; pos != *wqe_pos; pos = rdma_qnext(fl, pos))
+  {
+    wqe = dma_pointer(fl->wq_base + pos, sizeof(struct rdma_wqe));
+    if (UNLIKELY(wqe->status == RDMA_RESP_PENDING))
+    {
+      wqe->status = RDMA_CONN_FAILURE;
+      fl->cnt_rx_resp_errs++;
     }
+  }
+  return 0;
+}
 
-    cq_head += sizeof(struct rdma_wqe);
-    if (cq_head >= wq_len)
-      cq_head -= wq_len;
+/**
+ * Complete all WQEs up to and including the one at wqe_pos, followed by the
+ * WQEs behind it that failed validation and were never transmitted.
+ *
+ * Returns whether the application needs to be notified: unsignaled WQEs
+ * that succeeded are only reported with the next signaled completion, any
+ * failed WQE among the completed ones is reported right away.
+ */
+static inline uint8_t fast_rdmacq_bump(struct flextcp_pl_flowst* fl,
+      uint32_t wqe_pos)
+{
+  struct rdma_wqe* wqe;
+  uint32_t pos = fl->cq_head;
+  uint8_t notify = 0;
+
+  while (1)
+  {
+    wqe = dma_pointer(fl->wq_base + pos, sizeof(struct rdma_wqe));
+    if (wqe->status != RDMA_SUCCESS)
+      notify = 1;
+    if (pos == wqe_pos)
+      break;
+    pos = rdma_qnext(fl, pos);
   }
+  if ((wqe->flags & RDMA_WQE_SIGNALED) != 0)
+    notify = 1;
+
+  fl->cq_head = rdma_qnext(fl, wqe_pos);
+  while (fl->cq_head != fl->wq_tail)
+  {
+    wqe = dma_pointer(fl->wq_base + fl->cq_head, sizeof(struct rdma_wqe));
+    if (wqe->status != RDMA_OUT_OF_BOUNDS)
+      break;
 
-  fl->cq_head = cq_head;
+    fl->cq_head = rdma_qnext(fl, fl->cq_head);
+    notify = 1;
+  }
+  return notify;
 }
 
 static inline void fast_rdma_rxbuf_copy(struct flextcp_pl_flowst* fl,
@@ -368,118 +1058,321 @@ static inline void fast_rdma_rxbuf_copy(struct flextcp_pl_flowst* fl,
   fl->rx_avail += len;
 }
 
+/**
+ * Operation type of the WQE at offset pos is known and its local data lies
+ * within the memory region selected by its lkey. Atomics carry their
+ * operands in the extension slot and return the original value to the word
+ * at loff, only writes and sends gather their payload from an SGE list or
+ * carry it inline.
+ */
+static inline int rdma_wqe_valid(const struct flextcp_pl_flowst* fl,
+      const struct rdma_wqe* wqe, uint32_t pos)
+{
+  const struct rdma_sge* sge;
+  uint64_t len = 0;
+  uint32_t i, mr_len;
+
+  switch (wqe->type)
+  {
+    case RDMA_OP_READ:
+    case RDMA_OP_WRITE:
+    case RDMA_OP_SEND:
+    case RDMA_OP_WRITE_IMM:
+      break;
+    case RDMA_OP_FETCH_ADD:
+    case RDMA_OP_CMP_SWAP:
+      if (wqe->len != rdma_atomic_len(wqe->type)
+          || (wqe->flags & (RDMA_WQE_SGL | RDMA_WQE_INLINE)) != 0)
+        return 0;
+      rdma_mr(fl, wqe->lkey, &mr_len);
+      return (uint64_t) wqe->loff + sizeof(uint64_t) <= mr_len;
+    default:
+      return 0;
+  }
+
+  rdma_mr(fl, wqe->lkey, &mr_len);
+  if ((wqe->flags & (RDMA_WQE_SGL | RDMA_WQE_INLINE)) == 0)
+    return (uint64_t) wqe->loff + wqe->len <= mr_len;
+
+  if ((wqe->type != RDMA_OP_WRITE && wqe->type != RDMA_OP_SEND
+        && wqe->type != RDMA_OP_WRITE_IMM)
+      || (wqe->flags & (RDMA_WQE_SGL | RDMA_WQE_INLINE)) ==
+        (RDMA_WQE_SGL | RDMA_WQE_INLINE))
+    return 0;
+
+  if ((wqe->flags & RDMA_WQE_INLINE) != 0)
+    return wqe->len <= RDMA_MAX_INLINE;
+
+  if (wqe->loff == 0 || wqe->loff > RDMA_MAX_SGE)
+    return 0;
+
+  sge = dma_pointer(rdma_wqe_ext(fl, pos), RDMA_WQE_EXT_LEN);
+  for (i = 0; i < wqe->loff; i++)
+  {
+    if ((uint64_t) sge[i].loff + sge[i].len > mr_len)
+      return 0;
+    len += sge[i].len;
+  }
+  return len == wqe->len;
+}
+
 void fast_rdma_poll(struct dataplane_context* ctx,
       struct flextcp_pl_flowst* fl)
 {
-  uint32_t wq_head, wq_tail, rq_head, rq_tail, tx_seq;
-  uint32_t free_txbuf_len, ret, is_rqe;
+  uint32_t wq_head, wq_tail, rq_head, rq_tail;
   struct rdma_wqe* wqe;
+  uint8_t cq_bump = 0;
 
   wq_head = fl->wq_head;
   wq_tail = fl->wq_tail;
   rq_head = fl->rq_head;
   rq_tail = fl->rq_tail;
-  free_txbuf_len = fl->tx_len - fl->tx_avail - fl->tx_sent;
 
-  // there is something on going tx
-  if (fl->wqe_tx_seq > 0)
-  {
-    is_rqe = 0;
-    tx_seq = fl->wqe_tx_seq;
-  }
-  // there is something on going rx
-  else if (fl->rqe_tx_seq > 0)
-  {
-    is_rqe = 1;
-    tx_seq = fl->rqe_tx_seq;
-  }
-  else
+  /* Queue responses for received requests */
+  while (rq_tail != rq_head)
   {
-    is_rqe = 0;
-    tx_seq = 0;
+    if (rdma_txlog_add(fl, rq_tail | RDMA_TXLOG_RQE) != 0)
+      goto out;
+
+    wqe = dma_pointer(fl->rq_base + rq_tail, sizeof(struct rdma_wqe));
+    fl->tx_avail += rdma_msg_len(wqe, 1);
+#ifdef FLEXNIC_RDMA_LATENCY
+    rdma_lat_add(rdma_lat, RDMA_LAT_RQ_PLACE, *rdma_rqe_ts(fl, rq_tail),
+        util_rdtsc());
+#endif
+    rq_tail = rdma_qnext(fl, rq_tail);
   }
 
-  while (free_txbuf_len > 0)
+  /* Queue new requests */
+  while (wq_tail != wq_head)
   {
-    // nothing in queue
-    if (rq_head == rq_tail && wq_head == wq_tail)
-      break;
+    wqe = dma_pointer(fl->wq_base + wq_tail, sizeof(struct rdma_wqe));
 
-    // nothing to tx then switch to rx
-    if (!is_rqe && wq_head == wq_tail)
+    if (UNLIKELY(!rdma_wqe_valid(fl, wqe, wq_tail)))
     {
-      is_rqe = 1;
-      continue;
+      /* Never transmitted, completes once all WQEs before it did. If some
+       * are still outstanding, fast_rdmacq_bump() picks it up. */
+      wqe->status = RDMA_OUT_OF_BOUNDS;
+      if (fl->cq_head == wq_tail)
+      {
+        fl->cq_head = rdma_qnext(fl, wq_tail);
+        cq_bump = 1;
+      }
     }
-
-    // nothing to rx then switch to tx
-    if (is_rqe && rq_head == rq_tail)
+    else
     {
-      is_rqe = 0;
-      continue;
+      if (rdma_txlog_add(fl, wq_tail) != 0)
+        break;
+
+      wqe->status = RDMA_TX_PENDING;
+      fl->tx_avail += rdma_msg_len(wqe, 0);
+#ifdef FLEXNIC_RDMA_LATENCY
+      struct rdma_wqe_ts* ts = rdma_wqe_ts(fl, wq_tail);
+      ts->bump = util_rdtsc();
+      rdma_lat_add(rdma_lat, RDMA_LAT_POST_BUMP, ts->post, ts->bump);
+#endif
     }
 
-    // handle tx
-    if (!is_rqe)
+    wq_tail = rdma_qnext(fl, wq_tail);
+  }
+
+out:
+  fl->wq_tail = wq_tail;
+  fl->rq_tail = rq_tail;
+
+  if (cq_bump)
+    arx_rdma_cache_add(ctx, fl->db_id, fl->opaque, fl->wq_tail, fl->cq_head,
+        fl->rcv_tail);
+}
+
+/* Payload of a queued message still lies within its memory region. Keys in
+ * use are not released (see nicif_connection_mr()), this guards against
+ * sending memory the region no longer covers. */
+static inline int rdma_msg_valid(const struct flextcp_pl_flowst* fl,
+      const struct rdma_wqe* wqe, uint8_t is_rqe, uint32_t qpos)
+{
+  if (!is_rqe)
+    return rdma_wqe_valid(fl, wqe, qpos);
+  if (wqe->type != RDMA_OP_READ || wqe->status != RDMA_SUCCESS)
+    return 1;
+  return rdma_mr_contains(fl, wqe->lkey, wqe->loff, wqe->len);
+}
+
+/* Without buf the payload bytes are only skipped, headers must not be. */
+void fast_rdma_txfill(struct flextcp_pl_flowst* fl, uint8_t* buf,
+      uint16_t len)
+{
+  struct rdma_wqe* wqe;
+  uint8_t hdr[sizeof(struct rdma_hdr) + sizeof(beui32_t)];
+  uint32_t msg_len, msg_off, hdr_len, part, qpos;
+  uint8_t is_rqe, valid;
+
+  /* Messages are streamed back to back and may span several segments, the
+   * offset into a partially sent message is kept in txb_pos_sent. */
+  msg_off = fl->txb_pos_sent;
+  while (len > 0)
+  {
+    assert(fl->txb_pos != fl->txb_head);
+    wqe = rdma_txlog_entry(fl, fl->txb_pos, &is_rqe, &qpos);
+    msg_len = rdma_msg_len(wqe, is_rqe);
+    hdr_len = rdma_msg_hdr_len(wqe, is_rqe);
+    valid = rdma_msg_valid(fl, wqe, is_rqe, qpos);
+
+#ifdef FLEXNIC_RDMA_LATENCY
+    if (msg_off == 0 && !is_rqe)
     {
-      wqe = dma_pointer(fl->wq_base + wq_tail, sizeof(struct rdma_wqe));
+      /* Retransmissions keep the first transmission time */
+      struct rdma_wqe_ts* ts = rdma_wqe_ts(fl, qpos);
+      if (ts->tx == 0)
+      {
+        ts->tx = util_rdtsc();
+        rdma_lat_add(rdma_lat, RDMA_LAT_BUMP_TX, ts->bump, ts->tx);
+      }
+    }
+#endif
 
-      /* New WQE to be processed */
-      if (UNLIKELY(wqe->loff + wqe->len > fl->mr_len))
+    if (msg_off < hdr_len)
+    {
+      assert(buf != NULL);
+      rdma_msg_hdr(wqe, is_rqe, msg_len, hdr);
+      if (UNLIKELY(!valid))
       {
-        wqe->status = RDMA_OUT_OF_BOUNDS;
-        goto NEXT_WQE;
+        /* Zeros are sent in place of the payload, the operation fails on
+         * both ends: requests carry a key no peer registers */
+        if (is_rqe)
+        {
+          ((struct rdma_hdr*) hdr)->status = RDMA_OUT_OF_BOUNDS;
+        }
+        else
+        {
+          ((struct rdma_hdr*) hdr)->key = UINT8_MAX;
+          wqe->status = RDMA_OUT_OF_BOUNDS;
+        }
       }
+      part = MIN(len, hdr_len - msg_off);
+      memcpy(buf, hdr + msg_off, part);
+      buf += part;
+      len -= part;
+      msg_off += part;
     }
-    // handle rx
-    else
+
+    /* Request payload comes from the local offset, SGE list or the WQE
+     * itself, read response payload from the offset requested by the peer. */
+    while (len > 0 && msg_off < msg_len)
     {
-      wqe = dma_pointer(fl->rq_base + rq_tail, sizeof(struct rdma_wqe));
+      uint64_t addr = rdma_msg_payload(fl, wqe, is_rqe, qpos,
+          msg_off - hdr_len, &part);
+      part = MIN(len, part);
+      if (buf != NULL)
+      {
+        if (LIKELY(valid))
+          dma_read(addr, part, buf);
+        else
+          memset(buf, 0, part);
+        buf += part;
+      }
+      len -= part;
+      msg_off += part;
     }
 
-    /* New request/response */
-    if (tx_seq == 0)
+    if (msg_off == msg_len)
     {
-      if (free_txbuf_len < sizeof(struct rdma_hdr))
-        break;
+      if (!is_rqe && wqe->status == RDMA_TX_PENDING)
+        wqe->status = RDMA_RESP_PENDING;
+      fl->txb_pos = rdma_txlog_next(fl, fl->txb_pos);
+      msg_off = 0;
     }
+  }
+  fl->txb_pos_sent = msg_off;
+}
+
+uint16_t fast_rdma_txzc(struct flextcp_pl_flowst* fl, uint16_t len,
+      uint16_t min_len)
+{
+  struct rdma_wqe* wqe;
+  uint32_t msg_off, hdr_len, hdr_left, qpos, contig;
+  uint8_t is_rqe;
+
+  if (fl->txb_pos == fl->txb_head)
+    return 0;
+
+  wqe = rdma_txlog_entry(fl, fl->txb_pos, &is_rqe, &qpos);
+  msg_off = fl->txb_pos_sent;
+  hdr_len = rdma_msg_hdr_len(wqe, is_rqe);
+  hdr_left = (msg_off < hdr_len ? hdr_len - msg_off : 0);
 
-//    fl->tx_avail += sizeof(struct rdma_hdr) + wqe->len; //PROTO
-    fl->tx_avail += wqe_txavail(fl);
-    fl->txb_head += sizeof(struct rdma_wqe); //PROTO
+  /* Only a payload run ending the segment within the same message and the
+   * same contiguous part of the memory region */
+  if (msg_off + len > rdma_msg_len(wqe, is_rqe) || len < hdr_left + min_len
+      || UNLIKELY(!rdma_msg_valid(fl, wqe, is_rqe, qpos)))
+    return 0;
+  rdma_msg_payload(fl, wqe, is_rqe, qpos, msg_off + hdr_left - hdr_len,
+      &contig);
+  if (len - hdr_left > contig)
+    return 0;
 
-/* TODO: handle wqe that needs multiple packets
-    ret = fast_rdmawqe_tx(fl, wqe, !is_rqe);
-    if (ret > 0)
+  return len - hdr_left;
+}
+
+/* Skip len payload bytes sent zero-copy from the returned address, *refs is
+ * set to the zero-copy reference count of their memory region */
+uint64_t fast_rdma_txskip(struct flextcp_pl_flowst* fl, uint16_t len,
+      uint32_t** refs)
+{
+  struct rdma_wqe* wqe;
+  uint32_t qpos, contig;
+  uint8_t is_rqe;
+  uint64_t addr;
+
+  wqe = rdma_txlog_entry(fl, fl->txb_pos, &is_rqe, &qpos);
+  assert(fl->txb_pos_sent >= rdma_msg_hdr_len(wqe, is_rqe));
+  addr = rdma_msg_payload(fl, wqe, is_rqe, qpos,
+      fl->txb_pos_sent - rdma_msg_hdr_len(wqe, is_rqe), &contig);
+  assert(contig >= len);
+  *refs = &fp_state->flow_mrs[fl - fp_state->flowst][wqe->lkey].zc_refs;
+
+  fast_rdma_txfill(fl, NULL, len);
+  return addr;
+}
+
+void fast_rdma_txack(struct flextcp_pl_flowst* fl, uint32_t acked)
+{
+  struct rdma_wqe* wqe;
+  uint32_t msg_len, part, qpos;
+  uint8_t is_rqe, at_pos;
+
+  while (acked > 0 && fl->txb_tail != fl->txb_head)
+  {
+    wqe = rdma_txlog_entry(fl, fl->txb_tail, &is_rqe, &qpos);
+    msg_len = rdma_msg_len(wqe, is_rqe);
+    at_pos = (fl->txb_tail == fl->txb_pos);
+
+    part = MIN(acked, msg_len - fl->txb_tail_acked);
+    fl->txb_tail_acked += part;
+    acked -= part;
+    if (fl->txb_tail_acked < msg_len)
     {
-      tx_seq = wqe->len - ret;
+      if (at_pos && fl->txb_pos_sent < fl->txb_tail_acked)
+        fl->txb_pos_sent = fl->txb_tail_acked;
       break;
     }
-*/
 
-NEXT_WQE:
-    // update wq/rq tail
+    /* Message fully acknowledged, a response frees its RQ entry */
     if (is_rqe)
+      fl->rqe_ack_pos = rdma_qnext(fl, qpos);
+
+    fl->txb_tail = rdma_txlog_next(fl, fl->txb_tail);
+    fl->txb_tail_acked = 0;
+    if (at_pos)
     {
-      rq_tail += sizeof(struct rdma_wqe);
-      if (rq_tail >= fl->wq_len)
-        rq_tail -= fl->wq_len;
-    }
-    else
-    {
-      wq_tail += sizeof(struct rdma_wqe);
-      if (wq_tail >= fl->wq_len)
-        wq_tail -= fl->wq_len;
+      fl->txb_pos = fl->txb_tail;
+      fl->txb_pos_sent = 0;
     }
-    tx_seq = 0;
-    is_rqe = (is_rqe ? 0 : 1);
-    free_txbuf_len = fl->tx_len - fl->tx_avail - fl->tx_sent;
   }
+}
 
-  fl->wq_tail = wq_tail;
-  fl->rq_tail = rq_tail;
-  if (is_rqe)
-    fl->rqe_tx_seq = tx_seq;
-  else
-    fl->wqe_tx_seq = tx_seq;
+void fast_rdma_txrewind(struct flextcp_pl_flowst* fl)
+{
+  fl->txb_pos = fl->txb_tail;
+  fl->txb_pos_sent = fl->txb_tail_acked;
 }
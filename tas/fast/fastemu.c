@@ -71,8 +71,6 @@ static inline void tx_flush(struct dataplane_context *ctx);
 static inline void tx_send(struct dataplane_context *ctx,
     struct network_buf_handle *nbh, uint16_t off, uint16_t len);
 
-static void arx_cache_flush(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
-
 int dataplane_init(void)
 {
   if (FLEXNIC_INTERNAL_MEM_SIZE < sizeof(struct flextcp_pl_mem)) {
@@ -171,6 +169,12 @@ void dataplane_loop(struct dataplane_context *ctx)
     STATS_TSADD(ctx, cyc_qs, qs - qm);
     n += poll_kernel(ctx, ts);
 
+    /* retry app notifications deferred for lack of queue space, only
+     * delivered ones are progress, a stalled app must not keep us busy */
+    if (UNLIKELY(ctx->arx_ovf_num > 0 || ctx->arx_num > 0)) {
+      n += arx_cache_flush(ctx, ts);
+    }
+
     /* flush transmit buffer */
     tx_flush(ctx);
 
@@ -189,6 +193,10 @@ void dataplane_loop(struct dataplane_context *ctx)
 	// Only if device running
 	if(r == 0) {
 	  uint32_t timeout_us = qman_next_ts(&ctx->qman, ts);
+	  /* apps do not kick us when they free rx queue space, so come back
+	   * for deferred notifications */
+	  if (ctx->arx_ovf_num > 0 || ctx->arx_num > 0)
+	    timeout_us = MIN(timeout_us, POLL_CYCLE);
 	  /* fprintf(stderr, "[%u] fastemu idle - timeout %d ms\n", ctx->core, */
 	  /* 	  timeout_us == (uint32_t)-1 ? -1 : timeout_us / 1000); */
 	  struct rte_epoll_event event[2];
@@ -260,9 +268,13 @@ static unsigned poll_rx(struct dataplane_context *ctx, uint32_t ts)
   struct tcp_opts tcpopts[BATCH_SIZE];
   struct network_buf_handle *bhs[BATCH_SIZE];
 
-  n = BATCH_SIZE;
+  /* every packet may need an arx cache entry, some can be left over from
+   * earlier batches if applications fell behind */
+  n = BATCH_SIZE - ctx->arx_num;
   if (TXBUF_SIZE - ctx->tx_num < n)
     n = TXBUF_SIZE - ctx->tx_num;
+  if (UNLIKELY(n == 0))
+    return 0;
 
   STATS_ADD(ctx, rx_poll, 1);
 
@@ -588,33 +600,3 @@ static void poll_scale(struct dataplane_context *ctx)
   fp_scale_to = 0;
 }
 
-static void arx_cache_flush(struct dataplane_context *ctx, uint32_t ts)
-{
-  uint16_t i;
-  struct flextcp_pl_appctx *actx;
-  struct flextcp_pl_arx *parx[BATCH_SIZE];
-
-  for (i = 0; i < ctx->arx_num; i++) {
-    actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[i]];
-    if (fast_actx_rxq_alloc(ctx, actx, &parx[i]) != 0) {
-      /* TODO: how do we handle this? */
-      fprintf(stderr, "arx_cache_flush: no space in app rx queue\n");
-      abort();
-    }
-  }
-
-  for (i = 0; i < ctx->arx_num; i++) {
-    rte_prefetch0(parx[i]);
-  }
-
-  for (i = 0; i < ctx->arx_num; i++) {
-    *parx[i] = ctx->arx_cache[i];
-  }
-
-  for (i = 0; i < ctx->arx_num; i++) {
-    actx = &fp_state->appctx[ctx->id][ctx->arx_ctx[i]];
-    actx_kick(actx, ts);
-  }
-
-  ctx->arx_num = 0;
-}
@@ -47,6 +47,7 @@ int fast_appctx_poll(struct dataplane_context *ctx, uint32_t id,
 int fast_actx_rxq_alloc(struct dataplane_context *ctx,
     struct flextcp_pl_appctx *actx, struct flextcp_pl_arx **arx);
 int fast_actx_rxq_probe(struct dataplane_context *ctx, uint32_t id);
+unsigned arx_cache_flush(struct dataplane_context *ctx, uint32_t ts);
 
 /* fast_flows.c */
 void fast_flows_qman_pf(struct dataplane_context *ctx, uint32_t *queues,
@@ -78,16 +79,30 @@ void fast_flows_retransmit(struct dataplane_context *ctx, uint32_t flow_id);
 /* fast_rdma.c */
 int fast_rdmawq_bump(struct dataplane_context *ctx, uint32_t flow_id,
     uint32_t new_wq_head, uint32_t new_cq_tail);
+int fast_rdmarcv_bump(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t new_rcv_head);
 int fast_rdmarq_bump(struct dataplane_context* ctx,
     struct flextcp_pl_flowst* fs, uint32_t prev_rx_head, uint32_t rx_bump);
+int fast_rdmarq_place(struct dataplane_context* ctx,
+    struct flextcp_pl_flowst* fs, const uint8_t* payload, uint32_t len);
+uint8_t fast_rdmarq_stalled(const struct flextcp_pl_flowst* fs);
 void fast_rdma_poll(struct dataplane_context* ctx,
     struct flextcp_pl_flowst* fl);
+void fast_rdma_txfill(struct flextcp_pl_flowst* fl, uint8_t* buf,
+    uint16_t len);
+uint16_t fast_rdma_txzc(struct flextcp_pl_flowst* fl, uint16_t len,
+    uint16_t min_len);
+uint64_t fast_rdma_txskip(struct flextcp_pl_flowst* fl, uint16_t len,
+    uint32_t** refs);
+void fast_rdma_txack(struct flextcp_pl_flowst* fl, uint32_t acked);
+void fast_rdma_txrewind(struct flextcp_pl_flowst* fl);
 
 /*****************************************************************************/
 /* Helpers */
 
-static inline void tx_send(struct dataplane_context *ctx,
-    struct network_buf_handle *nbh, uint16_t off, uint16_t len)
+/** Queue a packet whose offset and length are already set */
+static inline void tx_enqueue(struct dataplane_context *ctx,
+    struct network_buf_handle *nbh)
 {
   uint32_t i = ctx->tx_num;
 
@@ -96,12 +111,18 @@ static inline void tx_send(struct dataplane_context *ctx,
     abort();
   }
 
-  network_buf_setoff(nbh, off);
-  network_buf_setlen(nbh, len);
   ctx->tx_handles[i] = nbh;
   ctx->tx_num = i + 1;
 }
 
+static inline void tx_send(struct dataplane_context *ctx,
+    struct network_buf_handle *nbh, uint16_t off, uint16_t len)
+{
+  network_buf_setoff(nbh, off);
+  network_buf_setlen(nbh, len);
+  tx_enqueue(ctx, nbh);
+}
+
 static inline uint16_t tx_xsum_enable(struct network_buf_handle *nbh,
     struct ip_hdr *iph, beui32_t ip_s, beui32_t ip_d, uint16_t l3_paylen)
 {
@@ -109,19 +130,42 @@ static inline uint16_t tx_xsum_enable(struct network_buf_handle *nbh,
       ip_s, ip_d, IP_PROTO_TCP, l3_paylen);
 }
 
-static inline void arx_cache_add(struct dataplane_context *ctx, uint16_t ctx_id,
-    uint64_t opaque, uint32_t rx_bump, uint32_t rx_pos, uint32_t tx_bump,
-    uint16_t type_flags)
+/** Index of the entry for a flow in an arx array, num if there is none. */
+static inline uint16_t arx_find(const struct flextcp_pl_arx *arx,
+    const uint16_t *arx_ctx, uint16_t num, uint16_t ctx_id, uint64_t opaque)
 {
-  uint16_t id = ctx->arx_num++;
+  uint16_t id;
+
+  /* arrays are small, a linear scan is cheaper than anything smarter */
+  for (id = 0; id < num; id++) {
+    if (arx_ctx[id] == ctx_id && arx[id].msg.rdmaupdate.opaque == opaque) {
+      break;
+    }
+  }
+  return id;
+}
+
+/**
+ * Find the arx cache entry of this batch for a flow, identified by its
+ * application context and opaque, or allocate a new one. Updates for the
+ * same flow are merged so the application only sees the latest state once
+ * per batch. The RDMA emulation does not send connection updates to the
+ * application (see fast_flows_packet()), so every entry is an RDMA update.
+ */
+static inline uint16_t arx_cache_slot(struct dataplane_context *ctx,
+    uint16_t ctx_id, uint64_t opaque)
+{
+  uint16_t id;
+
+  id = arx_find(ctx->arx_cache, ctx->arx_ctx, ctx->arx_num, ctx_id, opaque);
+  if (id < ctx->arx_num)
+    return id;
 
+  ctx->arx_num++;
   ctx->arx_ctx[id] = ctx_id;
-  ctx->arx_cache[id].type = type_flags & 0xff;
-  ctx->arx_cache[id].msg.connupdate.opaque = opaque;
-  ctx->arx_cache[id].msg.connupdate.rx_bump = rx_bump;
-  ctx->arx_cache[id].msg.connupdate.rx_pos = rx_pos;
-  ctx->arx_cache[id].msg.connupdate.tx_bump = tx_bump;
-  ctx->arx_cache[id].msg.connupdate.flags = type_flags >> 8;
+  ctx->arx_cache[id].type = FLEXTCP_PL_ARX_RDMAUPDATE;
+  ctx->arx_cache[id].msg.rdmaupdate.opaque = opaque;
+  return id;
 }
 
 static inline void actx_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us)
@@ -46,6 +46,10 @@
     int trace_event2(uint16_t type, uint16_t len_1, const void *buf_1,
         uint16_t len_2, const void *buf_2);
 #endif
+#include <tas_rdma_lat.h>
+#ifdef FLEXNIC_RDMA_LATENCY
+    int rdma_lat_thread_init(uint16_t id);
+#endif
 //#define DATAPLANE_STATS
 
 extern int exited;
@@ -24,8 +24,11 @@
 
 #include <stdio.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <rte_config.h>
+#include <rte_eal.h>
+#include <rte_memory.h>
 #include <rte_memcpy.h>
 #include <rte_malloc.h>
 #include <rte_lcore.h>
@@ -46,6 +49,7 @@
 #define MBUF_SIZE (BUFFER_SIZE + sizeof(struct rte_mbuf) + RTE_PKTMBUF_HEADROOM)
 #define RX_DESCRIPTORS 256
 #define TX_DESCRIPTORS 128
+#define SHM_HUGEPAGE_SIZE (2 * 1024 * 1024)
 
 uint8_t net_port_id = 0;
 static struct rte_eth_conf port_conf = {
@@ -85,6 +89,7 @@ static struct rte_eth_rss_reta_entry64 *rss_reta = NULL;
 static uint16_t *rss_core_buckets = NULL;
 
 static struct rte_mempool *mempool_alloc(void);
+static int shm_dma_register(void);
 static int reta_setup(void);
 static int reta_mlx5_resize(void);
 static rte_spinlock_t initlock = RTE_SPINLOCK_INITIALIZER;
@@ -149,6 +154,17 @@ int network_init(unsigned n_threads)
     port_conf.txmode.offloads =
       DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
 
+  /* zero-copy transmit chains shared memory segments to packets */
+  if (config.fp_rdma_zerocopy) {
+    if (shm_dma_register() == 0) {
+      port_conf.txmode.offloads |= DEV_TX_OFFLOAD_MULTI_SEGS;
+    } else {
+      fprintf(stderr, "Warning: RDMA zero-copy transmit not supported, "
+          "disabling.\n");
+      config.fp_rdma_zerocopy = 0;
+    }
+  }
+
   /* disable rx interrupts if requested */
   if (!config.fp_interrupts)
     port_conf.intr_conf.rxq = 0;
@@ -178,6 +194,8 @@ int network_init(unsigned n_threads)
   if (config.fp_xsumoffload)
     eth_devinfo.default_txconf.offloads =
       DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
+  if (config.fp_rdma_zerocopy)
+    eth_devinfo.default_txconf.offloads |= DEV_TX_OFFLOAD_MULTI_SEGS;
 
   memcpy(&tas_info->mac_address, &eth_addr, 6);
 
@@ -317,6 +335,51 @@ int network_rx_interrupt_ctl(struct network_thread *t, int turnon)
   }
 }
 
+#ifdef NETWORK_EXTBUF
+/* register shared memory for DMA so payloads can be transmitted from it */
+static int shm_dma_register(void)
+{
+  size_t pgsz = (config.fp_hugepages ? SHM_HUGEPAGE_SIZE :
+      sysconf(_SC_PAGESIZE));
+
+  /* checksums are computed before payload is attached */
+  if (!config.fp_xsumoffload) {
+    fprintf(stderr, "shm_dma_register: requires checksum offload\n");
+    return -1;
+  }
+  if (rte_eal_iova_mode() != RTE_IOVA_VA) {
+    fprintf(stderr, "shm_dma_register: requires IOVA as VA mode\n");
+    return -1;
+  }
+  if ((eth_devinfo.tx_offload_capa & DEV_TX_OFFLOAD_MULTI_SEGS) == 0) {
+    fprintf(stderr, "shm_dma_register: NIC does not support multi segment "
+        "transmit\n");
+    return -1;
+  }
+
+  if (rte_extmem_register(tas_shm, config.shm_len, NULL, 0, pgsz) != 0) {
+    fprintf(stderr, "shm_dma_register: rte_extmem_register failed (%d)\n",
+        rte_errno);
+    return -1;
+  }
+  if (rte_dev_dma_map(eth_devinfo.device, tas_shm, (uintptr_t) tas_shm,
+        config.shm_len) != 0)
+  {
+    fprintf(stderr, "shm_dma_register: rte_dev_dma_map failed (%d)\n",
+        rte_errno);
+    rte_extmem_unregister(tas_shm, config.shm_len);
+    return -1;
+  }
+
+  return 0;
+}
+#else
+static int shm_dma_register(void)
+{
+  return -1;
+}
+#endif
+
 static struct rte_mempool *mempool_alloc(void)
 {
   static unsigned pool_id = 0;
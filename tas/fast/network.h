@@ -31,9 +31,15 @@
 #include <rte_ethdev.h>
 #include <rte_mbuf.h>
 #include <rte_ip.h>
+#include <rte_version.h>
 
 #include <fastpath.h>
 
+/* attaching shared memory to mbufs requires external memory registration */
+#if RTE_VER_YEAR > 19 || (RTE_VER_YEAR == 19 && RTE_VER_MONTH >= 5)
+#define NETWORK_EXTBUF 1
+#endif
+
 struct network_buf_handle;
 
 extern uint8_t net_port_id;
@@ -145,6 +151,63 @@ static inline int network_buf_alloc(struct network_thread *t, unsigned num,
   return i;
 }
 
+/** allocate buffer to be attached to shared memory with
+ * network_buf_chain_ext() */
+static inline struct network_buf_handle *network_buf_alloc_ext(
+    struct network_thread *t)
+{
+#ifdef NETWORK_EXTBUF
+  return (struct network_buf_handle *) rte_pktmbuf_alloc(t->pool);
+#else
+  return NULL;
+#endif
+}
+
+#ifdef NETWORK_EXTBUF
+/* segment attached by network_buf_chain_ext() released by the NIC, drop its
+ * reference on the memory region. The region is not released while
+ * references are held (see nicif_connection_mr()). The application may still
+ * write to it once the WQE completed, a retransmission then carries bytes the
+ * peer drops as duplicates of data it already acknowledged. */
+static inline void network_ext_free(void *addr, void *opaque)
+{
+  __sync_fetch_and_sub((uint32_t *) opaque, 1);
+}
+#endif
+
+/** append len bytes at addr in shared memory to the packet in bh, without
+ * copying. Must be called after the length of bh has been set. *refs counts
+ * the segments of the memory region at addr held by the NIC, it is
+ * decremented once ext is released after transmission. */
+static inline void network_buf_chain_ext(struct network_buf_handle *bh,
+    struct network_buf_handle *ext, void *addr, uint16_t len, uint32_t *refs)
+{
+#ifdef NETWORK_EXTBUF
+  struct rte_mbuf *mb = (struct rte_mbuf *) bh;
+  struct rte_mbuf *mb_ext = (struct rte_mbuf *) ext;
+  struct rte_mbuf_ext_shared_info *shinfo;
+
+  /* shared info lives in the otherwise unused data room of ext, its free
+   * callback runs before ext returns to the pool. Shared memory is mapped
+   * with iova == va. */
+  shinfo = rte_pktmbuf_mtod(mb_ext, struct rte_mbuf_ext_shared_info *);
+  shinfo->free_cb = network_ext_free;
+  shinfo->fcb_opaque = refs;
+  rte_mbuf_ext_refcnt_set(shinfo, 1);
+  __sync_fetch_and_add(refs, 1);
+  rte_pktmbuf_attach_extbuf(mb_ext, addr, (rte_iova_t) (uintptr_t) addr, len,
+      shinfo);
+  mb_ext->data_off = 0;
+  mb_ext->pkt_len = mb_ext->data_len = len;
+
+  mb->next = mb_ext;
+  mb->nb_segs = 2;
+  mb->pkt_len += len;
+#else
+  abort();
+#endif
+}
+
 static inline void network_free(unsigned num, struct network_buf_handle **bufs)
 {
   unsigned i;
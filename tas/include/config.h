@@ -37,6 +37,8 @@ enum config_cc_algorithm {
   CONFIG_CC_TIMELY,
   /** Constant connection rate */
   CONFIG_CC_CONST_RATE,
+  /** Rate-based DCTCP accounting for RDMA read responses */
+  CONFIG_CC_RDMA_RATE,
 };
 
 /** Struct containing the parsed configuration parameters */
@@ -59,6 +61,12 @@ struct configuration {
   uint64_t rdma_mr_len;
   /** RDMA work/completion queue size. */
   uint64_t rdma_wq_len;
+  /** Max RDMA memory region size requested for a connection. */
+  uint64_t rdma_mr_max;
+  /** Max RDMA work/completion queue size requested for a connection. */
+  uint64_t rdma_wq_max;
+  /** RDMA buffer memory an application may allocate, 0 for unlimited. */
+  uint64_t rdma_app_mem;
   /** Initial tcp rtt for cc rate [us]*/
   uint32_t tcp_rtt_init;
   /** Link bandwidth for converting window to rate [gbps] */
@@ -127,6 +135,8 @@ struct configuration {
   uint32_t fp_hugepages;
   /** FP: enable vlan stripping */
   uint32_t fp_vlan_strip;
+  /** FP: transmit RDMA payloads directly from the memory region */
+  uint32_t fp_rdma_zerocopy;
   /** SP: kni interface name */
   char *kni_name;
   /** Ready signal fd */
@@ -36,6 +36,25 @@
 #define BATCH_SIZE 16
 #define BUFCACHE_SIZE 128
 #define TXBUF_SIZE (2 * BATCH_SIZE)
+#define ARX_OVF_SIZE 256
+
+/** Transmit buffer length for the message log of an RDMA flow to hold every
+ * entry of its work and receive queue, wq_len bytes each */
+#define RDMA_TXLOG_LEN(wq_len) \
+  (2 * ((wq_len) / sizeof(struct rdma_wqe)) * sizeof(uint32_t))
+/** Message log entry refers to a response queue entry, else a WQE */
+#define RDMA_TXLOG_RQE (1U << 31)
+
+/** Parsing states of received RDMA messages (pending_rq_state) */
+#define RDMA_RQ_PENDING_PARSE 0x0
+#define RDMA_RQ_PENDING_DATA  0x10
+#define RDMA_RQ_PENDING_RESP  0x20
+#define RDMA_RQ_PENDING_ATOMIC 0x30
+#define RDMA_RQ_PENDING_IMM   0x40
+#define RDMA_RQ_PENDING_SKIP  0x50
+/* Request header kept in pending_rq_buf until a response queue entry is free,
+ * the pending_rq_len stream bytes behind it are held in the rx buffer */
+#define RDMA_RQ_PENDING_FULL  0x60
 
 
 struct network_thread {
@@ -77,6 +96,11 @@ struct dataplane_context {
   uint16_t arx_ctx[BATCH_SIZE];
   uint16_t arx_num;
 
+  /* arx updates deferred because the app rx queue was full */
+  struct flextcp_pl_arx arx_ovf[ARX_OVF_SIZE];
+  uint16_t arx_ovf_ctx[ARX_OVF_SIZE];
+  uint16_t arx_ovf_num;
+
   /********************************************************/
   /* send buffer */
   struct network_buf_handle *tx_handles[TXBUF_SIZE];
@@ -95,6 +119,7 @@ struct dataplane_context {
   uint64_t loadmon_cyc_busy;
 
   uint64_t kernel_drop;
+  uint64_t arx_deferred;
 #ifdef DATAPLANE_STATS
   /********************************************************/
   /* Stats */
@@ -409,6 +409,8 @@ static void uxsocket_accept(void)
   app->closed = false;
   app->conns = NULL;
   app->listeners = NULL;
+  app->shmr_handle = NULL;
+  app->rdma_mem = 0;
   app->id = app_id_next++;
   nbqueue_enq(&ux_to_poll, &app->nqe);
 }
@@ -656,3 +658,21 @@ error_status:
 error_send:
     uxsocket_error(app);
 }
+
+int appif_rdma_charge(struct application *app, uint64_t len)
+{
+  if (config.rdma_app_mem != 0 && app->rdma_mem + len > config.rdma_app_mem) {
+    fprintf(stderr, "appif_rdma_charge: application %u exceeds rdma memory "
+        "limit\n", app->id);
+    return -1;
+  }
+
+  app->rdma_mem += len;
+  return 0;
+}
+
+void appif_rdma_release(struct application *app, uint64_t len)
+{
+  assert(app->rdma_mem >= len);
+  app->rdma_mem -= len;
+}
@@ -77,6 +77,15 @@ struct application {
   struct connection *conns;
   struct listener   *listeners;
 
+  /* RDMA memory region shared by all connections opened or accepted after it
+   * was created, NULL while each connection gets a private one */
+  struct packetmem_handle *shmr_handle;
+  uintptr_t shmr_off;
+  uint32_t shmr_len;
+  /* RDMA buffer memory allocated by the application, bounded by
+   * config.rdma_app_mem */
+  uint64_t rdma_mem;
+
   struct nicif_completion comp;
 
   uint16_t id;
@@ -91,4 +100,22 @@ struct application {
  */
 unsigned appif_ctx_poll(struct application *app, struct app_context *ctx);
 
+/**
+ * Account RDMA buffer memory allocated for an application.
+ *
+ * @param app Application allocating the memory
+ * @param len Number of bytes
+ *
+ * @return 0 on success, <0 if the application would exceed its limit
+ */
+int appif_rdma_charge(struct application *app, uint64_t len);
+
+/**
+ * Return RDMA buffer memory accounted with appif_rdma_charge().
+ *
+ * @param app Application releasing the memory
+ * @param len Number of bytes
+ */
+void appif_rdma_release(struct application *app, uint64_t len);
+
 #endif /* ndef APPIF_H_ */
@@ -27,8 +27,10 @@
  * @file appif_ctx.c
  * @addtogroup tas-sp-appif
  */
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <tas.h>
@@ -47,6 +49,12 @@ static int kin_accept_conn(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
 static int kin_req_scale(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_rdma_mr(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_rdma_share_mr(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_rdma_wq(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
 
 static void appif_ctx_kick(struct app_context *ctx)
 {
@@ -85,11 +93,12 @@ void appif_conn_opened(struct connection *c, int status)
     kout->data.conn_opened.rx_off = c->rx_buf - (uint8_t *) tas_shm;
     kout->data.conn_opened.tx_off = c->tx_buf - (uint8_t *) tas_shm;
     kout->data.conn_opened.mr_off = c->mr_buf - (uint8_t *) tas_shm;
-    kout->data.conn_opened.wq_off = c->wq_buf - (uint8_t *) tas_shm;
+    kout->data.conn_opened.wq_off = (c->wq_buf != NULL ?
+        c->wq_buf - (uint8_t *) tas_shm : 0);
     kout->data.conn_opened.rx_len = c->rx_len;
     kout->data.conn_opened.tx_len = c->tx_len;
     kout->data.conn_opened.mr_len = c->mr_len;
-    kout->data.conn_opened.wq_len = c->wq_len;
+    kout->data.conn_opened.wq_len = (c->wq_buf != NULL ? c->wq_len : 0);
 
     kout->data.conn_opened.seq_rx = c->remote_seq;
     kout->data.conn_opened.seq_tx = c->local_seq;
@@ -206,11 +215,12 @@ void appif_accept_conn(struct connection *c, int status)
     kout->data.accept_connection.rx_off = c->rx_buf - (uint8_t *) tas_shm;
     kout->data.accept_connection.tx_off = c->tx_buf - (uint8_t *) tas_shm;
     kout->data.accept_connection.mr_off = c->mr_buf - (uint8_t *) tas_shm;
-    kout->data.accept_connection.wq_off = c->wq_buf - (uint8_t *) tas_shm;
+    kout->data.accept_connection.wq_off = (c->wq_buf != NULL ?
+        c->wq_buf - (uint8_t *) tas_shm : 0);
     kout->data.accept_connection.rx_len = c->rx_len;
     kout->data.accept_connection.tx_len = c->tx_len;
     kout->data.accept_connection.mr_len = c->mr_len;
-    kout->data.accept_connection.wq_len = c->wq_len;
+    kout->data.accept_connection.wq_len = (c->wq_buf != NULL ? c->wq_len : 0);
 
     kout->data.accept_connection.seq_rx = c->remote_seq;
     kout->data.accept_connection.seq_tx = c->local_seq;
@@ -293,6 +303,23 @@ unsigned appif_ctx_poll(struct application *app, struct app_context *ctx)
       kout_inc += kin_req_scale(app, ctx, kin, kout);
       break;
 
+    case KERNEL_APPOUT_RDMA_REG_MR:
+    case KERNEL_APPOUT_RDMA_DEREG_MR:
+      /* memory region (de)registration request */
+      kout_inc += kin_rdma_mr(app, ctx, kin, kout);
+      break;
+
+    case KERNEL_APPOUT_RDMA_SHARE_MR:
+      /* shared memory region request */
+      kout_inc += kin_rdma_share_mr(app, ctx, kin, kout);
+      break;
+
+    case KERNEL_APPOUT_RDMA_WQ_ATTACH:
+    case KERNEL_APPOUT_RDMA_WQ_DETACH:
+      /* work queue attach/release request */
+      kout_inc += kin_rdma_wq(app, ctx, kin, kout);
+      break;
+
     case KERNEL_APPOUT_LISTEN_CLOSE:
     default:
       fprintf(stderr, "kin_poll: unsupported request type %u\n", kin->type);
@@ -327,7 +354,8 @@ static int kin_conn_open(struct application *app, struct app_context *ctx,
   struct connection *conn;
 
   if (tcp_open(ctx, kin->data.conn_open.opaque, kin->data.conn_open.remote_ip,
-      kin->data.conn_open.remote_port, ctx->doorbell->id, &conn) != 0)
+      kin->data.conn_open.remote_port, ctx->doorbell->id,
+      kin->data.conn_open.wq_len, kin->data.conn_open.mr_len, &conn) != 0)
   {
     fprintf(stderr, "kin_conn_open: tcp_open failed\n");
     goto error;
@@ -489,7 +517,8 @@ static int kin_accept_conn(struct application *app, struct app_context *ctx,
   }
 
   if (tcp_accept(ctx, kin->data.accept_conn.conn_opaque, listen,
-        ctx->doorbell->id) != 0)
+        ctx->doorbell->id, kin->data.accept_conn.wq_len,
+        kin->data.accept_conn.mr_len) != 0)
   {
     fprintf(stderr, "kin_accept_conn\n");
     goto error;
@@ -517,3 +546,162 @@ static int kin_req_scale(struct application *app, struct app_context *ctx,
 
   return 0;
 }
+
+static int kin_rdma_mr(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  struct connection *conn;
+  uint16_t key = kin->data.rdma_mr.key;
+  uint32_t len = kin->data.rdma_mr.len;
+  uintptr_t off = 0;
+  int status = -1;
+
+  for (conn = app->conns; conn != NULL; conn = conn->app_next) {
+    if (conn->local_ip == kin->data.rdma_mr.local_ip &&
+        conn->remote_ip == kin->data.rdma_mr.remote_ip &&
+        conn->local_port == kin->data.rdma_mr.local_port &&
+        conn->remote_port == kin->data.rdma_mr.remote_port &&
+        conn->opaque == kin->data.rdma_mr.opaque)
+    {
+      break;
+    }
+  }
+  if (conn == NULL) {
+    fprintf(stderr, "kin_rdma_mr: connection not found\n");
+    goto error;
+  }
+
+  if (kin->type == KERNEL_APPOUT_RDMA_REG_MR) {
+    if (tcp_rdma_reg_mr(conn, len, &key, &off) != 0) {
+      fprintf(stderr, "kin_rdma_mr: tcp_rdma_reg_mr failed\n");
+      goto error;
+    }
+  } else {
+    /* -EBUSY is reported so the application can retry */
+    if ((status = tcp_rdma_dereg_mr(conn, key)) != 0) {
+      if (status != -EBUSY) {
+        fprintf(stderr, "kin_rdma_mr: tcp_rdma_dereg_mr failed\n");
+        status = -1;
+      }
+      goto error;
+    }
+    len = 0;
+  }
+
+  kout->data.rdma_mr.opaque = kin->data.rdma_mr.opaque;
+  kout->data.rdma_mr.mr_off = off;
+  kout->data.rdma_mr.mr_len = len;
+  kout->data.rdma_mr.key = key;
+  kout->data.rdma_mr.status = 0;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_RDMA_MR;
+  appif_ctx_kick(ctx);
+  return 1;
+
+error:
+  kout->data.rdma_mr.opaque = kin->data.rdma_mr.opaque;
+  kout->data.rdma_mr.mr_off = 0;
+  kout->data.rdma_mr.mr_len = 0;
+  kout->data.rdma_mr.key = key;
+  kout->data.rdma_mr.status = status;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_RDMA_MR;
+  appif_ctx_kick(ctx);
+  return 1;
+}
+
+static int kin_rdma_share_mr(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  uint32_t len = kin->data.rdma_mr.len;
+  uintptr_t off;
+
+  /* connections already bound to the region keep it, so it can not be
+   * replaced */
+  if (app->shmr_handle != NULL || len == 0) {
+    fprintf(stderr, "kin_rdma_share_mr: invalid request\n");
+    goto error;
+  }
+
+  if (packetmem_alloc(len, &off, &app->shmr_handle) != 0) {
+    fprintf(stderr, "kin_rdma_share_mr: packetmem_alloc failed\n");
+    goto error;
+  }
+  memset((uint8_t *) tas_shm + off, 0, len);
+  app->shmr_off = off;
+  app->shmr_len = len;
+
+  kout->data.rdma_mr.opaque = kin->data.rdma_mr.opaque;
+  kout->data.rdma_mr.mr_off = off;
+  kout->data.rdma_mr.mr_len = len;
+  kout->data.rdma_mr.key = 0;
+  kout->data.rdma_mr.status = 0;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_RDMA_SHARED_MR;
+  appif_ctx_kick(ctx);
+  return 1;
+
+error:
+  kout->data.rdma_mr.opaque = kin->data.rdma_mr.opaque;
+  kout->data.rdma_mr.mr_off = 0;
+  kout->data.rdma_mr.mr_len = 0;
+  kout->data.rdma_mr.key = 0;
+  kout->data.rdma_mr.status = -1;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_RDMA_SHARED_MR;
+  appif_ctx_kick(ctx);
+  return 1;
+}
+
+static int kin_rdma_wq(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  struct connection *conn;
+  uintptr_t off = 0;
+  uint32_t len = 0;
+
+  for (conn = app->conns; conn != NULL; conn = conn->app_next) {
+    if (conn->local_ip == kin->data.rdma_wq.local_ip &&
+        conn->remote_ip == kin->data.rdma_wq.remote_ip &&
+        conn->local_port == kin->data.rdma_wq.local_port &&
+        conn->remote_port == kin->data.rdma_wq.remote_port &&
+        conn->opaque == kin->data.rdma_wq.opaque)
+    {
+      break;
+    }
+  }
+  if (conn == NULL) {
+    fprintf(stderr, "kin_rdma_wq: connection not found\n");
+    goto error;
+  }
+
+  if (kin->type == KERNEL_APPOUT_RDMA_WQ_ATTACH) {
+    if (tcp_rdma_wq_attach(conn, &off) != 0) {
+      fprintf(stderr, "kin_rdma_wq: tcp_rdma_wq_attach failed\n");
+      goto error;
+    }
+    len = conn->wq_len;
+  } else if (tcp_rdma_wq_detach(conn) != 0) {
+    /* not idle anymore, no error message */
+    goto error;
+  }
+
+  kout->data.rdma_wq.opaque = kin->data.rdma_wq.opaque;
+  kout->data.rdma_wq.wq_off = off;
+  kout->data.rdma_wq.wq_len = len;
+  kout->data.rdma_wq.status = 0;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_RDMA_WQ;
+  appif_ctx_kick(ctx);
+  return 1;
+
+error:
+  kout->data.rdma_wq.opaque = kin->data.rdma_wq.opaque;
+  kout->data.rdma_wq.wq_off = 0;
+  kout->data.rdma_wq.wq_len = 0;
+  kout->data.rdma_wq.status = -1;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_RDMA_WQ;
+  appif_ctx_kick(ctx);
+  return 1;
+}
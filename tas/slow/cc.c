@@ -47,6 +47,13 @@ static inline void dctcp_win_update(struct connection *c,
 static inline void dctcp_rate_init(struct connection *c);
 static inline void dctcp_rate_update(struct connection *c,
     struct nicif_connection_stats *stats, uint32_t diff_ts, uint32_t cur_ts);
+static inline uint32_t dctcp_rate_calc(struct connection *c,
+    struct connection_cc_dctcp_rate *cc, uint32_t rate,
+    struct nicif_connection_stats *stats, uint32_t cur_ts);
+
+static inline void rdma_rate_init(struct connection *c);
+static inline void rdma_rate_update(struct connection *c,
+    struct nicif_connection_stats *stats, uint32_t diff_ts, uint32_t cur_ts);
 
 static inline void timely_init(struct connection *c);
 static inline void timely_update(struct connection *c,
@@ -57,6 +64,7 @@ static inline void const_rate_update(struct connection *c,
     struct nicif_connection_stats *stats, uint32_t diff_ts, uint32_t cur_ts);
 
 static inline uint32_t window_to_rate(uint32_t window, uint32_t rtt);
+static inline uint32_t conn_tx_max(struct connection *c);
 
 static uint32_t last_ts = 0;
 static struct connection *cc_conns = NULL;
@@ -132,6 +140,10 @@ unsigned cc_poll(uint32_t cur_ts)
     c->cc_last_ecnb = stats.c_ecnb;
     stats.c_ecnb -= last;
 
+    last = c->cc_last_rdrespb;
+    c->cc_last_rdrespb = stats.c_rdrespb;
+    stats.c_rdrespb -= last;
+
     kstats.drops += stats.c_drops;
     kstats.ecn_marked += stats.c_ecnb;
     kstats.acks += stats.c_ackb;
@@ -153,6 +165,10 @@ unsigned cc_poll(uint32_t cur_ts)
         const_rate_update(c, &stats, diff_ts, cur_ts);
         break;
 
+      case CONFIG_CC_RDMA_RATE:
+        rdma_rate_update(c, &stats, diff_ts, cur_ts);
+        break;
+
       default:
         fprintf(stderr, "cc_poll: unknown CC algorithm (%u)\n",
             config.cc_algorithm);
@@ -198,6 +214,10 @@ void cc_conn_init(struct connection *conn)
       const_rate_init(conn);
       break;
 
+    case CONFIG_CC_RDMA_RATE:
+      rdma_rate_init(conn);
+      break;
+
     default:
       fprintf(stderr, "cc_conn_init: unknown CC algorithm (%u)\n",
           config.cc_algorithm);
@@ -327,9 +347,9 @@ static inline void dctcp_win_update(struct connection *c,
   if (win < CONF_MSS)
     win = CONF_MSS;
 
-  /* A window larger than the send buffer also does not make much sense */
-  if (win > c->tx_len)
-    win = c->tx_len;
+  /* A window larger than what can be in flight also does not make much sense */
+  if (win > conn_tx_max(c))
+    win = conn_tx_max(c);
 
   c->cc_rtt = rtt;
   c->cc_rate = window_to_rate(win, rtt);
@@ -338,6 +358,18 @@ static inline void dctcp_win_update(struct connection *c,
   c->cc_rexmits = 0;
 }
 
+/**
+ * Bytes that can be in flight: the send buffer of an RDMA flow is a log with
+ * one entry per message, each carrying up to a memory region's worth.
+ */
+static inline uint32_t conn_tx_max(struct connection *c)
+{
+  uint64_t max;
+
+  max = (uint64_t) (c->tx_len / sizeof(uint32_t)) * c->mr_len;
+  return (max > UINT32_MAX ? UINT32_MAX : max);
+}
+
 /** Convert window in bytes to kbps */
 static inline uint32_t window_to_rate(uint32_t window, uint32_t rtt)
 {
@@ -380,10 +412,17 @@ static inline void dctcp_rate_init(struct connection *c)
 static inline void dctcp_rate_update(struct connection *c,
     struct nicif_connection_stats *stats, uint32_t diff_ts, uint32_t cur_ts)
 {
-  struct connection_cc_dctcp_rate *cc = &c->cc.dctcp_rate;
+  c->cc_rate = dctcp_rate_calc(c, &c->cc.dctcp_rate, c->cc_rate, stats,
+      cur_ts);
+}
+
+/** Next rate-based DCTCP rate for the bytes in stats, starting from rate. */
+static inline uint32_t dctcp_rate_calc(struct connection *c,
+    struct connection_cc_dctcp_rate *cc, uint32_t rate,
+    struct nicif_connection_stats *stats, uint32_t cur_ts)
+{
   uint64_t ecn_rate;
-  uint32_t act_rate, rate = c->cc_rate, rtt = stats->rtt, c_ecnb, c_acks,
-           c_ackb, c_drops;
+  uint32_t act_rate, rtt = stats->rtt, c_ecnb, c_acks, c_ackb, c_drops;
 
   /* If RTT is zero, use estimate */
   if (rtt == 0) {
@@ -401,7 +440,7 @@ static inline void dctcp_rate_update(struct connection *c,
     cc->unproc_acks = c_acks;
     cc->unproc_ackb = c_ackb;
     cc->unproc_drops = c_drops;
-    return;
+    return rate;
   } else {
     cc->unproc_ecnb = 0;
     cc->unproc_acks = 0;
@@ -474,8 +513,59 @@ static inline void dctcp_rate_update(struct connection *c,
   if (rate < config.cc_dctcp_min)
     rate = config.cc_dctcp_min;
 
-  c->cc_rate = rate;
   c->cc_rexmits = 0;
+  return rate;
+}
+
+/******************************************************************************/
+/* RDMA-aware rate-based DCTCP */
+
+static inline void rdma_rate_init(struct connection *c)
+{
+  struct connection_cc_rdma *cc = &c->cc.rdma;
+
+  c->cc_rate = config.cc_dctcp_init;
+  cc->rate = config.cc_dctcp_init;
+  cc->txb = 0;
+  cc->respb = 0;
+
+  cc->dctcp.ecn_rate = 0;
+  cc->dctcp.act_rate = 0;
+  cc->dctcp.slowstart = 1;
+  cc->dctcp.unproc_ecnb = 0;
+  cc->dctcp.unproc_acks = 0;
+  cc->dctcp.unproc_ackb = 0;
+  cc->dctcp.unproc_drops = 0;
+}
+
+static inline void rdma_rate_update(struct connection *c,
+    struct nicif_connection_stats *stats, uint32_t diff_ts, uint32_t cur_ts)
+{
+  struct connection_cc_rdma *cc = &c->cc.rdma;
+  uint64_t rate;
+  uint32_t ackb = stats->c_ackb;
+
+  /* Read responses are sent by the peer but caused by our requests, count
+   * them as delivered bytes. Only our own bytes carry ECN feedback, assume
+   * the responses see the same marking ratio. */
+  stats->c_ackb += stats->c_rdrespb;
+  if (ackb > 0) {
+    stats->c_ecnb = ((uint64_t) stats->c_ecnb * stats->c_ackb) / ackb;
+  }
+  cc->rate = dctcp_rate_calc(c, &cc->dctcp, cc->rate, stats, cur_ts);
+
+  cc->txb = (7 * (uint64_t) cc->txb + ackb) / 8;
+  cc->respb = (7 * (uint64_t) cc->respb + stats->c_rdrespb) / 8;
+
+  /* Pace our requests so that they, together with the responses they cause,
+   * stay within the rate. Only a share is left for transmitting. */
+  rate = cc->rate;
+  if (cc->respb > 0) {
+    rate = (rate * cc->txb) / ((uint64_t) cc->txb + cc->respb);
+  }
+  if (rate < config.cc_dctcp_min)
+    rate = config.cc_dctcp_min;
+  c->cc_rate = rate;
 }
 
 /******************************************************************************/
@@ -181,6 +181,33 @@ void nicif_connection_free(uint32_t f_id);
  */
 int nicif_connection_move(uint32_t dst_db, uint32_t f_id);
 
+/**
+ * Set RDMA memory region of a flow.
+ *
+ * @param f_id  ID of flow
+ * @param key   Key of the memory region, 1 to FLEXNIC_PL_MR_NUM - 1
+ * @param base  Base address of the memory region
+ * @param len   Size of the memory region, 0 to release the key
+ *
+ * @return 0 on success, -EBUSY if the key to be released is still referenced
+ *         by queued work or messages, <0 else
+ */
+int nicif_connection_mr(uint32_t f_id, uint16_t key, uint64_t base,
+    uint32_t len);
+
+/**
+ * Attach or release the RDMA work queue of a flow.
+ *
+ * Releasing fails while work requests or posted receive buffers are
+ * outstanding, or while messages are still queued on the flow.
+ *
+ * @param f_id     ID of flow
+ * @param wq_base  Base address of the work queue, 0 to release it
+ *
+ * @return 0 on success, <0 else
+ */
+int nicif_connection_wq(uint32_t f_id, uint64_t wq_base);
+
 /**
  * Connection statistics for congestion control
  * (see nicif_connection_stats()).
@@ -194,6 +221,8 @@ struct nicif_connection_stats {
   uint32_t c_ackb;
   /** Number of ACKd bytes with ECN marks */
   uint32_t c_ecnb;
+  /** Received RDMA read response bytes */
+  uint32_t c_rdrespb;
   /** Has pending data in transmit buffer */
   int txp;
   /** Current rtt estimate */
@@ -417,6 +446,18 @@ struct connection_cc_timely {
   int slowstart;
 };
 
+/** Congestion control data for RDMA-aware rate-based DCTCP */
+struct connection_cc_rdma {
+  /** Rate-based DCTCP state for traffic in both directions */
+  struct connection_cc_dctcp_rate dctcp;
+  /** Rate for transmitted and read response bytes together [kbps] */
+  uint32_t rate;
+  /** EWMA of acknowledged bytes per control interval */
+  uint32_t txb;
+  /** EWMA of read response bytes per control interval */
+  uint32_t respb;
+};
+
 /** TCP connection state */
 struct connection {
   /**
@@ -427,6 +468,10 @@ struct connection {
     uint64_t opaque;
     /** Application context this connection is assigned to. */
     struct app_context *ctx;
+    /** Application owning the connection. */
+    struct application *app;
+    /** RDMA buffer memory charged to the application. */
+    uint64_t rdma_mem;
     /** New application context if connection should be moved. */
     struct app_context *new_ctx;
     /** Link list pointer for application connections. */
@@ -445,17 +490,21 @@ struct connection {
     struct packetmem_handle *tx_handle;
     /** Memory manager handle for memory region. */
     struct packetmem_handle *mr_handle;
-    /** Memory manager handle for work queue. */
+    /** Memory manager handle for work queue, NULL until the application
+     * attaches it with its first operation. */
     struct packetmem_handle *wq_handle;
     /** Memory manager handle for request queue. */
     struct packetmem_handle *rq_handle;
+    /** Memory manager handles for registered memory regions by key, key 0 is
+     * the memory region above. */
+    struct packetmem_handle *mr_handles[FLEXNIC_PL_MR_NUM];
     /** Receive buffer pointer. */
     uint8_t *rx_buf;
     /** Transmit buffer pointer. */
     uint8_t *tx_buf;
     /** Memory region pointer. */
     uint8_t *mr_buf;
-    /** Work Queue pointer. */
+    /** Work Queue pointer, NULL while not attached. */
     uint8_t *wq_buf;
     /** Request Queue pointer. */
     uint8_t *rq_buf;
@@ -529,6 +578,8 @@ struct connection {
     uint32_t cc_last_ackb;
     /** Number of ACKd bytes with ECN marks */
     uint32_t cc_last_ecnb;
+    /** Received RDMA read response bytes */
+    uint32_t cc_last_rdrespb;
 
     /** Congestion rate limit. */
     uint32_t cc_rate;
@@ -542,6 +593,8 @@ struct connection {
       struct connection_cc_timely timely;
       /** Rate-based dctcp */
       struct connection_cc_dctcp_rate dctcp_rate;
+      /** RDMA-aware rate-based dctcp */
+      struct connection_cc_rdma rdma;
     } cc;
     /** #control intervals with data in tx buffer but no ACKs */
     uint32_t cnt_tx_pending;
@@ -627,13 +680,16 @@ void tcp_poll(void);
  * @param remote_ip   Remote IP address
  * @param remote_port Remote port number
  * @param db_id       Doorbell ID to use for connection
+ * @param wq_len      Requested RDMA work queue size, 0 for default
+ * @param mr_len      Requested RDMA memory region size, 0 for default
  * @param conn        Pointer to location for storing pointer of created conn
  *                    struct.
  *
  * @return 0 on success, <0 else
  */
 int tcp_open(struct app_context *ctx, uint64_t opaque, uint32_t remote_ip,
-    uint16_t remote_port, uint32_t db_id, struct connection **conn);
+    uint16_t remote_port, uint32_t db_id, uint32_t wq_len, uint32_t mr_len,
+    struct connection **conn);
 
 /**
  * Open a listener.
@@ -659,11 +715,14 @@ int tcp_listen(struct app_context *ctx, uint64_t opaque, uint16_t local_port,
  * @param opaque  Opaque value passed from application
  * @param listen  Listener
  * @param db_id   Doorbell ID
+ * @param wq_len  Requested RDMA work queue size, 0 for default
+ * @param mr_len  Requested RDMA memory region size, 0 for default
  *
  * @return 0 on success, <0 else
  */
 int tcp_accept(struct app_context *ctx, uint64_t opaque,
-        struct listener *listen, uint32_t db_id);
+        struct listener *listen, uint32_t db_id, uint32_t wq_len,
+        uint32_t mr_len);
 
 /**
  * RX processing for a TCP packet.
@@ -685,6 +744,49 @@ int tcp_packet(const void *pkt, uint16_t len, uint32_t fn_core,
  */
 int tcp_close(struct connection *conn);
 
+/**
+ * Register an additional RDMA memory region on an open connection.
+ *
+ * @param conn    Connection
+ * @param len     Size of the memory region
+ * @param key     Pointer to location for storing the key
+ * @param off     Pointer to location for storing the shared memory offset
+ *
+ * @return 0 on success, <0 else
+ */
+int tcp_rdma_reg_mr(struct connection *conn, uint32_t len, uint16_t *key,
+    uintptr_t *off);
+
+/**
+ * Allocate and attach the RDMA work queue of an open connection, work queues
+ * are not allocated with the connection.
+ *
+ * @param conn    Connection
+ * @param off     Pointer to location for storing the shared memory offset
+ *
+ * @return 0 on success, <0 else
+ */
+int tcp_rdma_wq_attach(struct connection *conn, uintptr_t *off);
+
+/**
+ * Release the RDMA work queue of an idle connection.
+ *
+ * @param conn    Connection
+ *
+ * @return 0 on success, <0 else
+ */
+int tcp_rdma_wq_detach(struct connection *conn);
+
+/**
+ * Release a memory region registered with tcp_rdma_reg_mr().
+ *
+ * @param conn    Connection
+ * @param key     Key of the memory region
+ *
+ * @return 0 on success, -EBUSY while the key is in use, <0 else
+ */
+int tcp_rdma_dereg_mr(struct connection *conn, uint16_t key);
+
 /**
  * Destroy already closed/failed connection.
  *
@@ -22,6 +22,7 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +30,8 @@
 
 #include <tas.h>
 #include <tas_memif.h>
+#include <tas_rdma.h>
+#include <fastpath.h>
 #include <packet_defs.h>
 #include <utils.h>
 #include <utils_timeout.h>
@@ -65,6 +68,7 @@ static inline int flow_slot_clear(uint32_t f_id, ip_addr_t lip, beui16_t lp,
 static void flow_id_alloc_init(void);
 static int flow_id_alloc(uint32_t *fid);
 static void flow_id_free(uint32_t flow_id);
+static int flow_mr_busy(const struct flextcp_pl_flowst *fs, uint16_t key);
 
 struct flow_id_item flow_id_items[FLEXNIC_PL_FLOWST_NUM];
 struct flow_id_item *flow_id_freelist;
@@ -184,6 +188,7 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   beui32_t lip = t_beui32(ip_local), rip = t_beui32(ip_remote);
   beui16_t lp = t_beui16(port_local), rp = t_beui16(port_remote);
   uint32_t i, d, f_id, hash;
+  uint16_t key;
   struct flextcp_pl_flowhte *hte = fp_state->flowht;
 
   /* allocate flow id */
@@ -217,6 +222,11 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   fs->tx_len = tx_len;
   fs->wq_len = wq_len;
   fs->mr_len = mr_len;
+  /* zero-copy references of the previous flow are dropped asynchronously */
+  for (key = 0; key < FLEXNIC_PL_MR_NUM; key++) {
+    fp_state->flow_mrs[f_id][key].base = 0;
+    fp_state->flow_mrs[f_id][key].len = 0;
+  }
   memcpy(&fs->remote_mac, &mac_remote, ETH_ADDR_LEN);
   fs->db_id = db;
 
@@ -234,7 +244,6 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   fs->rx_next_seq = remote_seq;
   fs->rx_remote_avail = rx_len; /* XXX */
 
-  fs->txb_head = 0;
   fs->tx_sent = 0;
   fs->tx_next_pos = 0;
   fs->tx_next_seq = local_seq;
@@ -243,13 +252,21 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   fs->tx_rate = rate;
   fs->rtt_est = 0;
 
-  fs->wqe_tx_seq = 0;
+  fs->txb_head = 0;
+  fs->txb_tail = 0;
+  fs->txb_tail_acked = 0;
+  fs->txb_pos = 0;
+  fs->txb_pos_sent = 0;
   fs->wq_head = 0;
   fs->wq_tail = 0;
   fs->cq_head = 0;
   fs->cq_tail = 0;
   fs->rq_head = 0;
   fs->rq_tail = 0;
+  fs->rqe_ack_pos = 0;
+  fs->rcv_head = 0;
+  fs->rcv_tail = 0;
+  fs->pending_rq_state = 0;
 
   /* write to empty entry first */
   MEM_BARRIER();
@@ -284,6 +301,47 @@ int nicif_connection_disable(uint32_t f_id, uint32_t *tx_seq, uint32_t *rx_seq,
   return 0;
 }
 
+int nicif_connection_mr(uint32_t f_id, uint16_t key, uint64_t base,
+    uint32_t len)
+{
+  struct flextcp_pl_flowst *fs = &fp_state->flowst[f_id];
+  struct flextcp_pl_mr *mr;
+
+  if (key == 0 || key >= FLEXNIC_PL_MR_NUM) {
+    return -1;
+  }
+
+  /* fast path only accesses memory regions with the flow locked */
+  mr = &fp_state->flow_mrs[f_id][key];
+  util_spin_lock(&fs->lock);
+  if (len == 0 && (mr->zc_refs != 0 || flow_mr_busy(fs, key))) {
+    util_spin_unlock(&fs->lock);
+    return -EBUSY;
+  }
+  mr->base = base;
+  mr->len = len;
+  util_spin_unlock(&fs->lock);
+  return 0;
+}
+
+int nicif_connection_wq(uint32_t f_id, uint64_t wq_base)
+{
+  struct flextcp_pl_flowst *fs = &fp_state->flowst[f_id];
+
+  /* queue positions are kept, so late updates to the application stay valid
+   * after the work queue is attached again */
+  util_spin_lock(&fs->lock);
+  if (wq_base == 0 && (fs->wq_head != fs->cq_head ||
+        fs->rcv_head != fs->rcv_tail || fs->txb_head != fs->txb_tail))
+  {
+    util_spin_unlock(&fs->lock);
+    return -1;
+  }
+  fs->wq_base = wq_base;
+  util_spin_unlock(&fs->lock);
+  return 0;
+}
+
 void nicif_connection_free(uint32_t f_id)
 {
   flow_id_free(f_id);
@@ -312,6 +370,7 @@ int nicif_connection_stats(uint32_t f_id,
   p_stats->c_acks = fs->cnt_rx_acks;
   p_stats->c_ackb = fs->cnt_rx_ack_bytes;
   p_stats->c_ecnb = fs->cnt_rx_ecn_bytes;
+  p_stats->c_rdrespb = fs->cnt_rx_rdresp_bytes;
   p_stats->txp = fs->tx_sent != 0;
   p_stats->rtt = fs->rtt_est;
 
@@ -767,3 +826,60 @@ static void flow_id_free(uint32_t flow_id)
   it->next = flow_id_freelist;
   flow_id_freelist = it;
 }
+
+/* Memory region key still referenced by a WQE up to its completion, a message
+ * until it is acknowledged, or a request whose payload is being placed.
+ * Called with the flow locked. */
+static int flow_mr_busy(const struct flextcp_pl_flowst *fs, uint16_t key)
+{
+  const uint8_t *wq = (const uint8_t *) tas_shm + fs->wq_base;
+  const uint8_t *rq = (const uint8_t *) tas_shm + fs->rq_base;
+  const struct rdma_wqe *wqe;
+  uint32_t pos, ent;
+
+  if (fs->wq_base != 0) {
+    for (pos = fs->cq_head; pos != fs->wq_head;
+        pos = (pos + sizeof(*wqe)) % fs->wq_len)
+    {
+      wqe = (const struct rdma_wqe *) (wq + pos);
+      if (wqe->lkey == key) {
+        return 1;
+      }
+    }
+  }
+
+  /* completed WQEs may still be retransmitted, responses are only queued
+   * once received in full */
+  for (pos = fs->txb_tail; pos != fs->txb_head;
+      pos = (pos + sizeof(ent)) % fs->tx_len)
+  {
+    ent = *(const uint32_t *) ((const uint8_t *) tas_shm + fs->tx_base + pos);
+    if ((ent & RDMA_TXLOG_RQE) != 0) {
+      wqe = (const struct rdma_wqe *) (rq + (ent & ~RDMA_TXLOG_RQE));
+    } else {
+      wqe = (const struct rdma_wqe *) (wq + ent);
+    }
+    if (wqe->lkey == key) {
+      return 1;
+    }
+  }
+  for (pos = fs->rq_tail; pos != fs->rq_head;
+      pos = (pos + sizeof(*wqe)) % fs->wq_len)
+  {
+    wqe = (const struct rdma_wqe *) (rq + pos);
+    if (wqe->lkey == key) {
+      return 1;
+    }
+  }
+
+  if (fs->pending_rq_state == RDMA_RQ_PENDING_DATA ||
+      fs->pending_rq_state == RDMA_RQ_PENDING_IMM ||
+      fs->pending_rq_state == RDMA_RQ_PENDING_ATOMIC)
+  {
+    wqe = (const struct rdma_wqe *) (rq + fs->pending_rq_pos);
+    if (wqe->lkey == key) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -33,10 +33,14 @@
 #include <rte_hash_crc.h>
 
 #include <tas.h>
+#include <fastpath.h>
 #include <packet_defs.h>
 #include <utils.h>
 #include <utils_rng.h>
+#include <tas_rdma.h>
+#include <tas_rdma_lat.h>
 #include "internal.h"
+#include "appif.h"
 
 #define TCP_MSS 1460
 #define TCP_HTSIZE 4096
@@ -76,7 +80,8 @@ struct tcp_opts {
 static int conn_arp_done(struct connection *conn);
 static void conn_packet(struct connection *c, const struct pkt_tcp *p,
     const struct tcp_opts *opts, uint32_t fn_core, uint16_t flow_group);
-static inline struct connection *conn_alloc(void);
+static inline struct connection *conn_alloc(struct app_context *ctx,
+    uint32_t wq_len, uint32_t mr_len);
 static inline void conn_free(struct connection *conn);
 static void conn_register(struct connection *conn);
 static void conn_unregister(struct connection *conn);
@@ -144,14 +149,15 @@ void tcp_poll(void)
 }
 
 int tcp_open(struct app_context *ctx, uint64_t opaque, uint32_t remote_ip,
-    uint16_t remote_port, uint32_t db_id, struct connection **pconn)
+    uint16_t remote_port, uint32_t db_id, uint32_t wq_len, uint32_t mr_len,
+    struct connection **pconn)
 {
   int ret;
   struct connection *conn;
   uint16_t local_port;
 
   /* allocate connection struct */
-  if ((conn = conn_alloc()) == NULL) {
+  if ((conn = conn_alloc(ctx, wq_len, mr_len)) == NULL) {
     fprintf(stderr, "tcp_open: malloc failed\n");
     return -1;
   }
@@ -319,12 +325,12 @@ int tcp_listen(struct app_context *ctx, uint64_t opaque, uint16_t local_port,
 }
 
 int tcp_accept(struct app_context *ctx, uint64_t opaque,
-    struct listener *listen, uint32_t db_id)
+    struct listener *listen, uint32_t db_id, uint32_t wq_len, uint32_t mr_len)
 {
   struct connection *conn;
 
   /* allocate listener struct */
-  if ((conn = conn_alloc()) == NULL) {
+  if ((conn = conn_alloc(ctx, wq_len, mr_len)) == NULL) {
     fprintf(stderr, "tcp_accept: conn_alloc failed\n");
     return -1;
   }
@@ -424,6 +430,109 @@ int tcp_close(struct connection *conn)
   return 0;
 }
 
+int tcp_rdma_reg_mr(struct connection *conn, uint32_t len, uint16_t *key,
+    uintptr_t *off)
+{
+  uint16_t k;
+
+  if (conn->status != CONN_OPEN || len == 0) {
+    return -1;
+  }
+
+  for (k = 1; k < FLEXNIC_PL_MR_NUM && conn->mr_handles[k] != NULL; k++);
+  if (k == FLEXNIC_PL_MR_NUM) {
+    fprintf(stderr, "tcp_rdma_reg_mr: no free key\n");
+    return -1;
+  }
+
+  if (packetmem_alloc(len, off, &conn->mr_handles[k]) != 0) {
+    fprintf(stderr, "tcp_rdma_reg_mr: packetmem_alloc failed\n");
+    return -1;
+  }
+  memset((uint8_t *) tas_shm + *off, 0, len);
+
+  if (nicif_connection_mr(conn->flow_id, k, *off, len) != 0) {
+    fprintf(stderr, "tcp_rdma_reg_mr: nicif_connection_mr failed\n");
+    packetmem_free(conn->mr_handles[k]);
+    conn->mr_handles[k] = NULL;
+    return -1;
+  }
+
+  *key = k;
+  return 0;
+}
+
+int tcp_rdma_wq_attach(struct connection *conn, uintptr_t *off)
+{
+  size_t len;
+
+  if (conn->status != CONN_OPEN) {
+    return -1;
+  }
+
+  if (conn->wq_handle != NULL) {
+    *off = conn->wq_buf - (uint8_t *) tas_shm;
+    return 0;
+  }
+
+  /* work queue is followed by the receive queue, the WQE extensions and
+   * the WQE timestamps (if enabled) */
+  len = 2 * conn->wq_len + conn->wq_len / sizeof(struct rdma_wqe) *
+    (RDMA_WQE_EXT_LEN + RDMA_WQE_TS_LEN);
+  if (packetmem_alloc(len, off, &conn->wq_handle) != 0) {
+    fprintf(stderr, "tcp_rdma_wq_attach: packetmem_alloc failed\n");
+    conn->wq_handle = NULL;
+    return -1;
+  }
+  memset((uint8_t *) tas_shm + *off, 0, len);
+
+  if (nicif_connection_wq(conn->flow_id, *off) != 0) {
+    fprintf(stderr, "tcp_rdma_wq_attach: nicif_connection_wq failed\n");
+    packetmem_free(conn->wq_handle);
+    conn->wq_handle = NULL;
+    return -1;
+  }
+
+  conn->wq_buf = (uint8_t *) tas_shm + *off;
+  return 0;
+}
+
+int tcp_rdma_wq_detach(struct connection *conn)
+{
+  if (conn->status != CONN_OPEN || conn->wq_handle == NULL) {
+    return -1;
+  }
+
+  if (nicif_connection_wq(conn->flow_id, 0) != 0) {
+    return -1;
+  }
+
+  packetmem_free(conn->wq_handle);
+  conn->wq_handle = NULL;
+  conn->wq_buf = NULL;
+  return 0;
+}
+
+int tcp_rdma_dereg_mr(struct connection *conn, uint16_t key)
+{
+  int ret;
+
+  if (conn->status != CONN_OPEN || key == 0 || key >= FLEXNIC_PL_MR_NUM ||
+      conn->mr_handles[key] == NULL)
+  {
+    return -1;
+  }
+
+  /* region stays allocated while the fast path still references the key */
+  if ((ret = nicif_connection_mr(conn->flow_id, key, 0, 0)) != 0) {
+    return ret;
+  }
+
+  packetmem_free(conn->mr_handles[key]);
+  conn->mr_handles[key] = NULL;
+  return 0;
+}
+
 void tcp_destroy(struct connection *conn)
 {
   assert(conn->status == CONN_FAILED);
@@ -570,7 +679,7 @@ static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
   if (nicif_connection_add(c->db_id, c->remote_mac, c->local_ip, c->local_port,
         c->remote_ip, c->remote_port, c->rx_buf - (uint8_t *) tas_shm,
         c->rx_len, c->tx_buf - (uint8_t *) tas_shm, c->tx_len,
-        c->wq_buf - (uint8_t*) tas_shm, c->wq_len,
+        (c->wq_buf != NULL ? c->wq_buf - (uint8_t*) tas_shm : 0), c->wq_len,
         c->mr_buf - (uint8_t*) tas_shm, c->mr_len,
         c->rq_buf - (uint8_t*) tas_shm,
         c->remote_seq, c->local_seq, c->opaque, c->flags, c->cc_rate,
@@ -633,74 +742,133 @@ static inline uint16_t port_alloc(void)
   return 0;
 }
 
-static inline struct connection *conn_alloc(void)
+static inline struct connection *conn_alloc(struct app_context *ctx,
+    uint32_t wq_len, uint32_t mr_len)
 {
+  struct application *app = ctx->app;
   struct connection *conn;
-  uintptr_t off_rx, off_tx, off_mr, off_wq, off_rq;
+  uintptr_t off_rx, off_tx, off_mr, off_rq;
+  uint64_t rdma_mem;
+  uint32_t tx_len;
+
+  /* requested queue and region sizes, bounded by the configured maximum */
+  if (wq_len == 0) {
+    wq_len = config.rdma_wq_len;
+  } else if (wq_len > config.rdma_wq_max) {
+    wq_len = config.rdma_wq_max;
+  }
+  wq_len -= wq_len % sizeof(struct rdma_wqe);
+  if (wq_len < 2 * sizeof(struct rdma_wqe)) {
+    wq_len = 2 * sizeof(struct rdma_wqe);
+  }
+
+  /* the transmit buffer holds the message log, it needs room for every WQ
+   * and RQ entry so the whole backlog can be handed to the fast path */
+  tx_len = RDMA_TXLOG_LEN(wq_len);
+  if (tx_len < config.tcp_txbuf_len) {
+    tx_len = config.tcp_txbuf_len;
+  }
+
+  if (app->shmr_handle != NULL) {
+    /* bound to the memory region shared by the application */
+    mr_len = app->shmr_len;
+  } else if (mr_len == 0) {
+    mr_len = config.rdma_mr_len;
+  } else if (mr_len > config.rdma_mr_max) {
+    mr_len = config.rdma_mr_max;
+  }
+
+  /* request queue, and work queue attached later on */
+  rdma_mem = wq_len + 2 * wq_len + wq_len / sizeof(struct rdma_wqe) *
+    (RDMA_RQE_TS_LEN + RDMA_WQE_EXT_LEN + RDMA_WQE_TS_LEN);
+  if (app->shmr_handle == NULL) {
+    rdma_mem += mr_len;
+  }
+  if (appif_rdma_charge(app, rdma_mem) != 0) {
+    fprintf(stderr, "conn_alloc: appif_rdma_charge failed\n");
+    return NULL;
+  }
 
   if ((conn = malloc(sizeof(*conn))) == NULL) {
     fprintf(stderr, "conn_alloc: malloc failed\n");
-    return NULL;
+    goto MALLOC_ERROR;
   }
+  memset(conn->mr_handles, 0, sizeof(conn->mr_handles));
 
   if (packetmem_alloc(config.tcp_rxbuf_len, &off_rx, &conn->rx_handle) != 0) {
     fprintf(stderr, "conn_alloc: packetmem_alloc rx failed\n");
     goto RXBUF_ALLOC_ERROR;
   }
 
-  if (packetmem_alloc(config.tcp_txbuf_len, &off_tx, &conn->tx_handle) != 0) {
+  if (packetmem_alloc(tx_len, &off_tx, &conn->tx_handle) != 0) {
     fprintf(stderr, "conn_alloc: packetmem_alloc tx failed\n");
     goto TXBUF_ALLOC_ERROR;
   }
 
-  if (packetmem_alloc(config.rdma_mr_len, &off_mr, &conn->mr_handle) != 0) {
+  if (app->shmr_handle != NULL) {
+    conn->mr_handle = NULL;
+    off_mr = app->shmr_off;
+  } else if (packetmem_alloc(mr_len, &off_mr, &conn->mr_handle) != 0) {
     fprintf(stderr, "conn_alloc: packetmem_alloc mr failed\n");
     goto MRBUF_ALLOC_ERROR;
   }
 
-  if (packetmem_alloc(config.rdma_wq_len, &off_wq, &conn->wq_handle) != 0) {
-    fprintf(stderr, "conn_alloc: packetmem_alloc wq failed\n");
-    goto WQBUF_ALLOC_ERROR;
-  }
-
-  if (packetmem_alloc(config.rdma_wq_len, &off_rq, &conn->rq_handle) != 0) {
+  if (packetmem_alloc(wq_len + wq_len / sizeof(struct rdma_wqe) *
+        RDMA_RQE_TS_LEN, &off_rq, &conn->rq_handle) != 0) {
     fprintf(stderr, "conn_alloc: packetmem_alloc rq failed\n");
     goto RQBUF_ALLOC_ERROR;
   }
 
+  conn->app = app;
+  conn->rdma_mem = rdma_mem;
   conn->rx_buf = (uint8_t *) tas_shm + off_rx;
   conn->rx_len = config.tcp_rxbuf_len;
   conn->tx_buf = (uint8_t *) tas_shm + off_tx;
-  conn->tx_len = config.tcp_txbuf_len;
+  conn->tx_len = tx_len;
   conn->mr_buf = (uint8_t *) tas_shm + off_mr;
-  conn->mr_len = config.rdma_mr_len;
-  conn->wq_buf = (uint8_t *) tas_shm + off_wq;
-  conn->wq_len = config.rdma_wq_len;
+  conn->mr_len = mr_len;
+  conn->wq_handle = NULL;
+  conn->wq_buf = NULL;
+  conn->wq_len = wq_len;
   conn->rq_buf = (uint8_t *) tas_shm + off_rq;
   conn->to_armed = 0;
 
   return conn;
 
 RQBUF_ALLOC_ERROR:
-  packetmem_free(conn->wq_handle);
-WQBUF_ALLOC_ERROR:
-  packetmem_free(conn->mr_handle);
+  if (conn->mr_handle != NULL) {
+    packetmem_free(conn->mr_handle);
+  }
 MRBUF_ALLOC_ERROR:
   packetmem_free(conn->tx_handle);
 TXBUF_ALLOC_ERROR:
   packetmem_free(conn->rx_handle);
 RXBUF_ALLOC_ERROR:
   free(conn);
+MALLOC_ERROR:
+  appif_rdma_release(app, rdma_mem);
   return NULL;
 }
 
 static inline void conn_free(struct connection *conn)
 {
+  uint16_t key;
+
+  for (key = 1; key < FLEXNIC_PL_MR_NUM; key++) {
+    if (conn->mr_handles[key] != NULL) {
+      packetmem_free(conn->mr_handles[key]);
+    }
+  }
   packetmem_free(conn->tx_handle);
   packetmem_free(conn->rx_handle);
-  packetmem_free(conn->mr_handle);
-  packetmem_free(conn->wq_handle);
+  if (conn->mr_handle != NULL) {
+    packetmem_free(conn->mr_handle);
+  }
+  if (conn->wq_handle != NULL) {
+    packetmem_free(conn->wq_handle);
+  }
   packetmem_free(conn->rq_handle);
+  appif_rdma_release(conn->app, conn->rdma_mem);
   free(conn);
 }
 
@@ -978,7 +1146,7 @@ static void listener_accept(struct listener *l)
   if (nicif_connection_add(c->db_id, c->remote_mac, c->local_ip, c->local_port,
         c->remote_ip, c->remote_port, c->rx_buf - (uint8_t *) tas_shm,
         c->rx_len, c->tx_buf - (uint8_t *) tas_shm, c->tx_len,
-        c->wq_buf - (uint8_t*) tas_shm, c->wq_len,
+        (c->wq_buf != NULL ? c->wq_buf - (uint8_t*) tas_shm : 0), c->wq_len,
         c->mr_buf - (uint8_t*) tas_shm, c->mr_len,
         c->rq_buf - (uint8_t*) tas_shm,
         c->remote_seq, c->local_seq + 1, c->opaque, c->flags, c->cc_rate,
@@ -167,6 +167,14 @@ static int common_thread(void *arg)
   }
 #endif
 
+  /* initialize RDMA latency histograms if enabled */
+#ifdef FLEXNIC_RDMA_LATENCY
+  if (rdma_lat_thread_init(id) != 0) {
+    fprintf(stderr, "initializing RDMA latency histograms failed\n");
+    goto error_trace;
+  }
+#endif
+
   /* initialize data plane context */
   if (dataplane_context_init(ctx) != 0) {
     fprintf(stderr, "initializing data plane context\n");
@@ -180,7 +188,7 @@ static int common_thread(void *arg)
   return 0;
 
 error_dpctx:
-#ifdef FLEXNIC_TRACING
+#if defined(FLEXNIC_TRACING) || defined(FLEXNIC_RDMA_LATENCY)
 error_trace:
 #endif
   dataplane_context_destroy(ctx);
@@ -248,7 +256,8 @@ void flexnic_loadmon(uint32_t ts)
 {
   uint64_t cyc_busy = 0, x, tsc, cycles, id_cyc;
   unsigned i, num_cores;
-  static uint64_t ewma_busy = 0, ewma_cycles = 0, last_tsc = 0, kdrops = 0;
+  static uint64_t ewma_busy = 0, ewma_cycles = 0, last_tsc = 0, kdrops = 0,
+    arxdefer = 0;
   static int waiting = 1, waiting_n = 0, count = 0;
 
   num_cores = fp_cores_cur;
@@ -264,6 +273,8 @@ void flexnic_loadmon(uint32_t ts)
 
     kdrops += ctxs[i]->kernel_drop;
     ctxs[i]->kernel_drop = 0;
+    arxdefer += ctxs[i]->arx_deferred;
+    ctxs[i]->arx_deferred = 0;
   }
 
   /* measure cpu cycles since last call */
@@ -283,9 +294,10 @@ void flexnic_loadmon(uint32_t ts)
   if (count++ % 100 == 0) {
     if (!config.quiet)
       fprintf(stderr, "flexnic_loadmon: status cores = %u   busy = %lu  "
-          "cycles =%lu  kdrops=%lu\n", num_cores, ewma_busy, ewma_cycles,
-          kdrops);
+          "cycles =%lu  kdrops=%lu  arxdefer=%lu\n", num_cores, ewma_busy,
+          ewma_cycles, kdrops, arxdefer);
     kdrops = 0;
+    arxdefer = 0;
   }
 
   /* waiting period after scaling decsions */
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 
 #include "harness.h"
 #include "../testutils.h"
@@ -35,9 +36,13 @@ struct harness {
   size_t num_fpcores;
   size_t next_ctx;
   uint64_t num_kicks;
+  void (*kick)(void);
   struct harness_ctx *ctxs;
 };
 
+/* fast path kick eventfds of libtas, set up by flextcp_kernel_connect() */
+extern int flexnic_evfd[];
+
 struct harness_params harness_param;
 struct harness harness;
 
@@ -52,6 +57,7 @@ void harness_prepare(struct harness_params *hp)
   harness.num_fpcores = hp->fp_cores;
   harness.next_ctx = 0;
   harness.num_kicks = 0;
+  harness.kick = NULL;
 
   /* allocate contexts */
   harness.ctxs = test_zalloc(harness.num_ctxs * sizeof(*hc));
@@ -277,14 +283,52 @@ int harness_arx_push(size_t ctxid, size_t qid, uint64_t opaque,
 
 }
 
+int harness_arx_push_rdma(size_t ctxid, size_t qid, uint64_t opaque,
+    uint32_t wq_tail, uint32_t cq_head, uint32_t rcv_tail)
+{
+  struct harness_ctx *hc = &harness.ctxs[ctxid];
+  struct harness_fpc_ctx *fpc = &hc->fpcs[qid];
+  struct flextcp_pl_arx *arx = &fpc->arx_base[fpc->arx_pos];
+
+  if (arx->type != FLEXTCP_PL_ARX_INVALID)
+    return -1;
+
+  arx->msg.rdmaupdate.opaque = opaque;
+  arx->msg.rdmaupdate.wq_tail = wq_tail;
+  arx->msg.rdmaupdate.cq_head = cq_head;
+  arx->msg.rdmaupdate.rcv_tail = rcv_tail;
+  arx->type = FLEXTCP_PL_ARX_RDMAUPDATE;
+
+  fpc->arx_pos++;
+  if (fpc->arx_pos >= hc->arx_len)
+    fpc->arx_pos -= hc->arx_len;
+
+  return 0;
+}
+
 int flextcp_kernel_connect(void)
 {
+  size_t i;
+
+  for (i = 0; i < harness.num_fpcores; i++) {
+    if ((flexnic_evfd[i] = eventfd(0, EFD_NONBLOCK)) < 0) {
+      perror("flextcp_kernel_connect: eventfd failed");
+      return -1;
+    }
+  }
   return 0;
 }
 
+void harness_set_kick(void (*kick)(void))
+{
+  harness.kick = kick;
+}
+
 void flextcp_kernel_kick(void)
 {
   harness.num_kicks++;
+  if (harness.kick != NULL)
+    harness.kick();
 }
 
 int flexnic_driver_internal(void **int_mem_start)
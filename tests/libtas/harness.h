@@ -17,6 +17,9 @@ struct harness_params {
 };
 
 void harness_prepare(struct harness_params *hp);
+/* kick is called for every request the library queues on aout, so it can
+ * answer requests the library blocks on */
+void harness_set_kick(void (*kick)(void));
 
 int harness_aout_peek(struct kernel_appout **ao, size_t ctxid);
 int harness_aout_pop(size_t ctxid);
@@ -36,5 +39,7 @@ int harness_atx_pull(size_t ctxid, size_t qid, uint32_t rx_bump,
     uint32_t tx_bump, uint32_t flow_id, uint16_t bump_seq, uint8_t flags);
 int harness_arx_push(size_t ctxid, size_t qid, uint64_t opaque,
     uint32_t rx_bump, uint32_t rx_pos, uint32_t tx_bump, uint8_t flags);
+int harness_arx_push_rdma(size_t ctxid, size_t qid, uint64_t opaque,
+    uint32_t wq_tail, uint32_t cq_head, uint32_t rcv_tail);
 
 #endif // ndef HARNESS_H_
@@ -341,6 +341,81 @@ static void test_full_txbuf(void *p)
 }
 
 
+static void test_rdma_poll_order(void *p)
+{
+  struct flextcp_context ctx;
+  struct flextcp_connection conn;
+  struct flextcp_event evs[4];
+  int num;
+  int n;
+  void *rxbuf, *txbuf;
+
+  if (flextcp_init() != 0)
+    test_error("flextcp_init failed");
+
+  test_randinit(&ctx, sizeof(ctx));
+  if (flextcp_context_create(&ctx) != 0)
+    test_error("flextcp_context_create failed");
+
+  /* open connection */
+  test_randinit(&conn, sizeof(conn));
+  if (flextcp_connection_open(&ctx, &conn, TEST_IP, TEST_PORT) != 0)
+    test_error("flextcp_connection_open failed");
+  n = harness_aout_pull_connopen(0, (uintptr_t) &conn, TEST_IP, TEST_PORT, 0);
+  test_assert("pulling conn open request off aout", n == 0);
+
+  rxbuf = test_zalloc(1024);
+  txbuf = test_zalloc(1024);
+  n = harness_ain_push_connopened(0, (uintptr_t) &conn, 1024, rxbuf, 1024,
+      txbuf, 1, TEST_LIP, TEST_LPORT, 0);
+  test_assert("harness_ain_push_connopened success", n == 0);
+  num = flextcp_context_poll(&ctx, 4, evs);
+  test_assert("conn open event", num == 1 &&
+      evs[0].event_type == FLEXTCP_EV_CONN_OPEN);
+
+  /* 128 work queue entries posted */
+  conn.wq_size = 256;
+  conn.wq_len = 128;
+  conn.wq_tail = 0;
+  conn.cq_len = 0;
+  conn.rcv_len = 0;
+  conn.rcv_tail = 0;
+  conn.rcv_cq_len = 0;
+  conn.rdma_cq = NULL;
+
+  /* received bytes queued ahead of completions */
+  n = harness_arx_push(0, 0, (uintptr_t) &conn, 32, 0, 0, 0);
+  test_assert("harness_arx_push success", n == 0);
+  n = harness_arx_push_rdma(0, 0, (uintptr_t) &conn, 0, 64, 0);
+  test_assert("harness_arx_push_rdma success", n == 0);
+
+  /* completions behind the connection update are not held up by it */
+  num = rdma_cq_fastpath_poll(&ctx, 4);
+  test_assert("one rdma update", num == 1);
+  test_assert("cq_len", conn.cq_len == 64);
+  test_assert("wq_len", conn.wq_len == 64);
+  test_assert("wq_tail", conn.wq_tail == 64);
+
+  /* more bytes after the deferred update */
+  n = harness_arx_push(0, 0, (uintptr_t) &conn, 8, 0, 0, 0);
+  test_assert("harness_arx_push success", n == 0);
+
+  /* connection updates are handed out in the order they arrived */
+  num = flextcp_context_poll(&ctx, 4, evs);
+  test_assert("two rx events", num == 2);
+  test_assert("rxev_type 1", evs[0].event_type == FLEXTCP_EV_CONN_RECEIVED);
+  test_assert("rxev_buf 1", evs[0].ev.conn_received.buf == rxbuf);
+  test_assert("rxev_len 1", evs[0].ev.conn_received.len == 32);
+  test_assert("rxev_type 2", evs[1].event_type == FLEXTCP_EV_CONN_RECEIVED);
+  test_assert("rxev_buf 2",
+      evs[1].ev.conn_received.buf == (uint8_t *) rxbuf + 32);
+  test_assert("rxev_len 2", evs[1].ev.conn_received.len == 8);
+
+  num = flextcp_context_poll(&ctx, 4, evs);
+  test_assert("no more events", num == 0);
+}
+
+
 int main(int argc, char *argv[])
 {
   int ret = 0;
@@ -371,5 +446,8 @@ int main(int argc, char *argv[])
   if (test_subcase("full txbuf", test_full_txbuf, NULL))
     ret = 1;
 
+  if (test_subcase("rdma poll order", test_rdma_poll_order, NULL))
+    ret = 1;
+
   return ret;
 }
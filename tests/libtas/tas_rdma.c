@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <tas_rdma.h>
+
+#include "../testutils.h"
+#include "harness.h"
+
+#define TEST_IP   0x0a010203
+#define TEST_PORT 12345
+
+#define TEST_LIP   0x0a010201
+#define TEST_LPORT 23456
+
+#define TEST_BUFLEN 1024
+#define TEST_MRLEN  4096
+#define TEST_WQLEN  (16 * sizeof(struct rdma_wqe))
+
+/* if 0 requests are consumed without an answer, the test queued it already */
+static int kernel_answer = 1;
+/* work queue handed out by the last attach */
+static uint8_t *last_wq = NULL;
+
+/* answer the requests the library blocks on, as the slow path would */
+static void kernel_respond(void)
+{
+  struct kernel_appout *ao;
+  struct kernel_appin ai;
+
+  while (harness_aout_peek(&ao, 0) == 0) {
+    memset(&ai, 0, sizeof(ai));
+
+    if (ao->type == KERNEL_APPOUT_LISTEN_OPEN) {
+      ai.type = KERNEL_APPIN_STATUS_LISTEN_OPEN;
+      ai.data.status.opaque = ao->data.listen_open.opaque;
+    } else if (ao->type == KERNEL_APPOUT_CONN_CLOSE) {
+      ai.type = KERNEL_APPIN_STATUS_CONN_CLOSE;
+      ai.data.status.opaque = ao->data.conn_close.opaque;
+    } else if (ao->type == KERNEL_APPOUT_RDMA_WQ_ATTACH) {
+      /* room for the queue, its receive queue and the extension slots */
+      ai.type = KERNEL_APPIN_STATUS_RDMA_WQ;
+      ai.data.rdma_wq.opaque = ao->data.rdma_wq.opaque;
+      last_wq = test_zalloc(16 * TEST_WQLEN);
+      ai.data.rdma_wq.wq_off = (uintptr_t) last_wq;
+      ai.data.rdma_wq.wq_len = TEST_WQLEN;
+    } else {
+      /* connection establishment is answered by the test */
+      return;
+    }
+
+    harness_aout_pop(0);
+    if (kernel_answer && harness_ain_push(0, &ai) != 0)
+      test_error("harness_ain_push failed");
+  }
+}
+
+static void test_addr(struct sockaddr_in *addr, uint32_t ip, uint16_t port)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = htonl(ip);
+  addr->sin_port = htons(port);
+}
+
+/* start an asynchronous connect, returns its fd and the request opaque */
+static int test_connect_start(uint64_t *opaque)
+{
+  struct sockaddr_in addr;
+  int fd, n;
+
+  test_addr(&addr, TEST_IP, TEST_PORT);
+  fd = rdma_connect_async(&addr, 16, TEST_MRLEN);
+  test_assert("rdma_connect_async", fd > 0);
+
+  n = harness_aout_pull_connopen_op(0, opaque, TEST_IP, TEST_PORT, 0);
+  test_assert("pulling conn open request off aout", n == 0);
+  return fd;
+}
+
+static void test_push_connopened(uint64_t opaque)
+{
+  struct kernel_appin ai;
+
+  memset(&ai, 0, sizeof(ai));
+  ai.type = KERNEL_APPIN_CONN_OPENED;
+  ai.data.conn_opened.opaque = opaque;
+  ai.data.conn_opened.rx_off = (uintptr_t) test_zalloc(TEST_BUFLEN);
+  ai.data.conn_opened.tx_off = (uintptr_t) test_zalloc(TEST_BUFLEN);
+  ai.data.conn_opened.mr_off = (uintptr_t) test_zalloc(TEST_MRLEN);
+  ai.data.conn_opened.rx_len = TEST_BUFLEN;
+  ai.data.conn_opened.tx_len = TEST_BUFLEN;
+  ai.data.conn_opened.mr_len = TEST_MRLEN;
+  ai.data.conn_opened.flow_id = 1;
+  ai.data.conn_opened.local_ip = TEST_LIP;
+  ai.data.conn_opened.local_port = TEST_LPORT;
+  test_assert("harness_ain_push conn opened", harness_ain_push(0, &ai) == 0);
+}
+
+/* establish a connection asynchronously, returns its fd */
+static int test_connect_op(uint64_t *opaque)
+{
+  struct rdma_conn_ev ev;
+  int fd, n;
+
+  fd = test_connect_start(opaque);
+  test_push_connopened(*opaque);
+
+  n = rdma_conn_poll(&ev, 1, 0);
+  test_assert("one connection established", n == 1);
+  test_assert("established fd", ev.fd == fd);
+  test_assert("established status", ev.status == 0);
+  test_assert("established mr_len", ev.mr_len == TEST_MRLEN);
+  return fd;
+}
+
+static int test_connect(void)
+{
+  uint64_t opaque;
+
+  return test_connect_op(&opaque);
+}
+
+static void test_fd_reuse(void *p)
+{
+  struct rdma_wqe cqe;
+  int fd, fd2;
+
+  if (rdma_init() != 0)
+    test_error("rdma_init failed");
+  harness_set_kick(kernel_respond);
+
+  fd = test_connect();
+  test_assert("write before close", rdma_write(fd, 8, 0, 0) >= 0);
+  test_assert("close", rdma_close(fd) == 0);
+
+  /* closed fd is rejected, not dereferenced */
+  test_assert("read after close", rdma_read(fd, 8, 0, 0) == -1);
+  test_assert("write after close", rdma_write(fd, 8, 0, 0) == -1);
+  test_assert("cq poll after close", rdma_cq_poll(fd, &cqe, 1) == -1);
+  test_assert("read on unused fd", rdma_read(fd + 1, 8, 0, 0) == -1);
+
+  /* fd is handed out again for the next connection */
+  fd2 = test_connect();
+  test_assert("fd reused", fd2 == fd);
+  test_assert("write on reused fd", rdma_write(fd2, 8, 0, 0) >= 0);
+  test_assert("cq poll on reused fd", rdma_cq_poll(fd2, &cqe, 1) == 0);
+}
+
+static void test_cq_unsignaled(void *p)
+{
+  struct rdma_wqe cqe[2], *wq;
+  uint64_t opaque, opaque2;
+  int fd, fd2, id[3], i, n;
+
+  if (rdma_init() != 0)
+    test_error("rdma_init failed");
+  harness_set_kick(kernel_respond);
+
+  fd = test_connect_op(&opaque);
+  fd2 = test_connect_op(&opaque2);
+
+  /* only the last of three writes is signaled */
+  test_assert("signal interval", rdma_set_signal_interval(fd, 3) == 0);
+  for (i = 0; i < 3; i++) {
+    id[i] = rdma_write(fd, 8, 0, 0);
+    test_assert("write posted", id[i] >= 0);
+  }
+  wq = (struct rdma_wqe *) last_wq;
+  for (i = 0; i < 3; i++)
+    wq[id[i] / sizeof(*wq)].status = RDMA_SUCCESS;
+
+  /* unsignaled completions are applied while polling another connection */
+  n = harness_arx_push_rdma(0, 0, opaque, 0, 2 * sizeof(*wq), 0);
+  test_assert("harness_arx_push_rdma success", n == 0);
+  n = rdma_cq_poll(fd2, cqe, 2);
+  test_assert("nothing for the other connection", n == 0);
+
+  /* signaled completion is only known to the fast path queue */
+  n = harness_arx_push_rdma(0, 0, opaque, 0, 3 * sizeof(*wq), 0);
+  test_assert("harness_arx_push_rdma success", n == 0);
+  n = rdma_cq_poll(fd, cqe, 1);
+  test_assert("signaled reported", n == 1 && cqe[0].id == id[2]);
+  n = rdma_cq_poll(fd, cqe, 1);
+  test_assert("nothing left", n == 0);
+}
+
+static void test_scq_destroy(void *p)
+{
+  struct rdma_cqe cqe[2];
+  struct rdma_wqe *wq;
+  struct rdma_cq *cq;
+  uint64_t opaque, opaque2;
+  int fd, fd2, id, n;
+
+  if (rdma_init() != 0)
+    test_error("rdma_init failed");
+  harness_set_kick(kernel_respond);
+
+  fd = test_connect_op(&opaque);
+  fd2 = test_connect_op(&opaque2);
+  cq = rdma_scq_create();
+  test_assert("rdma_scq_create", cq != NULL);
+
+  /* attached connections keep the queue alive */
+  test_assert("attach", rdma_scq_attach(fd, cq) == 0);
+  test_assert("attach other", rdma_scq_attach(fd2, cq) == 0);
+  test_assert("destroy attached", rdma_scq_destroy(cq) == -1);
+  test_assert("detach", rdma_scq_detach(fd2) == 0);
+  test_assert("detach again", rdma_scq_detach(fd2) == -1);
+  test_assert("destroy attached", rdma_scq_destroy(cq) == -1);
+
+  /* completion queued on the shared queue */
+  id = rdma_write(fd, 8, 0, 0);
+  test_assert("write posted", id >= 0);
+  wq = (struct rdma_wqe *) last_wq;
+  wq[id / sizeof(*wq)].status = RDMA_SUCCESS;
+  n = harness_arx_push_rdma(0, 0, opaque, 0, sizeof(*wq), 0);
+  test_assert("harness_arx_push_rdma success", n == 0);
+  n = rdma_cq_poll(fd2, &cqe[0].wqe, 1);
+  test_assert("nothing for the detached connection", n == 0);
+
+  /* closing unlinks the connection from the ready list */
+  test_assert("close", rdma_close(fd) == 0);
+  n = rdma_scq_poll(cq, cqe, 2, 0);
+  test_assert("closed connection not reported", n == 0);
+  test_assert("destroy", rdma_scq_destroy(cq) == 0);
+}
+
+static void test_async(void *p)
+{
+  struct sockaddr_in addr;
+  struct kernel_appout *ao;
+  struct kernel_appin ai;
+  struct rdma_conn_ev evs[4];
+  uint64_t aopaque, copaque, fopaque;
+  int lfd, afd, cfd, ffd, n;
+
+  if (rdma_init() != 0)
+    test_error("rdma_init failed");
+  harness_set_kick(kernel_respond);
+  /* a lost event leaves the library blocked */
+  alarm(5);
+
+  test_addr(&addr, TEST_LIP, TEST_LPORT);
+  lfd = rdma_listen(&addr, 8);
+  test_assert("rdma_listen", lfd > 0);
+
+  /* accept, connect and a failing connect in flight at once */
+  afd = rdma_accept_async(lfd, 16, TEST_MRLEN);
+  test_assert("rdma_accept_async", afd > 0);
+  n = harness_aout_peek(&ao, 0);
+  test_assert("accept request on aout", n == 0 &&
+      ao->type == KERNEL_APPOUT_ACCEPT_CONN);
+  aopaque = ao->data.accept_conn.conn_opaque;
+  harness_aout_pop(0);
+
+  cfd = test_connect_start(&copaque);
+  ffd = test_connect_start(&fopaque);
+  test_assert("distinct fds", afd != cfd && afd != ffd && cfd != ffd);
+
+  n = rdma_conn_poll(evs, 4, 0);
+  test_assert("nothing established yet", n == 0);
+
+  /* responses arrive in a different order than the requests */
+  test_push_connopened(copaque);
+  n = harness_ain_push_connopen_failed(0, fopaque, -1);
+  test_assert("harness_ain_push_connopen_failed", n == 0);
+
+  memset(&ai, 0, sizeof(ai));
+  ai.type = KERNEL_APPIN_ACCEPTED_CONN;
+  ai.data.accept_connection.opaque = aopaque;
+  ai.data.accept_connection.rx_off = (uintptr_t) test_zalloc(TEST_BUFLEN);
+  ai.data.accept_connection.tx_off = (uintptr_t) test_zalloc(TEST_BUFLEN);
+  ai.data.accept_connection.mr_off = (uintptr_t) test_zalloc(TEST_MRLEN);
+  ai.data.accept_connection.rx_len = TEST_BUFLEN;
+  ai.data.accept_connection.tx_len = TEST_BUFLEN;
+  ai.data.accept_connection.mr_len = TEST_MRLEN;
+  ai.data.accept_connection.flow_id = 2;
+  ai.data.accept_connection.local_ip = TEST_LIP;
+  ai.data.accept_connection.remote_ip = TEST_IP;
+  ai.data.accept_connection.remote_port = TEST_PORT;
+  test_assert("harness_ain_push accepted", harness_ain_push(0, &ai) == 0);
+
+  /* a control response polled along with the handshakes, before the close
+   * request is waiting for it */
+  memset(&ai, 0, sizeof(ai));
+  ai.type = KERNEL_APPIN_STATUS_CONN_CLOSE;
+  ai.data.status.opaque = copaque;
+  test_assert("harness_ain_push close", harness_ain_push(0, &ai) == 0);
+
+  n = rdma_conn_poll(evs, 4, 0);
+  test_assert("three handshakes done", n == 3);
+  test_assert("connect fd", evs[0].fd == cfd && evs[0].status == 0);
+  test_assert("connect mr", evs[0].mr_base != NULL &&
+      evs[0].mr_len == TEST_MRLEN);
+  test_assert("failed fd", evs[1].fd == ffd && evs[1].status == -1);
+  test_assert("accept fd", evs[2].fd == afd && evs[2].status == 0);
+  test_assert("accept mr", evs[2].mr_base != NULL &&
+      evs[2].mr_len == TEST_MRLEN);
+
+  n = rdma_conn_poll(evs, 4, 0);
+  test_assert("no more handshakes", n == 0);
+
+  /* close picks up the response kept aside */
+  kernel_answer = 0;
+  test_assert("close with queued response", rdma_close(cfd) == 0);
+  kernel_answer = 1;
+  test_assert("close accepted", rdma_close(afd) == 0);
+
+  /* failed fd was released */
+  test_assert("write on failed fd", rdma_write(ffd, 8, 0, 0) == -1);
+}
+
+int main(int argc, char *argv[])
+{
+  int ret = 0;
+
+  struct harness_params params;
+  params.num_ctxs = 1;
+  params.fp_cores = 2;
+  params.arx_len = 1024;
+  params.atx_len = 1024;
+  params.ain_len = 1024;
+  params.aout_len = 1024;
+
+  harness_prepare(&params);
+
+  if (test_subcase("fd reuse after close", test_fd_reuse, NULL))
+    ret = 1;
+
+  if (test_subcase("async connect and accept", test_async, NULL))
+    ret = 1;
+
+  if (test_subcase("cq poll unsignaled", test_cq_unsignaled, NULL))
+    ret = 1;
+
+  if (test_subcase("shared cq destroy", test_scq_destroy, NULL))
+    ret = 1;
+
+  return ret;
+}
@@ -16,9 +16,9 @@ int main()
   remoteaddr.sin_port = htons(5005);
 
   void *mr_base;
-  uint32_t mr_len;
+  uint32_t mr_len = 0;
 
-  int fd = rdma_connect(&remoteaddr, &mr_base, &mr_len);
+  int fd = rdma_connect(&remoteaddr, 0, &mr_base, &mr_len);
 
   if (fd < 0)
     fprintf(stderr, "Connection failed\n");
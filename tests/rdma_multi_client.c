@@ -13,6 +13,7 @@
 #define MESSAGE_SIZE        64
 #define MRSIZE              64*1024
 #define WQSIZE              1024
+#define CONNECT_WINDOW      1024    // Handshakes in flight
 
 #define EXEC_LEN 120
 #define ITERATION 5000000
@@ -22,6 +23,7 @@
 #define HIST_BUCKETS 499
 
 int fd[NUM_CONNECTIONS];
+int fd_index[1 << 16];
 void* mr_base[NUM_CONNECTIONS];
 uint32_t mr_len[NUM_CONNECTIONS];
 int count[NUM_CONNECTIONS];
@@ -157,6 +159,15 @@ int main(int argc, char* argv[])
     fprintf(stderr, "conns: %d, msg: %u, pend_msg: %d\n", num_conns, msg_len, pending_msgs);
 
     rdma_init();
+
+    // All connections use one memory region instead of a private one each
+    void* shared_mr;
+    if (rdma_share_mr(MRSIZE, &shared_mr) != 0)
+    {
+        fprintf(stderr, "Shared memory region failed\n");
+        return -1;
+    }
+
     struct sockaddr_in remoteaddr;
     remoteaddr.sin_family = AF_INET;
     remoteaddr.sin_addr.s_addr = inet_addr(rip);
@@ -168,15 +179,40 @@ int main(int argc, char* argv[])
     struct timings latency_time[num_conns];
     memset(latency_time, 0, sizeof(struct timings) * num_conns);
 
-    for (int i = 0; i < num_conns; i++)
+    // Keep up to CONNECT_WINDOW handshakes in flight
+    struct rdma_conn_ev conn_ev[64];
+    int started = 0, established = 0;
+    while (established < num_conns)
     {
-        fd[i] = rdma_connect(&remoteaddr, &mr_base[i], &mr_len[i]);
+        for (; started < num_conns && started - established < CONNECT_WINDOW;
+            started++)
+        {
+            fd[started] = rdma_connect_async(&remoteaddr, 0, 0);
+            if (fd[started] < 0)
+            {
+                fprintf(stderr, "Connection failed\n");
+                return -1;
+            }
+            fd_index[fd[started]] = started;
+        }
 
-        if (fd[i] < 0)
+        int n = rdma_conn_poll(conn_ev, 64, -1);
+        if (n < 0)
         {
             fprintf(stderr, "Connection failed\n");
             return -1;
         }
+        for (int j = 0; j < n; j++)
+        {
+            if (conn_ev[j].status != 0)
+            {
+                fprintf(stderr, "Connection failed\n");
+                return -1;
+            }
+            mr_base[fd_index[conn_ev[j].fd]] = conn_ev[j].mr_base;
+            mr_len[fd_index[conn_ev[j].fd]] = conn_ev[j].mr_len;
+            established++;
+        }
     }
 
     fprintf(stderr, "SRoCE Connections established: %d\n", num_conns);
@@ -192,7 +228,8 @@ int main(int argc, char* argv[])
     count[0] = pending_msgs;
     for (int i = 1; i < num_conns; i++)
     {
-        memcpy(mr_base[i], mr_base[0], mr_len[0]);
+        if (mr_base[i] != mr_base[0])
+            memcpy(mr_base[i], mr_base[0], mr_len[0]);
         count[i] = pending_msgs;
     }
 
@@ -10,6 +10,8 @@
 #define NUM_CONNECTIONS     65535
 #define MESSAGE_SIZE        64
 #define NUM_PENDING_MSGS    63
+#define MRSIZE              64*1024
+#define ACCEPT_WINDOW       1024    // Accepts in flight
 
 int fd[NUM_CONNECTIONS];
 void* mr_base[NUM_CONNECTIONS];
@@ -26,21 +28,54 @@ int main(int argc, char* argv[])
     fprintf(stderr, "Params: ip=%s port=%d conns=%d\n", ip, port, num_connections);
 
     rdma_init();
-    struct sockaddr_in localaddr, remoteaddr;
+
+    // All connections use one memory region instead of a private one each
+    void* shared_mr;
+    if (rdma_share_mr(MRSIZE, &shared_mr) != 0)
+    {
+        fprintf(stderr, "Shared memory region failed\n");
+        return -1;
+    }
+
+    struct sockaddr_in localaddr;
     localaddr.sin_family = AF_INET;
     localaddr.sin_addr.s_addr = inet_addr(ip);
     localaddr.sin_port = htons(port);
     int lfd = rdma_listen(&localaddr, 1024);
 
-    for (int i = 0; i < num_connections; i++)
+    // Keep up to ACCEPT_WINDOW accepts in flight
+    struct rdma_conn_ev conn_ev[64];
+    int started = 0, established = 0;
+    while (established < num_connections)
     {
-        fd[i] = rdma_accept(lfd, &remoteaddr, &mr_base[i], &mr_len[i]);
+        for (; started < num_connections &&
+            started - established < ACCEPT_WINDOW; started++)
+        {
+            if (rdma_accept_async(lfd, 0, 0) < 0)
+            {
+                fprintf(stderr, "Connection failed\n");
+                return -1;
+            }
+        }
 
-        if (fd[i] < 0)
+        int n = rdma_conn_poll(conn_ev, 64, -1);
+        if (n < 0)
         {
             fprintf(stderr, "Connection failed\n");
             return -1;
         }
+        for (int j = 0; j < n; j++)
+        {
+            if (conn_ev[j].status != 0)
+            {
+                fprintf(stderr, "Connection failed\n");
+                return -1;
+            }
+            fd[established] = conn_ev[j].fd;
+            mr_base[established] = conn_ev[j].mr_base;
+            mr_len[established] = conn_ev[j].mr_len;
+            established++;
+        }
     }
 
     fprintf(stderr, "Connections established: %d\n", num_connections);
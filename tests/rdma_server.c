@@ -18,10 +18,10 @@ int main()
     localaddr.sin_port = htons(5005);
 
     void *mr_base;
-    uint32_t mr_len;
+    uint32_t mr_len = 0;
 
     int lfd = rdma_listen(&localaddr, 8);
-    int fd = rdma_accept(lfd, &remoteaddr, &mr_base, &mr_len);
+    int fd = rdma_accept(lfd, &remoteaddr, 0, &mr_base, &mr_len);
 
     if (fd < 0)
         fprintf(stderr, "Connection failed\n");
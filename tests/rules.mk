@@ -24,6 +24,7 @@ TESTS_SOCKETS := \
 TESTS_AUTO := \
   tests/libtas/tas_ll \
   tests/libtas/tas_sockets \
+  tests/libtas/tas_rdma \
   tests/tas_unit/fastpath
 
 # full unit tests
@@ -62,12 +63,17 @@ tests/libtas/tas_sockets: CPPFLAGS += -Ilib/sockets/include/
 tests/libtas/tas_sockets: tests/libtas/tas_sockets.o tests/libtas/harness.o \
   tests/testutils.o lib/libtas_sockets.so
 
-tests/tas_unit/fastpath: CPPFLAGS+= -Itas/include $(DPDK_CPPFLAGS)
+tests/libtas/tas_rdma: CPPFLAGS += -Ilib/tas/include/ -Ilib/rdma/include/
+tests/libtas/tas_rdma: tests/libtas/tas_rdma.o tests/libtas/harness.o \
+  tests/testutils.o lib/libtas_rdma.so
+
+tests/tas_unit/fastpath: CPPFLAGS+= -Itas/include -Ilib/rdma/include \
+  $(DPDK_CPPFLAGS)
 tests/tas_unit/fastpath: CFLAGS+= $(DPDK_CFLAGS)
 tests/tas_unit/fastpath: LDFLAGS+= $(DPDK_LDFLAGS)
 tests/tas_unit/fastpath: LDLIBS+= -lrte_eal
 tests/tas_unit/fastpath: tests/tas_unit/fastpath.o tests/testutils.o \
-  tas/fast/fast_flows.o tas/fast/fast_rdma.o
+  tas/fast/fast_flows.o tas/fast/fast_rdma.o tas/fast/fast_appctx.o
 
 tests/full/%.o: CPPFLAGS+=-Ilib/tas/include
 tests/full/tas_linux: tests/full/tas_linux.o tests/full/fulltest.o lib/libtas.so
@@ -82,6 +88,7 @@ tests-rdma: $(TESTS_RDMA)
 run-tests: $(TESTS_AUTO)
 	tests/libtas/tas_ll
 	tests/libtas/tas_sockets
+	tests/libtas/tas_rdma
 	tests/tas_unit/fastpath
 
 # run full tests that run full TAS
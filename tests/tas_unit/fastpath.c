@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 
 #include "../testutils.h"
@@ -11,6 +12,8 @@
 
 #include <tas.h>
 #include <tas_memif.h>
+#include <tas_rdma.h>
+#include <packet_defs.h>
 #include "../../tas/include/config.h"
 #include "../../tas/fast/internal.h"
 #include "../../tas/fast/fastemu.h"
@@ -88,6 +91,41 @@ static void flow_init(uint32_t fid, uint32_t rxlen, uint32_t txlen, uint64_t opa
   fs->rtt_est = 18;
 }
 
+/* initialize rdma queues and memory region of a flow */
+static void rdma_flow_init(uint32_t fid, uint32_t wqlen, uint32_t mrlen)
+{
+  struct flextcp_pl_flowst *fs = &state_base.flowst[fid];
+
+  /* tas_shm is NULL, so dma addresses are plain pointers */
+  config.shm_len = UINT64_MAX;
+
+  memset(fs, 0, sizeof(*fs));
+  flow_init(fid, 4096, 4096, fid);
+  fs->wq_base = (uintptr_t) test_zalloc(2 * wqlen +
+      wqlen / sizeof(struct rdma_wqe) * RDMA_WQE_EXT_LEN);
+  fs->rq_base = (uintptr_t) test_zalloc(wqlen);
+  fs->mr_base = (uintptr_t) test_zalloc(mrlen);
+  fs->wq_len = wqlen;
+  fs->mr_len = mrlen;
+  memset(state_base.flow_mrs[fid], 0, sizeof(state_base.flow_mrs[fid]));
+}
+
+/* place stream bytes in the flow's rx buffer and parse them */
+static void rdma_deliver(struct dataplane_context *ctx, uint32_t fid,
+    const uint8_t *buf, uint32_t len)
+{
+  struct flextcp_pl_flowst *fs = &state_base.flowst[fid];
+  uint8_t *rxb = (uint8_t *) (uintptr_t) fs->rx_base_sp;
+  uint32_t pos = fs->rx_next_pos, part;
+
+  part = MIN(len, fs->rx_len - pos);
+  memcpy(rxb + pos, buf, part);
+  memcpy(rxb, buf + part, len - part);
+  fs->rx_avail -= len;
+  fs->rx_next_pos = (pos + len) % fs->rx_len;
+  fast_rdmarq_bump(ctx, fs, pos, len);
+}
+
 /* alloc dummy mbuf */
 static struct rte_mbuf *mbuf_alloc(void)
 {
@@ -287,6 +325,1198 @@ void test_retransmit(void *arg)
       (QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL));
 }
 
+void test_rdma_read(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_hdr *hdr;
+  uint8_t buf[2048];
+  uint16_t len;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  test_randinit((uint8_t *) (uintptr_t) resp->mr_base + 256, 512);
+
+  /* requester posts read of 512 bytes from remote 256 to local 1024 */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  wqe->id = 0;
+  wqe->type = RDMA_OP_READ;
+  wqe->status = RDMA_PENDING;
+  wqe->flags = RDMA_WQE_SIGNALED;
+  wqe->loff = 1024;
+  wqe->roff = 256;
+  wqe->len = 512;
+  req->wq_head = sizeof(*wqe);
+
+  fast_rdma_poll(&ctx, req);
+  test_assert("request queued", req->wq_tail == sizeof(*wqe) &&
+      wqe->status == RDMA_TX_PENDING);
+  test_assert("request is header only", req->tx_avail == sizeof(*hdr));
+
+  len = req->tx_avail;
+  fast_rdma_txfill(req, buf, len);
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("request type", hdr->type == (RDMA_REQUEST | RDMA_READ));
+  test_assert("request fields", f_beui32(hdr->offset) == 256 &&
+      f_beui32(hdr->length) == 512);
+  test_assert("awaiting response", wqe->status == RDMA_RESP_PENDING);
+
+  /* responder parses request and serves data from its memory region */
+  rdma_deliver(&ctx, 1, buf, len);
+  test_assert("request received", resp->rq_head == sizeof(*wqe));
+  test_assert("rx buffer freed", resp->rx_avail == 4096);
+
+  fast_rdma_poll(&ctx, resp);
+  test_assert("response queued", resp->tx_avail == sizeof(*hdr) + 512);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  test_assert("response type", hdr->type == (RDMA_RESPONSE | RDMA_READ) &&
+      hdr->status == RDMA_SUCCESS && f_beui32(hdr->length) == 512);
+  test_assert("response payload", memcmp(buf + sizeof(*hdr),
+        (uint8_t *) (uintptr_t) resp->mr_base + 256, 512) == 0);
+
+  /* requester receives response in two parts */
+  rdma_deliver(&ctx, 0, buf, 10);
+  test_assert("not completed on partial header", req->cq_head == 0);
+  rdma_deliver(&ctx, 0, buf + 10, len - 10);
+  test_assert("data placed", memcmp((uint8_t *) (uintptr_t) req->mr_base +
+        1024, (uint8_t *) (uintptr_t) resp->mr_base + 256, 512) == 0);
+  test_assert("read completed", req->cq_head == sizeof(*wqe) &&
+      wqe->status == RDMA_SUCCESS);
+  test_assert("completion notified", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].type == FLEXTCP_PL_ARX_RDMAUPDATE &&
+      ctx.arx_cache[0].msg.rdmaupdate.cq_head == sizeof(*wqe));
+}
+
+void test_rdma_write_segmented(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_hdr *hdr;
+  uint8_t buf[1448];
+  uint32_t total, len;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 16384);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 16384);
+  test_randinit((uint8_t *) (uintptr_t) req->mr_base, 10000);
+
+  /* single write spanning several segments */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  wqe->id = 0;
+  wqe->type = RDMA_OP_WRITE;
+  wqe->status = RDMA_PENDING;
+  wqe->loff = 0;
+  wqe->roff = 4096;
+  wqe->len = 10000;
+  req->wq_head = sizeof(*wqe);
+
+  fast_rdma_poll(&ctx, req);
+  test_assert("whole write queued", req->tx_avail == sizeof(*hdr) + 10000);
+
+  total = req->tx_avail;
+  while (total > 0) {
+    len = MIN(total, sizeof(buf));
+    fast_rdma_txfill(req, buf, len);
+    total -= len;
+    if (total > 0) {
+      test_assert("partial offset kept", req->txb_pos_sent ==
+          sizeof(*hdr) + 10000 - total);
+      test_assert("still transmitting", wqe->status == RDMA_TX_PENDING);
+    }
+    rdma_deliver(&ctx, 1, buf, len);
+  }
+  test_assert("transmitted", req->txb_pos_sent == 0 &&
+      req->txb_pos == req->txb_head && wqe->status == RDMA_RESP_PENDING);
+  test_assert("write received", resp->rq_head == sizeof(*wqe));
+  test_assert("data placed", memcmp((uint8_t *) (uintptr_t) resp->mr_base +
+        4096, (uint8_t *) (uintptr_t) req->mr_base, 10000) == 0);
+
+  /* header split across segments */
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  test_assert("write response is header only", len == sizeof(*hdr));
+  fast_rdma_txfill(resp, buf, 5);
+  test_assert("partial header", resp->txb_pos_sent == 5);
+  fast_rdma_txfill(resp, buf + 5, len - 5);
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("response type", hdr->type == (RDMA_RESPONSE | RDMA_WRITE) &&
+      hdr->status == RDMA_SUCCESS);
+
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("write completed", req->cq_head == sizeof(*wqe) &&
+      wqe->status == RDMA_SUCCESS);
+}
+
+void test_rdma_direct_place(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[16 + 3000];
+  uint32_t len = 16 + 3000;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  test_randinit((uint8_t *) (uintptr_t) req->mr_base, 3000);
+
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  wqe->id = 0;
+  wqe->type = RDMA_OP_WRITE;
+  wqe->status = RDMA_PENDING;
+  wqe->loff = 0;
+  wqe->roff = 1000;
+  wqe->len = 3000;
+  req->wq_head = sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  fast_rdma_txfill(req, buf, len);
+
+  /* in-order segments bypass the rx buffer, the header may be split */
+  fast_rdmarq_place(&ctx, resp, buf, 10);
+  test_assert("partial header kept", resp->pending_rq_state == 10);
+  fast_rdmarq_place(&ctx, resp, buf + 10, 1000);
+  test_assert("rx buffer untouched", resp->rx_avail == 4096 &&
+      resp->rx_next_pos == 0);
+
+  /* staged data continues the same message */
+  rdma_deliver(&ctx, 1, buf + 1010, 1000);
+  fast_rdmarq_place(&ctx, resp, buf + 2010, len - 2010);
+  test_assert("write received", resp->rq_head == sizeof(*wqe) &&
+      resp->rx_avail == 4096);
+  test_assert("data placed", memcmp((uint8_t *) (uintptr_t) resp->mr_base +
+        1000, (uint8_t *) (uintptr_t) req->mr_base, 3000) == 0);
+}
+
+void test_rdma_unsignaled(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[256];
+  uint32_t len;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+
+  /* only the last of three writes is signaled */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  for (i = 0; i < 3; i++) {
+    wqe[i].id = i * sizeof(*wqe);
+    wqe[i].type = RDMA_OP_WRITE;
+    wqe[i].status = RDMA_PENDING;
+    wqe[i].flags = (i == 2 ? RDMA_WQE_SIGNALED : 0);
+    wqe[i].loff = 0;
+    wqe[i].roff = (i == 1 ? 4096 : 0);
+    wqe[i].len = 8;
+  }
+  req->wq_head = 3 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  fast_rdma_txfill(req, buf, len);
+  rdma_deliver(&ctx, 1, buf, len);
+
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+
+  /* first response completes silently, failures are always reported */
+  rdma_deliver(&ctx, 0, buf, 16);
+  test_assert("unsignaled retired", req->cq_head == sizeof(*wqe) &&
+      ctx.arx_num == 0);
+  rdma_deliver(&ctx, 0, buf + 16, 16);
+  test_assert("failure notified", wqe[1].status == RDMA_OUT_OF_BOUNDS &&
+      ctx.arx_num == 1);
+  rdma_deliver(&ctx, 0, buf + 32, 16);
+  test_assert("signaled merged", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].msg.rdmaupdate.cq_head == 3 * sizeof(*wqe));
+}
+
+void test_rdma_txlog_len(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[256];
+  uint32_t len;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  req->tx_len = RDMA_TXLOG_LEN(req->wq_len);
+  resp->tx_len = RDMA_TXLOG_LEN(resp->wq_len);
+
+  /* both flows fill their work queue with writes */
+  for (i = 0; i < 3; i++) {
+    wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base + i;
+    wqe->id = i * sizeof(*wqe);
+    wqe->type = RDMA_OP_WRITE;
+    wqe->len = 8;
+    wqe = (struct rdma_wqe *) (uintptr_t) resp->wq_base + i;
+    wqe->id = i * sizeof(*wqe);
+    wqe->type = RDMA_OP_WRITE;
+    wqe->len = 8;
+  }
+  resp->wq_head = 3 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+
+  /* requests fill the receive queue before the own writes are queued */
+  rdma_deliver(&ctx, 0, buf, len);
+  req->wq_head = 3 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  test_assert("responses logged", req->rq_tail == req->rq_head &&
+      req->rq_tail == 3 * sizeof(*wqe));
+  test_assert("writes logged", req->wq_tail == req->wq_head);
+  test_assert("log entries", req->txb_head == 6 * sizeof(uint32_t));
+  test_assert("all exposed", req->tx_avail == 3 * 16 + len);
+}
+
+void test_rdma_notify_merge(void *arg)
+{
+  struct flextcp_pl_flowst *fs;
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[2][256];
+  uint32_t f, len;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  for (f = 0; f < 4; f++)
+    rdma_flow_init(f, 4 * sizeof(*wqe), 4096);
+  /* flow 2 has the opaque of flow 0, but belongs to another app context */
+  state_base.flowst[2].opaque = state_base.flowst[0].opaque;
+  state_base.flowst[2].db_id = 1;
+
+  /* flows 0 and 2 each post two signaled writes, to flows 1 and 3 */
+  for (f = 0; f < 4; f += 2) {
+    fs = &state_base.flowst[f];
+    wqe = (struct rdma_wqe *) (uintptr_t) fs->wq_base;
+    for (i = 0; i < 2; i++) {
+      wqe[i].id = i * sizeof(*wqe);
+      wqe[i].type = RDMA_OP_WRITE;
+      wqe[i].status = RDMA_PENDING;
+      wqe[i].flags = RDMA_WQE_SIGNALED;
+      wqe[i].loff = 0;
+      wqe[i].roff = 0;
+      wqe[i].len = 8;
+    }
+    fs->wq_head = 2 * sizeof(*wqe);
+    fast_rdma_poll(&ctx, fs);
+    len = fs->tx_avail;
+    fast_rdma_txfill(fs, buf[f / 2], len);
+    rdma_deliver(&ctx, f + 1, buf[f / 2], len);
+
+    fs = &state_base.flowst[f + 1];
+    fast_rdma_poll(&ctx, fs);
+    len = fs->tx_avail;
+    fast_rdma_txfill(fs, buf[f / 2], len);
+  }
+  test_assert("nothing notified yet", ctx.arx_num == 0);
+
+  /* responses of both flows arrive interleaved in one batch */
+  for (i = 0; i < 2; i++) {
+    rdma_deliver(&ctx, 0, buf[0] + i * 16, 16);
+    rdma_deliver(&ctx, 2, buf[1] + i * 16, 16);
+  }
+  test_assert("one update per flow", ctx.arx_num == 2);
+  test_assert("flow 0 latest", ctx.arx_ctx[0] == 0 &&
+      ctx.arx_cache[0].msg.rdmaupdate.opaque == state_base.flowst[0].opaque &&
+      ctx.arx_cache[0].msg.rdmaupdate.cq_head == 2 * sizeof(*wqe));
+  test_assert("flow 2 latest", ctx.arx_ctx[1] == 1 &&
+      ctx.arx_cache[1].msg.rdmaupdate.opaque == state_base.flowst[2].opaque &&
+      ctx.arx_cache[1].msg.rdmaupdate.cq_head == 2 * sizeof(*wqe));
+}
+
+void test_arx_deferred(void *arg)
+{
+  struct flextcp_pl_appctx *actx = &state_base.appctx[0][1];
+  struct dataplane_context ctx;
+  struct flextcp_pl_arx *rxq;
+  uint16_t id;
+  unsigned n;
+
+  config.shm_len = UINT64_MAX;
+  memset(&ctx, 0, sizeof(ctx));
+
+  /* app rx queue of context 1 with room for one notification */
+  rxq = test_zalloc(2 * sizeof(*rxq));
+  memset(actx, 0, sizeof(*actx));
+  actx->rx_base = (uintptr_t) rxq;
+  actx->rx_len = 2 * sizeof(*rxq);
+  actx->rx_avail = sizeof(*rxq);
+
+  id = arx_cache_slot(&ctx, 1, 10);
+  ctx.arx_cache[id].msg.rdmaupdate.cq_head = 64;
+  id = arx_cache_slot(&ctx, 1, 20);
+  ctx.arx_cache[id].msg.rdmaupdate.cq_head = 64;
+
+  n = arx_cache_flush(&ctx, 0);
+  test_assert("first delivered", n == 1 && rxq[0].type ==
+      FLEXTCP_PL_ARX_RDMAUPDATE && rxq[0].msg.rdmaupdate.opaque == 10);
+  test_assert("second deferred", ctx.arx_num == 0 && ctx.arx_ovf_num == 1 &&
+      actx->cnt_arx_deferred == 1);
+
+  /* nothing delivered is no progress, the core may go idle */
+  n = arx_cache_flush(&ctx, 0);
+  test_assert("retry without space", n == 0 && ctx.arx_ovf_num == 1);
+
+  /* a newer update replaces the deferred one instead of overtaking it */
+  id = arx_cache_slot(&ctx, 1, 20);
+  ctx.arx_cache[id].msg.rdmaupdate.cq_head = 128;
+  n = arx_cache_flush(&ctx, 0);
+  test_assert("newer deferred", n == 0 && ctx.arx_num == 0 &&
+      ctx.arx_ovf_num == 1 && actx->cnt_arx_deferred == 2 &&
+      ctx.arx_ovf[0].msg.rdmaupdate.cq_head == 128);
+
+  /* app frees its queue */
+  actx->rx_avail = 2 * sizeof(*rxq);
+  n = arx_cache_flush(&ctx, 0);
+  test_assert("deferred delivered", n == 1 && ctx.arx_ovf_num == 0 &&
+      rxq[1].msg.rdmaupdate.opaque == 20 &&
+      rxq[1].msg.rdmaupdate.cq_head == 128);
+}
+
+void test_rdma_invalid_wqe(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[256];
+  uint32_t len;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+
+  /* invalid WQE with nothing outstanding completes right away */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 3 * sizeof(*wqe));
+  wqe[0].type = RDMA_OP_WRITE;
+  wqe[0].loff = 4090;
+  wqe[0].len = 8;
+  req->wq_head = sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  test_assert("nothing queued", req->tx_avail == 0);
+  test_assert("invalid completed", wqe[0].status == RDMA_OUT_OF_BOUNDS &&
+      req->cq_head == sizeof(*wqe));
+  test_assert("invalid notified", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].msg.rdmaupdate.cq_head == sizeof(*wqe));
+
+  /* trailing invalid WQE completes with the write before it */
+  memset(&ctx, 0, sizeof(ctx));
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_WRITE;
+  wqe[1].len = 8;
+  wqe[2].id = 2 * sizeof(*wqe);
+  wqe[2].type = 0xff;
+  req->wq_head = 3 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  test_assert("waits for write", wqe[2].status == RDMA_OUT_OF_BOUNDS &&
+      req->cq_head == sizeof(*wqe) && ctx.arx_num == 0);
+
+  len = req->tx_avail;
+  fast_rdma_txfill(req, buf, len);
+  rdma_deliver(&ctx, 1, buf, len);
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("both completed", wqe[1].status == RDMA_SUCCESS &&
+      req->cq_head == 3 * sizeof(*wqe));
+  test_assert("trailing invalid notified", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].msg.rdmaupdate.cq_head == 3 * sizeof(*wqe));
+}
+
+void test_rdma_rq_full(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[256];
+  uint8_t *mr, *rxb;
+  uint32_t len, held;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  test_randinit((uint8_t *) (uintptr_t) req->mr_base, 64);
+  mr = (uint8_t *) (uintptr_t) resp->mr_base;
+  rxb = (uint8_t *) (uintptr_t) resp->rx_base_sp;
+
+  /* write while all response queue entries await an ack, then a read */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 2 * sizeof(*wqe));
+  wqe[0].type = RDMA_OP_WRITE;
+  wqe[0].len = 64;
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_READ;
+  wqe[1].len = 8;
+  req->wq_head = 2 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  fast_rdma_txfill(req, buf, len);
+
+  /* parsed from the packet, everything behind the write header is held */
+  resp->rq_head = resp->rq_tail = 3 * sizeof(*wqe);
+  fast_rdmarq_place(&ctx, resp, buf, len);
+  held = len - sizeof(struct rdma_hdr);
+  test_assert("write held", fast_rdmarq_stalled(resp) &&
+      resp->rq_head == 3 * sizeof(*wqe) && mr[0] == 0);
+  test_assert("window shrunk", resp->rx_avail == 4096 - held &&
+      resp->rx_next_pos == held &&
+      memcmp(rxb, buf + sizeof(struct rdma_hdr), held) == 0);
+
+  /* no entry freed yet, resuming keeps the request waiting */
+  fast_rdmarq_bump(&ctx, resp, resp->rx_next_pos, 0);
+  test_assert("still held", fast_rdmarq_stalled(resp) &&
+      resp->rx_avail == 4096 - held);
+
+  /* acks free entries, both requests are processed */
+  resp->rqe_ack_pos = 2 * sizeof(*wqe);
+  fast_rdmarq_bump(&ctx, resp, resp->rx_next_pos, 0);
+  test_assert("write placed", !fast_rdmarq_stalled(resp) &&
+      memcmp(mr, (uint8_t *) (uintptr_t) req->mr_base, 64) == 0);
+  test_assert("read received", resp->rq_head == sizeof(*wqe) &&
+      resp->pending_rq_state == 0 && resp->rx_avail == 4096);
+}
+
+void test_rdma_resp_mismatch(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_hdr hdr;
+  uint8_t buf[sizeof(hdr) + 8];
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+
+  /* read and write awaiting their responses */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 2 * sizeof(*wqe));
+  wqe[0].type = RDMA_OP_READ;
+  wqe[0].len = 8;
+  wqe[0].status = RDMA_RESP_PENDING;
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_WRITE;
+  wqe[1].status = RDMA_RESP_PENDING;
+  wqe[1].flags = RDMA_WQE_SIGNALED;
+  req->wq_head = req->wq_tail = 2 * sizeof(*wqe);
+
+  /* read response for an unknown id, its data is skipped */
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = RDMA_RESPONSE | RDMA_READ;
+  hdr.id = t_beui32(3 * sizeof(*wqe));
+  hdr.length = t_beui32(8);
+  memcpy(buf, &hdr, sizeof(hdr));
+  memset(buf + sizeof(hdr), 0xff, 8);
+  rdma_deliver(&ctx, 0, buf, sizeof(buf));
+  test_assert("unknown id counted", req->cnt_rx_resp_errs == 1 &&
+      req->pending_rq_state == 0 && req->rx_avail == 4096 &&
+      req->cq_head == 0 && wqe[0].status == RDMA_RESP_PENDING);
+
+  /* write response skips the read, which fails */
+  hdr.type = RDMA_RESPONSE | RDMA_WRITE;
+  hdr.status = RDMA_SUCCESS;
+  hdr.id = t_beui32(sizeof(*wqe));
+  hdr.length = t_beui32(0);
+  rdma_deliver(&ctx, 0, (uint8_t *) &hdr, sizeof(hdr));
+  test_assert("read failed", req->cnt_rx_resp_errs == 2 &&
+      wqe[0].status == RDMA_CONN_FAILURE && wqe[1].status == RDMA_SUCCESS);
+  test_assert("both completed", req->cq_head == 2 * sizeof(*wqe) &&
+      ctx.arx_num == 1);
+}
+
+void test_rdma_unsignaled_failed(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_hdr hdr;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+
+  /* unsignaled failed WQE still at cq_head, retired by the successful
+   * unsignaled write behind it */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 2 * sizeof(*wqe));
+  wqe[0].type = RDMA_OP_WRITE;
+  wqe[0].status = RDMA_OUT_OF_BOUNDS;
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_WRITE;
+  wqe[1].status = RDMA_RESP_PENDING;
+  req->wq_head = req->wq_tail = 2 * sizeof(*wqe);
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = RDMA_RESPONSE | RDMA_WRITE;
+  hdr.status = RDMA_SUCCESS;
+  hdr.id = t_beui32(sizeof(*wqe));
+  rdma_deliver(&ctx, 0, (uint8_t *) &hdr, sizeof(hdr));
+  test_assert("both retired", req->cq_head == 2 * sizeof(*wqe) &&
+      wqe[1].status == RDMA_SUCCESS);
+  test_assert("failure notified", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].msg.rdmaupdate.cq_head == 2 * sizeof(*wqe));
+}
+
+void test_rdma_send_recv(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe, *rcv;
+  struct rdma_hdr *hdr;
+  uint8_t buf[512];
+  uint32_t len;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  test_randinit((uint8_t *) (uintptr_t) req->mr_base, 200);
+
+  /* responder posts a single receive buffer of 256 bytes at 2048 */
+  rcv = (struct rdma_wqe *) (uintptr_t) (resp->wq_base + resp->wq_len);
+  rcv->id = 0;
+  rcv->type = RDMA_OP_RECV;
+  rcv->status = RDMA_PENDING;
+  rcv->loff = 2048;
+  rcv->len = 256;
+  fast_rdmarcv_bump(&ctx, 1, sizeof(*rcv));
+
+  /* two sends of 200 bytes, the second one finds no receive buffer */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  for (i = 0; i < 2; i++) {
+    wqe[i].id = i * sizeof(*wqe);
+    wqe[i].type = RDMA_OP_SEND;
+    wqe[i].status = RDMA_PENDING;
+    wqe[i].flags = RDMA_WQE_SIGNALED;
+    wqe[i].loff = 0;
+    wqe[i].roff = 1234;
+    wqe[i].len = 200;
+  }
+  req->wq_head = 2 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  test_assert("sends queued", len == 2 * (sizeof(*hdr) + 200));
+  fast_rdma_txfill(req, buf, len);
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("send header", hdr->type == (RDMA_REQUEST | RDMA_SEND) &&
+      f_beui32(hdr->offset) == 0);
+
+  rdma_deliver(&ctx, 1, buf, len);
+  test_assert("receive filled", resp->rcv_tail == sizeof(*rcv) &&
+      rcv->status == RDMA_SUCCESS && rcv->len == 200);
+  test_assert("message placed", memcmp((uint8_t *) (uintptr_t) resp->mr_base
+        + 2048, (uint8_t *) (uintptr_t) req->mr_base, 200) == 0);
+  test_assert("receive notified", ctx.arx_num >= 1 &&
+      ctx.arx_cache[ctx.arx_num - 1].msg.rdmaupdate.rcv_tail == sizeof(*rcv));
+
+  /* responses complete the sends */
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("send completed", wqe[0].status == RDMA_SUCCESS);
+  test_assert("send not ready", wqe[1].status == RDMA_RECV_NOT_READY &&
+      req->cq_head == 2 * sizeof(*wqe));
+}
+
+void test_rdma_atomic(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_hdr *hdr;
+  uint64_t *lmr, *rmr, *ops;
+  uint8_t buf[512];
+  uint32_t len;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  lmr = (uint64_t *) (uintptr_t) req->mr_base;
+  rmr = (uint64_t *) (uintptr_t) resp->mr_base;
+  rmr[2] = 0x100000005ULL;
+
+  /* fetch-add 3 and successful compare-and-swap on the same word, then a
+   * misaligned one; operands are taken from the WQE extension slots */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 3 * sizeof(*wqe));
+  ops = (uint64_t *) (uintptr_t) (req->wq_base + 2 * req->wq_len);
+  ops[0] = 3;
+  ops[RDMA_WQE_EXT_LEN / sizeof(*ops)] = 0x100000008ULL;
+  ops[RDMA_WQE_EXT_LEN / sizeof(*ops) + 1] = 42;
+  wqe[0].type = RDMA_OP_FETCH_ADD;
+  wqe[0].loff = 0;
+  wqe[0].roff = 16;
+  wqe[0].len = 8;
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_CMP_SWAP;
+  wqe[1].loff = 16;
+  wqe[1].roff = 16;
+  wqe[1].len = 16;
+  wqe[2].id = 2 * sizeof(*wqe);
+  wqe[2].type = RDMA_OP_FETCH_ADD;
+  wqe[2].flags = RDMA_WQE_SIGNALED;
+  wqe[2].loff = 32;
+  wqe[2].roff = 20;
+  wqe[2].len = 8;
+  req->wq_head = 3 * sizeof(*wqe);
+
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  test_assert("atomics queued", len == 3 * sizeof(*hdr) + 32);
+  fast_rdma_txfill(req, buf, len);
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("atomic header", hdr->type == (RDMA_REQUEST | RDMA_FETCH_ADD)
+      && f_beui32(hdr->offset) == 16 && f_beui32(hdr->length) == 8);
+
+  /* operands split across deliveries */
+  rdma_deliver(&ctx, 1, buf, sizeof(*hdr) + 4);
+  test_assert("not executed on partial operand", rmr[2] == 0x100000005ULL);
+  rdma_deliver(&ctx, 1, buf + sizeof(*hdr) + 4, len - sizeof(*hdr) - 4);
+  test_assert("atomics executed", rmr[2] == 42 &&
+      resp->rq_head == 3 * sizeof(*wqe));
+
+  /* responses are header only and carry the original value */
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  test_assert("responses queued", len == 3 * sizeof(*hdr));
+  fast_rdma_txfill(resp, buf, len);
+  test_assert("response header", hdr->type ==
+      (RDMA_RESPONSE | RDMA_FETCH_ADD) && f_beui32(hdr->offset) == 1 &&
+      f_beui32(hdr->length) == 5);
+
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("original values returned", lmr[0] == 0x100000005ULL &&
+      lmr[2] == 0x100000008ULL);
+  test_assert("atomics completed", wqe[0].status == RDMA_SUCCESS &&
+      wqe[1].status == RDMA_SUCCESS && req->cq_head == 3 * sizeof(*wqe));
+  test_assert("misaligned rejected", wqe[2].status == RDMA_OUT_OF_BOUNDS &&
+      rmr[3] == 0);
+  test_assert("operands not in memory region", lmr[1] == 0 && lmr[3] == 0);
+
+  /* operands of the wrong length fail the request, parsing continues */
+  resp->rqe_ack_pos = resp->rq_tail;
+  memset(buf, 0, sizeof(buf));
+  hdr->type = RDMA_REQUEST | RDMA_FETCH_ADD;
+  hdr->id = t_beui32(3 * sizeof(*wqe));
+  hdr->offset = t_beui32(16);
+  hdr->length = t_beui32(24);
+  hdr = (struct rdma_hdr *) (buf + sizeof(*hdr) + 24);
+  hdr->type = RDMA_REQUEST | RDMA_READ;
+  hdr->length = t_beui32(8);
+  rdma_deliver(&ctx, 1, buf, 2 * sizeof(*hdr) + 24);
+  wqe = (struct rdma_wqe *) (uintptr_t) resp->rq_base;
+  test_assert("wrong length failed", wqe[3].status == RDMA_OUT_OF_BOUNDS &&
+      rmr[2] == 42);
+  test_assert("next request parsed", resp->rq_head == sizeof(*wqe) &&
+      wqe[0].type == RDMA_OP_READ && resp->pending_rq_state == 0);
+}
+
+void test_rdma_write_sgl(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_sge *sgl;
+  struct rdma_hdr *hdr;
+  uint8_t *lmr, *rmr;
+  uint8_t buf[2048];
+  uint32_t total, len, *refs;
+  uint16_t zc;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  lmr = (uint8_t *) (uintptr_t) req->mr_base;
+  rmr = (uint8_t *) (uintptr_t) resp->mr_base;
+  test_randinit(lmr, 4096);
+
+  /* header of 24 bytes and a value of 1000 bytes written back to back; the
+   * second entry has an out of bounds segment */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 2 * sizeof(*wqe));
+  sgl = (struct rdma_sge *) (uintptr_t) (req->wq_base + 2 * req->wq_len);
+  sgl[0].loff = 3000;
+  sgl[0].len = 24;
+  sgl[1].loff = 500;
+  sgl[1].len = 1000;
+  wqe[0].type = RDMA_OP_WRITE;
+  wqe[0].flags = RDMA_WQE_SGL | RDMA_WQE_SIGNALED;
+  wqe[0].loff = 2;
+  wqe[0].roff = 100;
+  wqe[0].len = 1024;
+  sgl[RDMA_MAX_SGE].loff = 4000;
+  sgl[RDMA_MAX_SGE].len = 100;
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_WRITE;
+  wqe[1].flags = RDMA_WQE_SGL;
+  wqe[1].loff = 1;
+  wqe[1].len = 100;
+  req->wq_head = 2 * sizeof(*wqe);
+
+  fast_rdma_poll(&ctx, req);
+  test_assert("single message", req->tx_avail == sizeof(*hdr) + 1024);
+  test_assert("invalid segment rejected", wqe[1].status == RDMA_OUT_OF_BOUNDS);
+
+  /* zero-copy only within a segment */
+  test_assert("zc spans segments", fast_rdma_txzc(req, 1448, 256) == 0);
+  fast_rdma_txfill(req, buf, sizeof(*hdr) + 24 + 6);
+  zc = fast_rdma_txzc(req, 500, 256);
+  test_assert("zc in segment", zc == 500 &&
+      fast_rdma_txskip(req, zc, &refs) == req->mr_base + 500 + 6);
+  fast_rdma_txrewind(req);
+
+  /* gathered in odd sized parts */
+  for (total = 0; total < sizeof(*hdr) + 1024; total += len) {
+    len = MIN(sizeof(*hdr) + 1024 - total, 37);
+    fast_rdma_txfill(req, buf + total, len);
+  }
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("sgl header", hdr->type == (RDMA_REQUEST | RDMA_WRITE) &&
+      f_beui32(hdr->offset) == 100 && f_beui32(hdr->length) == 1024);
+
+  rdma_deliver(&ctx, 1, buf, total);
+  test_assert("segments placed contiguously",
+      memcmp(rmr + 100, lmr + 3000, 24) == 0 &&
+      memcmp(rmr + 124, lmr + 500, 1000) == 0);
+
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("sgl write completed", wqe[0].status == RDMA_SUCCESS &&
+      req->cq_head == 2 * sizeof(*wqe));
+}
+
+void test_rdma_write_imm(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe, *rcv;
+  struct rdma_hdr *hdr;
+  uint8_t buf[512];
+  uint32_t len;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  test_randinit((uint8_t *) (uintptr_t) req->mr_base, 100);
+
+  /* a single receive buffer is posted */
+  rcv = (struct rdma_wqe *) (uintptr_t) (resp->wq_base + resp->wq_len);
+  memset(rcv, 0, sizeof(*rcv));
+  rcv->type = RDMA_OP_RECV;
+  rcv->status = RDMA_PENDING;
+  fast_rdmarcv_bump(&ctx, 1, sizeof(*rcv));
+
+  /* two writes with immediate, the second one finds no receive buffer */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 2 * sizeof(*wqe));
+  for (i = 0; i < 2; i++) {
+    wqe[i].id = i * sizeof(*wqe);
+    wqe[i].type = RDMA_OP_WRITE_IMM;
+    wqe[i].flags = RDMA_WQE_SIGNALED;
+    wqe[i].loff = 0;
+    wqe[i].roff = 1000;
+    wqe[i].len = 100;
+    wqe[i].imm = 0xdeadbee0 + i;
+  }
+  req->wq_head = 2 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  test_assert("immediate queued", len == 2 * (sizeof(*hdr) + 4 + 100));
+  fast_rdma_txfill(req, buf, len);
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("immediate header", hdr->type == (RDMA_REQUEST | RDMA_WRITE) &&
+      f_beui16(hdr->flags) == RDMA_HDR_IMM &&
+      f_beui32(*(beui32_t *) (hdr + 1)) == 0xdeadbee0);
+
+  /* split within the immediate */
+  rdma_deliver(&ctx, 1, buf, sizeof(*hdr) + 2);
+  test_assert("not completed on partial immediate", resp->rcv_tail == 0);
+  rdma_deliver(&ctx, 1, buf + sizeof(*hdr) + 2, len - sizeof(*hdr) - 2);
+  test_assert("data placed", memcmp((uint8_t *) (uintptr_t) resp->mr_base +
+        1000, (uint8_t *) (uintptr_t) req->mr_base, 100) == 0);
+  test_assert("receive completed", resp->rcv_tail == sizeof(*rcv) &&
+      rcv->type == RDMA_OP_WRITE_IMM && rcv->status == RDMA_SUCCESS &&
+      rcv->imm == 0xdeadbee0 && rcv->loff == 1000 && rcv->len == 100);
+  test_assert("target notified", ctx.arx_num >= 1 &&
+      ctx.arx_cache[ctx.arx_num - 1].msg.rdmaupdate.rcv_tail == sizeof(*rcv));
+
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("write completed", wqe[0].status == RDMA_SUCCESS);
+  test_assert("write not ready", wqe[1].status == RDMA_RECV_NOT_READY &&
+      req->cq_head == 2 * sizeof(*wqe));
+}
+
+void test_rdma_write_inline(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_hdr *hdr;
+  uint8_t *ext, data[RDMA_MAX_INLINE];
+  uint8_t buf[512];
+  uint32_t len;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  test_randinit(data, sizeof(data));
+
+  /* payload in the extension slot of the second entry, loff is ignored;
+   * the third one is too long to be inline */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 3 * sizeof(*wqe));
+  ext = (uint8_t *) (uintptr_t) (req->wq_base + 2 * req->wq_len);
+  memcpy(ext + RDMA_WQE_EXT_LEN, data, sizeof(data));
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_WRITE;
+  wqe[1].flags = RDMA_WQE_INLINE | RDMA_WQE_SIGNALED;
+  wqe[1].loff = 4000;
+  wqe[1].roff = 200;
+  wqe[1].len = sizeof(data);
+  wqe[2].id = 2 * sizeof(*wqe);
+  wqe[2].type = RDMA_OP_WRITE;
+  wqe[2].flags = RDMA_WQE_INLINE;
+  wqe[2].len = RDMA_MAX_INLINE + 1;
+  req->cq_head = req->cq_tail = req->wq_tail = sizeof(*wqe);
+  req->wq_head = 3 * sizeof(*wqe);
+
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  test_assert("inline queued", len == sizeof(*hdr) + sizeof(data));
+  test_assert("too long rejected", wqe[2].status == RDMA_OUT_OF_BOUNDS);
+  fast_rdma_txfill(req, buf, 30);
+  fast_rdma_txfill(req, buf + 30, len - 30);
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("inline header", hdr->type == (RDMA_REQUEST | RDMA_WRITE) &&
+      f_beui32(hdr->offset) == 200 && f_beui32(hdr->length) == sizeof(data));
+  test_assert("inline payload", memcmp(buf + sizeof(*hdr), data,
+        sizeof(data)) == 0);
+
+  rdma_deliver(&ctx, 1, buf, len);
+  test_assert("inline placed", memcmp((uint8_t *) (uintptr_t) resp->mr_base +
+        200, data, sizeof(data)) == 0);
+
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("inline completed", wqe[1].status == RDMA_SUCCESS &&
+      req->cq_head == 3 * sizeof(*wqe));
+}
+
+void test_rdma_mr_keys(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct flextcp_pl_mr *lmr = &state_base.flow_mrs[0][2];
+  struct flextcp_pl_mr *rmr = &state_base.flow_mrs[1][1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_hdr *hdr;
+  uint8_t buf[1024];
+  uint32_t len;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  lmr->base = (uintptr_t) test_zalloc(256);
+  lmr->len = 256;
+  rmr->base = (uintptr_t) test_zalloc(128);
+  rmr->len = 128;
+  test_randinit((uint8_t *) (uintptr_t) lmr->base + 16, 64);
+
+  /* write from local key 2 to remote key 1, read it back into key 0, and
+   * write to remote key 3 that is not registered */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 3 * sizeof(*wqe));
+  wqe[0].type = RDMA_OP_WRITE;
+  wqe[0].loff = 16;
+  wqe[0].roff = 32;
+  wqe[0].len = 64;
+  wqe[0].lkey = 2;
+  wqe[0].rkey = 1;
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_READ;
+  wqe[1].roff = 32;
+  wqe[1].len = 64;
+  wqe[1].rkey = 1;
+  wqe[2].id = 2 * sizeof(*wqe);
+  wqe[2].type = RDMA_OP_WRITE;
+  wqe[2].len = 8;
+  wqe[2].rkey = 3;
+  req->wq_head = 3 * sizeof(*wqe);
+
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  test_assert("requests queued", len == 3 * sizeof(*hdr) + 64 + 8);
+  fast_rdma_txfill(req, buf, len);
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("remote key in header", hdr->key == 1);
+  test_assert("payload from local key", memcmp(buf + sizeof(*hdr),
+        (uint8_t *) (uintptr_t) lmr->base + 16, 64) == 0);
+
+  rdma_deliver(&ctx, 1, buf, len);
+  test_assert("placed in remote key", memcmp((uint8_t *) (uintptr_t)
+        rmr->base + 32, (uint8_t *) (uintptr_t) lmr->base + 16, 64) == 0);
+  test_assert("default region untouched", ((uint8_t *) (uintptr_t)
+        resp->mr_base)[32] == 0);
+
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("write completed", wqe[0].status == RDMA_SUCCESS);
+  test_assert("read back into key 0", wqe[1].status == RDMA_SUCCESS &&
+      memcmp((uint8_t *) (uintptr_t) req->mr_base, (uint8_t *) (uintptr_t)
+        lmr->base + 16, 64) == 0);
+  test_assert("unknown key rejected", wqe[2].status == RDMA_OUT_OF_BOUNDS &&
+      req->cq_head == 3 * sizeof(*wqe));
+}
+
+void test_rdma_mr_released(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct flextcp_pl_mr *lmr = &state_base.flow_mrs[0][2];
+  struct flextcp_pl_mr *rmr = &state_base.flow_mrs[1][1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  struct rdma_hdr *hdr;
+  uint8_t buf[512], zero[64];
+  uint32_t len;
+
+  memset(&ctx, 0, sizeof(ctx));
+  memset(zero, 0, sizeof(zero));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  lmr->base = (uintptr_t) test_zalloc(256);
+  lmr->len = 256;
+  rmr->base = (uintptr_t) test_zalloc(128);
+  rmr->len = 128;
+  test_randinit((uint8_t *) (uintptr_t) rmr->base, 64);
+  test_randinit((uint8_t *) (uintptr_t) resp->mr_base, 64);
+
+  /* read from remote key 1 into key 0, and from remote key 0 into key 2 */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, 2 * sizeof(*wqe));
+  wqe[0].type = RDMA_OP_READ;
+  wqe[0].len = 64;
+  wqe[0].rkey = 1;
+  wqe[1].id = sizeof(*wqe);
+  wqe[1].type = RDMA_OP_READ;
+  wqe[1].len = 64;
+  wqe[1].lkey = 2;
+  req->wq_head = 2 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  fast_rdma_txfill(req, buf, len);
+  rdma_deliver(&ctx, 1, buf, len);
+  fast_rdma_poll(&ctx, resp);
+
+  /* responder key released with the response queued */
+  rmr->len = 0;
+  test_assert("no zero-copy", fast_rdma_txzc(resp, sizeof(*hdr) + 64, 1)
+      == 0);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  hdr = (struct rdma_hdr *) buf;
+  test_assert("response failed", hdr->status == RDMA_OUT_OF_BOUNDS &&
+      memcmp(buf + sizeof(*hdr), zero, 64) == 0);
+
+  /* requester key released before the read data arrives */
+  lmr->len = 0;
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("first read failed", wqe[0].status == RDMA_OUT_OF_BOUNDS &&
+      memcmp((uint8_t *) (uintptr_t) req->mr_base, zero, 64) == 0);
+  test_assert("second read not placed", wqe[1].status == RDMA_OUT_OF_BOUNDS
+      && memcmp((uint8_t *) (uintptr_t) lmr->base, zero, 64) == 0);
+  test_assert("both completed", req->cq_head == 2 * sizeof(*wqe) &&
+      req->cnt_rx_resp_errs == 0);
+}
+
+void test_rdma_wq_detached(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[256];
+  uint64_t wq_base;
+  uint32_t len;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+
+  /* bumps on a flow without work queue are ignored */
+  wq_base = resp->wq_base;
+  resp->wq_base = 0;
+  fast_rdmawq_bump(&ctx, 1, sizeof(*wqe), 0);
+  test_assert("wq bump ignored", resp->wq_head == 0 && resp->tx_avail == 0);
+  fast_rdmarcv_bump(&ctx, 1, sizeof(*wqe));
+  test_assert("receive bump ignored", resp->rcv_head == 0);
+
+  /* it still serves requests, sends find no receive buffer */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  memset(wqe, 0, sizeof(*wqe));
+  wqe->type = RDMA_OP_SEND;
+  wqe->len = 16;
+  req->wq_head = sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  fast_rdma_txfill(req, buf, len);
+  rdma_deliver(&ctx, 1, buf, len);
+  fast_rdma_poll(&ctx, resp);
+  len = resp->tx_avail;
+  fast_rdma_txfill(resp, buf, len);
+  rdma_deliver(&ctx, 0, buf, len);
+  test_assert("send not ready", wqe->status == RDMA_RECV_NOT_READY &&
+      req->cq_head == sizeof(*wqe));
+
+  /* attached again, positions are unchanged */
+  resp->wq_base = wq_base;
+  fast_rdmarcv_bump(&ctx, 1, sizeof(*wqe));
+  test_assert("receive bump after attach", resp->rcv_head == sizeof(*wqe));
+}
+
+void test_rdma_retransmit(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct flextcp_pl_flowst *resp = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[3000], rebuf[3000];
+  uint32_t len;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  rdma_flow_init(1, 4 * sizeof(*wqe), 4096);
+  test_randinit((uint8_t *) (uintptr_t) req->mr_base, 4096);
+
+  /* two writes of 1000 bytes */
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  for (i = 0; i < 2; i++) {
+    wqe[i].id = i * sizeof(*wqe);
+    wqe[i].type = RDMA_OP_WRITE;
+    wqe[i].status = RDMA_PENDING;
+    wqe[i].loff = i * 1000;
+    wqe[i].roff = i * 1000;
+    wqe[i].len = 1000;
+  }
+  req->wq_head = 2 * sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  len = req->tx_avail;
+  test_assert("both queued", len == 2 * (16 + 1000));
+  test_assert("both logged", req->txb_head == 2 * sizeof(uint32_t));
+
+  fast_rdma_txfill(req, buf, 1448);
+  fast_rdma_txfill(req, buf + 1448, len - 1448);
+
+  /* first 500 bytes acknowledged, rest lost */
+  fast_rdma_txack(req, 500);
+  test_assert("tail not retired", req->txb_tail == 0 &&
+      req->txb_tail_acked == 500);
+  fast_rdma_txrewind(req);
+  test_assert("rewound to ack", req->txb_pos == 0 && req->txb_pos_sent == 500);
+  fast_rdma_txfill(req, rebuf + 500, len - 500);
+  test_assert("retransmission identical", memcmp(buf + 500, rebuf + 500,
+        len - 500) == 0);
+
+  /* acks retire messages in order */
+  fast_rdma_txack(req, 1016 - 500);
+  test_assert("first retired", req->txb_tail == sizeof(uint32_t) &&
+      req->txb_tail_acked == 0);
+  fast_rdma_txack(req, 1016);
+  test_assert("all retired", req->txb_tail == req->txb_head &&
+      req->txb_pos == req->txb_head);
+
+  /* responses free their RQ entries once acknowledged */
+  rdma_deliver(&ctx, 1, buf, len);
+  fast_rdma_poll(&ctx, resp);
+  test_assert("two responses", resp->tx_avail == 2 * 16);
+  fast_rdma_txfill(resp, buf, 2 * 16);
+  test_assert("rq entries held", resp->rqe_ack_pos == 0);
+  fast_rdma_txack(resp, 2 * 16);
+  test_assert("rq entries freed", resp->rqe_ack_pos == 2 * sizeof(*wqe));
+}
+
+void test_rdma_zerocopy(void *arg)
+{
+  struct flextcp_pl_flowst *req = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  struct rdma_wqe *wqe;
+  uint8_t buf[3000], zbuf[3000];
+  uint64_t addr;
+  uint32_t *refs;
+  uint16_t zc;
+
+  memset(&ctx, 0, sizeof(ctx));
+  rdma_flow_init(0, 4 * sizeof(*wqe), 4096);
+  test_randinit((uint8_t *) (uintptr_t) req->mr_base, 4096);
+
+  wqe = (struct rdma_wqe *) (uintptr_t) req->wq_base;
+  wqe[0].id = 0;
+  wqe[0].type = RDMA_OP_WRITE;
+  wqe[0].status = RDMA_PENDING;
+  wqe[0].loff = 100;
+  wqe[0].roff = 0;
+  wqe[0].len = 2000;
+  req->wq_head = sizeof(*wqe);
+  fast_rdma_poll(&ctx, req);
+  fast_rdma_txfill(req, buf, 16 + 2000);
+  fast_rdma_txrewind(req);
+
+  /* header is copied, payload referenced in the memory region */
+  zc = fast_rdma_txzc(req, 1448, 256);
+  test_assert("zc after header", zc == 1448 - 16);
+  fast_rdma_txfill(req, zbuf, 1448 - zc);
+  addr = fast_rdma_txskip(req, zc, &refs);
+  test_assert("zc address", addr == req->mr_base + 100);
+  test_assert("zc region refs", refs == &state_base.flow_mrs[0][0].zc_refs);
+  memcpy(zbuf + 16, (uint8_t *) (uintptr_t) addr, zc);
+
+  /* remainder below threshold and segments spanning messages are copied */
+  test_assert("zc too short", fast_rdma_txzc(req, 200, 256) == 0);
+  test_assert("zc spans message", fast_rdma_txzc(req, 1000, 256) == 0);
+  zc = fast_rdma_txzc(req, 16 + 2000 - 1448, 256);
+  test_assert("zc remainder", zc == 16 + 2000 - 1448);
+  addr = fast_rdma_txskip(req, zc, &refs);
+  memcpy(zbuf + 1448, (uint8_t *) (uintptr_t) addr, zc);
+  test_assert("zc identical", memcmp(buf, zbuf, 16 + 2000) == 0);
+  test_assert("zc request sent", req->txb_pos == req->txb_head &&
+      wqe[0].status == RDMA_RESP_PENDING);
+}
+
 int main(int argc, char *argv[])
 {
   int ret = 0;
@@ -318,5 +1548,69 @@ int main(int argc, char *argv[])
   if (test_subcase("retransmit", test_retransmit, NULL))
     ret = 1;
 
+  if (test_subcase("rdma read", test_rdma_read, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma write segmented", test_rdma_write_segmented, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma write sgl", test_rdma_write_sgl, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma direct placement", test_rdma_direct_place, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma retransmit", test_rdma_retransmit, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma send recv", test_rdma_send_recv, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma write inline", test_rdma_write_inline, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma write imm", test_rdma_write_imm, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma mr keys", test_rdma_mr_keys, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma mr released", test_rdma_mr_released, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma wq detached", test_rdma_wq_detached, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma atomic", test_rdma_atomic, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma invalid wqe", test_rdma_invalid_wqe, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma rq full", test_rdma_rq_full, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma resp mismatch", test_rdma_resp_mismatch, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma unsignaled", test_rdma_unsignaled, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma unsignaled failed", test_rdma_unsignaled_failed,
+        NULL))
+    ret = 1;
+
+  if (test_subcase("rdma txlog len", test_rdma_txlog_len, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma notify merge", test_rdma_notify_merge, NULL))
+    ret = 1;
+
+  if (test_subcase("arx deferred", test_arx_deferred, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma zerocopy", test_rdma_zerocopy, NULL))
+    ret = 1;
+
   return ret;
 }
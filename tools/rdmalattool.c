@@ -0,0 +1,205 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Dumps the RDMA latency histograms of TAS fast path cores and librdma
+ * contexts (built with FLEXNIC_RDMA_LATENCY), optionally every n seconds:
+ *
+ *   rdmalattool [interval]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+
+#include <tas_rdma_lat.h>
+#include <utils.h>
+
+#define SHM_DIR "/dev/shm"
+#define SHM_PREFIX "flexnic_rdmalat_"
+
+static const char *stage_names[RDMA_LAT_STAGES] = {
+  [RDMA_LAT_POST_BUMP] = "post->bump",
+  [RDMA_LAT_BUMP_TX] = "bump->tx",
+  [RDMA_LAT_TX_RESP] = "tx->resp",
+  [RDMA_LAT_RQ_PLACE] = "rq-place",
+  [RDMA_LAT_RESP_CQ] = "resp->cq",
+  [RDMA_LAT_TOTAL] = "post->cq",
+};
+
+static const double pcts[] = { 50., 90., 99., 99.9 };
+#define PCTS_NUM (sizeof(pcts) / sizeof(pcts[0]))
+
+/** TSC frequency if no segment provides it */
+static uint64_t tsc_hz_calibrated = 0;
+
+static uint64_t calibrate_tsc(void)
+{
+  struct timespec ts_before, ts_after;
+  uint64_t tsc, ns;
+
+  if (tsc_hz_calibrated != 0)
+    return tsc_hz_calibrated;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts_before);
+  tsc = util_rdtsc();
+  usleep(100000);
+  tsc = util_rdtsc() - tsc;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts_after);
+
+  ns = (ts_after.tv_sec - ts_before.tv_sec) * 1000000000ULL +
+    ts_after.tv_nsec - ts_before.tv_nsec;
+  tsc_hz_calibrated = tsc * 1000000000ULL / ns;
+  return tsc_hz_calibrated;
+}
+
+static struct flexnic_rdma_lat *lat_connect(const char *name)
+{
+  struct flexnic_rdma_lat *lat;
+  int fd;
+
+  if ((fd = shm_open(name, O_RDONLY, 0)) == -1) {
+    return NULL;
+  }
+
+  lat = mmap(NULL, sizeof(*lat), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (lat == MAP_FAILED) {
+    return NULL;
+  }
+  return lat;
+}
+
+/** Value at percentile pct: the upper end of the bucket it falls in */
+static uint64_t hist_pct(const struct flexnic_rdma_lat_hist *h,
+    uint64_t count, double pct)
+{
+  uint64_t target, sum = 0;
+  unsigned i;
+
+  target = (uint64_t) (count * pct / 100.);
+  if (target == 0) {
+    target = 1;
+  }
+
+  for (i = 0; i < RDMA_LAT_BUCKETS; i++) {
+    sum += h->buckets[i];
+    if (sum >= target) {
+      if (i + 1 == RDMA_LAT_BUCKETS) {
+        return h->max;
+      }
+      return MIN(rdma_lat_bucket_value(i + 1) - 1, h->max);
+    }
+  }
+  return h->max;
+}
+
+static void lat_dump(const char *name, const struct flexnic_rdma_lat *lat)
+{
+  const struct flexnic_rdma_lat_hist *h;
+  uint64_t count, hz;
+  double ns;
+  unsigned i, j;
+
+  hz = lat->tsc_hz != 0 ? lat->tsc_hz : calibrate_tsc();
+  ns = 1000000000. / hz;
+
+  for (i = 0; i < RDMA_LAT_STAGES; i++) {
+    h = &lat->hist[i];
+    /* histograms are updated live, the count is only a snapshot */
+    if ((count = h->count) == 0) {
+      continue;
+    }
+
+    printf("%-16s %-10s n=%-10"PRIu64" mean=%-9.0f min=%-9.0f", name,
+        stage_names[i], count, (double) h->sum / count * ns, h->min * ns);
+    for (j = 0; j < PCTS_NUM; j++) {
+      printf(" p%g=%-9.0f", pcts[j], hist_pct(h, count, pcts[j]) * ns);
+    }
+    printf(" max=%.0f (ns)\n", h->max * ns);
+  }
+}
+
+static int dump_all(void)
+{
+  struct flexnic_rdma_lat *lat;
+  struct dirent *de;
+  DIR *dir;
+  int n = 0;
+
+  if ((dir = opendir(SHM_DIR)) == NULL) {
+    perror("dump_all: opendir failed");
+    return -1;
+  }
+
+  while ((de = readdir(dir)) != NULL) {
+    if (strncmp(de->d_name, SHM_PREFIX, strlen(SHM_PREFIX)) != 0) {
+      continue;
+    }
+    if ((lat = lat_connect(de->d_name)) == NULL) {
+      fprintf(stderr, "dump_all: connecting to %s failed\n", de->d_name);
+      continue;
+    }
+
+    lat_dump(de->d_name + strlen(SHM_PREFIX), lat);
+    munmap(lat, sizeof(*lat));
+    n++;
+  }
+  closedir(dir);
+
+  if (n == 0) {
+    fprintf(stderr, "no latency histograms found, is TAS built with "
+        "FLEXNIC_RDMA_LATENCY?\n");
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned interval = 0;
+
+  if (argc >= 2) {
+    interval = atoi(argv[1]);
+  }
+
+  do {
+    if (dump_all() != 0) {
+      return EXIT_FAILURE;
+    }
+    if (interval != 0) {
+      printf("\n");
+      fflush(stdout);
+      sleep(interval);
+    }
+  } while (interval != 0);
+
+  return EXIT_SUCCESS;
+}
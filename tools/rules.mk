@@ -1,6 +1,6 @@
 include mk/subdir_pre.mk
 
-tools := tracetool statetool scaletool
+tools := tracetool statetool scaletool rdmalattool
 execs := $(addprefix $(d)/, $(tools))
 TOOLS_OBJS := $(addsuffix .o,$(execs))
 
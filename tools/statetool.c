@@ -100,6 +100,29 @@ static int dump_appctx(uint16_t db_id)
   return 0;
 }
 
+/** dump counters of application contexts with a receive queue on a core */
+static void dump_appctx_cnt(uint16_t core)
+{
+  struct flextcp_pl_appctx *ctx;
+  uint16_t db_id;
+
+  for (db_id = 0; db_id < FLEXNIC_PL_APPCTX_NUM; db_id++) {
+    ctx = &plm->appctx[core][db_id];
+    if (ctx->rx_len == 0) {
+      continue;
+    }
+
+    printf("context %u core %u {\n"
+           "  rx {\n"
+           "             len=%08x\n"
+           "           avail=%08x\n"
+           "    arx_deferred=%10"PRIu64"\n"
+           "  }\n"
+           "}\n", db_id, core, ctx->rx_len, ctx->rx_avail,
+           ctx->cnt_arx_deferred);
+  }
+}
+
 static int dump_flow(uint32_t flow_id)
 {
   struct flextcp_pl_flowst *fs;
@@ -195,6 +218,9 @@ int main(int argc, char *argv[])
   for (i = 0; i < FLEXNIC_PL_APPCTX_NUM; i++) {
     dump_appctx(i);
   }
+  for (i = 0; i < FLEXNIC_PL_APPST_CTX_MCS; i++) {
+    dump_appctx_cnt(i);
+  }
   for (i = 0; i < FLEXNIC_PL_FLOWST_NUM; i++) {
     dump_flow(i);
   }